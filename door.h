@@ -0,0 +1,310 @@
+/*
+ * door.h
+ * The readers of the door and the scheduler that polls them. Each RC522 has
+ * its own SS pin and a direction: a tap on the reader outside the door is
+ * someone coming in, on the one inside someone leaving. With a single reader
+ * a tap toggles, as before.
+ *
+ * door_poll_start() starts a REQIDL on every reader at once, so the 15 ms a
+ * reader waits for an answer that does not come are spent by all of them
+ * together; the screen is composed meanwhile. door_poll_next() then returns
+ * the readers that got a card, in the order their polls end: a card at one
+ * reader does not wait for the empty poll of the other. Polls that end
+ * together are taken round-robin, from a reader that moves on by one every
+ * pass, so none is always served last when both sides of the door are busy.
+ *
+ * DOOR_READERS (default 1) is set before this file is included, the SS pins
+ * are free pins of PORTB next to the SPI port.
+ *
+ * The polls adapt to the door. For DOOR_HOT_MS after a card they follow each
+ * other back to back. Then the pause between two polls starts at DOOR_GAP_MS
+ * and doubles after every empty one, up to the limit of the phase given to
+ * door_poll_start(). In a pause the readers are in soft power-down and the
+ * CPU sleeps; Timer1 compare A wakes it, DOOR_WAKE_MS before the poll the
+ * readers are powered up so that the cards in the field have power when the
+ * REQIDL comes. A card that was read and halted would come back as a new tap
+ * once the field returns, so a reader that halted a card is only powered down
+ * after a WUPA found nothing in its field.
+ *
+ * Needs sched.h.
+ */
+#ifndef DOOR_H
+#define DOOR_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <avr/sleep.h>
+#include "mfrc522.h"
+
+#ifndef DOOR_READERS
+#define DOOR_READERS	1
+#endif
+
+#define DOOR_HOT_MS		2000	//polls back to back this long after the last card
+#define DOOR_GAP_MS		25		//the first pause after that
+#define DOOR_WAKE_MS	7		//the oscillator starts, then 5 ms of field before a REQA (ISO/IEC 14443-3)
+
+//which way a tap on the reader goes
+#define DOOR_IN			1
+#define DOOR_OUT		2
+#define DOOR_BOTH		(DOOR_IN|DOOR_OUT)	//a single reader, a tap toggles
+
+struct door_reader
+{
+	struct mfrc522 rc;
+	uint8_t direction;
+	uint8_t atqa[MAX_LEN];	//answer to the REQIDL of the pass
+	uint8_t asleep;			//in soft power-down
+	uint8_t halted;			//a card was halted since the reader was powered down
+};
+
+#if DOOR_READERS == 1
+static const uint8_t door_ss[1] = {SPI_SS};
+static const uint8_t door_direction[1] = {DOOR_BOTH};
+#elif DOOR_READERS == 2
+//a reader on either side of the door
+static const uint8_t door_ss[2] = {SPI_SS, PB3};
+static const uint8_t door_direction[2] = {DOOR_IN, DOOR_OUT};
+#elif DOOR_READERS == 3
+//a double door: two readers outside, one inside
+static const uint8_t door_ss[3] = {SPI_SS, PB3, PB1};
+static const uint8_t door_direction[3] = {DOOR_IN, DOOR_OUT, DOOR_IN};
+#else
+#error "DOOR_READERS is 1, 2 or 3"
+#endif
+
+struct door_reader door_readers[DOOR_READERS];
+uint8_t door_first;			//reader looked at first in the next pass
+uint8_t door_next;
+uint8_t door_pending;		//a bit per reader whose poll is not finished yet
+uint8_t door_found;			//a card answered in the pass
+uint8_t door_skipped;		//the pass did not poll, the CPU sleeps instead
+uint8_t door_asleep;		//some reader is in soft power-down
+uint16_t door_gap;			//ms from one poll to the next, 0 back to back
+uint16_t door_gap_max;		//of the phase
+uint32_t door_due;			//tick of the next poll
+uint32_t door_seen;			//tick of the last card
+
+//every SS pin goes high before the first frame on the bus
+void door_init(void)
+{
+	uint8_t i;
+	door_seen = -SCHED_MS(DOOR_HOT_MS);		//no card yet
+	for(i = 0; i < DOOR_READERS; i++)
+	{
+		door_readers[i].direction = door_direction[i];
+		mfrc522_attach(&door_readers[i].rc, door_ss[i]);
+	}
+	for(i = 0; i < DOOR_READERS; i++)
+	{
+		mfrc522_init(&door_readers[i].rc);
+	}
+}
+
+//1 when every reader answers with its version
+uint8_t door_detect(void)
+{
+	uint8_t i;
+	for(i = 0; i < DOOR_READERS; i++)
+	{
+		if(!mfrc522_version_ok(mfrc522_read(&door_readers[i].rc, VersionReg)))
+		{
+			return 0;
+		}
+	}
+	return 1;
+}
+
+//the health check of every reader, once per pass
+void door_session(void)
+{
+	uint8_t i;
+	for(i = 0; i < DOOR_READERS; i++)
+	{
+		mfrc522_session(&door_readers[i].rc);
+	}
+}
+
+//the readers in soft power-down are powered up
+void door_wake(void)
+{
+	uint8_t i;
+	for(i = 0; i < DOOR_READERS; i++)
+	{
+		if(door_readers[i].asleep)
+		{
+			mfrc522_power_up(&door_readers[i].rc);
+			door_readers[i].asleep = 0;
+		}
+	}
+	door_asleep = 0;
+}
+
+//soft power-down of the readers without a halted card in their field
+void door_rest(void)
+{
+	struct door_reader *reader;
+	uint8_t i;
+	for(i = 0; i < DOOR_READERS; i++)
+	{
+		reader = &door_readers[i];
+		if(reader->asleep)
+		{
+			continue;
+		}
+		if(reader->halted)
+		{
+			//WUPA wakes the halted cards too, the REQIDL of the next poll sends them back to HALT
+			if(mfrc522_request(&reader->rc, PICC_REQALL, reader->atqa) == CARD_FOUND)
+			{
+				continue;
+			}
+			reader->halted = 0;
+		}
+		mfrc522_power_down(&reader->rc);
+		reader->asleep = 1;
+		door_asleep = 1;
+	}
+}
+
+/*
+ * Until the next poll or the next task of the scheduler: the CPU sleeps,
+ * Timer1 compare A wakes it at that tick at the latest (the tick is TCNT1
+ * / 1024, TCNT1 comes round to it every 65 ms). Any other interrupt, the
+ * button or the USART, wakes it too.
+ */
+void door_sleep(void)
+{
+	uint32_t next;
+	
+	next = door_asleep ? door_due - SCHED_MS(DOOR_WAKE_MS) : door_due;
+	next = sched_next(next);
+	if((int32_t)(next - sched_now()) <= 0)
+	{
+		return;
+	}
+#if MFRC522_CONFIG_IRQ
+	mfrc522_alarm((uint16_t)(next << 10));
+#endif
+	set_sleep_mode(SLEEP_MODE_IDLE);
+	sleep_mode();
+}
+
+/*
+ * REQIDL: cards handled before are halted and stay quiet until they leave the field.
+ * gap_max is the longest pause between two polls in the phase, in ms.
+ */
+void door_poll_start(uint16_t gap_max)
+{
+	uint32_t now = sched_now();
+	uint8_t i;
+	
+	door_found = 0;
+	door_pending = 0;
+	door_gap_max = gap_max;
+	//a phase that polls more often than the one before
+	if((int32_t)(door_due - now) > (int32_t)SCHED_MS(gap_max))
+	{
+		door_due = now + SCHED_MS(gap_max);
+	}
+	if(door_asleep && (int32_t)(door_due - now) <= (int32_t)SCHED_MS(DOOR_WAKE_MS))
+	{
+		door_wake();
+		//the cards need the field for DOOR_WAKE_MS, also when the pass is late
+		if((int32_t)(door_due - now) < (int32_t)SCHED_MS(DOOR_WAKE_MS))
+		{
+			door_due = now + SCHED_MS(DOOR_WAKE_MS);
+		}
+	}
+	if((int32_t)(now - door_due) < 0)
+	{
+		door_skipped = 1;
+		return;
+	}
+	
+	for(i = 0; i < DOOR_READERS; i++)
+	{
+		mfrc522_request_start(&door_readers[i].rc, PICC_REQIDL, door_readers[i].atqa);
+	}
+	door_next = door_first;
+	door_pending = (1<<DOOR_READERS) - 1;
+	if(++door_first == DOOR_READERS)
+	{
+		door_first = 0;
+	}
+}
+
+/*
+ * At the end of a pass: back to back while cards come, else the next pause,
+ * twice the last one, with the readers in soft power-down.
+ */
+void door_pace(void)
+{
+	uint32_t now = sched_now();
+	
+	if(door_found)
+	{
+		door_seen = now;
+	}
+	if(now - door_seen < SCHED_MS(DOOR_HOT_MS))
+	{
+		door_gap = 0;
+		door_due = now;
+		return;
+	}
+	door_gap = door_gap == 0 ? DOOR_GAP_MS : door_gap * 2;
+	if(door_gap > door_gap_max)
+	{
+		door_gap = door_gap_max;
+	}
+	door_due = now + SCHED_MS(door_gap);
+	door_rest();
+}
+
+//the next reader of the pass with a card in its field, NULL when all polls are finished
+struct door_reader *door_poll_next(void)
+{
+	struct door_reader *reader;
+	uint8_t i;
+	
+	//no poll in this pass, the CPU sleeps until the next
+	if(door_skipped)
+	{
+		door_skipped = 0;
+		door_sleep();
+		return NULL;
+	}
+	while(door_pending)
+	{
+		for(i = 0; i < DOOR_READERS; i++)
+		{
+			reader = &door_readers[door_next];
+			if((door_pending & (1<<door_next)) && !mfrc522_to_card_busy(&reader->rc))
+			{
+				door_pending &= ~(1<<door_next);
+				if(mfrc522_request_finish(&reader->rc, reader->atqa) == CARD_FOUND)
+				{
+					door_found = 1;
+					reader->halted = 1;
+					return reader;
+				}
+			}
+			if(++door_next == DOOR_READERS)
+			{
+				door_next = 0;
+			}
+		}
+		if(door_pending)
+		{
+			mfrc522_wait();
+		}
+	}
+	door_pace();
+	return NULL;
+}
+
+//whether a tap on the reader is someone leaving, given whether the student is inside
+#define door_leaving(reader, is_inside) \
+	((reader)->direction == DOOR_BOTH ? (is_inside) : (reader)->direction == DOOR_OUT)
+
+#endif /* DOOR_H */
@@ -0,0 +1,114 @@
+/*
+ * eeprom_queue.h
+ * Write-behind queue for the EEPROM: eeprom_queue_write() only stores the
+ * byte, the EE_RDY interrupt programs the queued bytes one after the other
+ * while the main loop keeps running.
+ *
+ * A byte queued for an address that is still waiting replaces the older
+ * byte. eeprom_queue_flush() waits until everything queued is in the EEPROM,
+ * read the EEPROM only after it.
+ */
+#ifndef EEPROM_QUEUE_H
+#define EEPROM_QUEUE_H
+
+#include <stdint.h>
+#include <avr/io.h>
+#include <avr/interrupt.h>
+#include <avr/eeprom.h>
+
+//a power of 2, a journal record takes 6 entries
+#define EEPROM_QUEUE_SIZE	32
+
+struct eeprom_queue_entry
+{
+	uint8_t *addr;
+	uint8_t data;
+};
+
+struct eeprom_queue_entry eeprom_queue[EEPROM_QUEUE_SIZE];
+volatile uint8_t eeprom_queue_head;		//next entry to program
+volatile uint8_t eeprom_queue_tail;		//next free entry
+
+//programs the oldest queued byte, the EEPROM must be ready
+void eeprom_queue_program(void)
+{
+	struct eeprom_queue_entry *e = &eeprom_queue[eeprom_queue_head];
+	
+	//starts the write and returns, unchanged bytes are not written again
+	eeprom_update_byte(e->addr, e->data);
+	eeprom_queue_head = (eeprom_queue_head + 1) & (EEPROM_QUEUE_SIZE - 1);
+}
+
+//EEPROM ready for the next byte, the interrupt stays on until the queue is empty
+ISR(EE_RDY_vect)
+{
+	if(eeprom_queue_head == eeprom_queue_tail)
+	{
+		EECR &= ~(1<<EERIE);
+		return;
+	}
+	eeprom_queue_program();
+}
+
+void eeprom_queue_write(uint8_t *addr, uint8_t data)
+{
+	uint8_t sreg, i;
+	
+	sreg = SREG;
+	cli();
+	//a write to the same address still waiting in the queue takes the new value
+	for(i = eeprom_queue_head; i != eeprom_queue_tail; i = (i + 1) & (EEPROM_QUEUE_SIZE - 1))
+	{
+		if(eeprom_queue[i].addr == addr)
+		{
+			eeprom_queue[i].data = data;
+			SREG = sreg;
+			return;
+		}
+	}
+	//queue full: program the oldest byte here
+	if(((eeprom_queue_tail + 1) & (EEPROM_QUEUE_SIZE - 1)) == eeprom_queue_head)
+	{
+		eeprom_busy_wait();
+		eeprom_queue_program();
+	}
+	eeprom_queue[eeprom_queue_tail].addr = addr;
+	eeprom_queue[eeprom_queue_tail].data = data;
+	eeprom_queue_tail = (eeprom_queue_tail + 1) & (EEPROM_QUEUE_SIZE - 1);
+	EECR |= (1<<EERIE);
+	SREG = sreg;
+}
+
+void eeprom_queue_write_block(const void *src, void *dst, uint8_t n)
+{
+	for(uint8_t i = 0; i < n; i++)
+	{
+		eeprom_queue_write((uint8_t *)dst + i, ((const uint8_t *)src)[i]);
+	}
+}
+
+//barrier: returns when every queued byte is programmed
+void eeprom_queue_flush(void)
+{
+	if(SREG & (1<<SREG_I))
+	{
+		//the interrupt drains the queue
+		while(eeprom_queue_head != eeprom_queue_tail)
+		{
+			eeprom_busy_wait();
+		}
+	}
+	else
+	{
+		//interrupts off (before sei() or in an ISR): program the queue here
+		EECR &= ~(1<<EERIE);
+		while(eeprom_queue_head != eeprom_queue_tail)
+		{
+			eeprom_busy_wait();
+			eeprom_queue_program();
+		}
+	}
+	eeprom_busy_wait();
+}
+
+#endif /* EEPROM_QUEUE_H */
@@ -0,0 +1,258 @@
+/*
+ * export.h
+ * The attendance over the USART in frames, read on a PC with
+ * host/export_decode.c.
+ *
+ * The USART runs at 62500 baud 8N1 (U2X, UBRR = 1, exact at 1 MHz) on RXD
+ * PD0 and TXD PD1. Receiving EXPORT_COMMAND starts an export. The main loop
+ * (export_poll()) packs whole frames into a ring while it has room for the
+ * largest one, and the UDRE interrupt sends the ring a byte at a time. The
+ * reader and the clock go on meanwhile.
+ *
+ * A frame:
+ *   EXPORT_SOF  type  length  payload[length]  crc (2)
+ * crc is the CRC-16/CCITT of _crc_ccitt_update(), starting from 0xFFFF, over
+ * type, length and payload. The decoder drops a frame that fails it and looks
+ * for the next EXPORT_SOF. Numbers are little endian.
+ *   EXPORT_HELLO	version, students, arrival unit in s (2), first day (2),
+ *					last day (2)
+ *   EXPORT_NAME	student, the name
+ *   EXPORT_DAY		day (2), present (a bit per student, as in presence.h),
+ *					the arrival of every student present, in roster order, in
+ *					arrival units since the device was switched on, 255 for
+ *					255 units or later (HISTORY_ARRIVAL_MAX)
+ *   EXPORT_END		number of frames before it (2)
+ *   EXPORT_TAP		sequence (2), day (2), time in s (2), EXPORT_TAP_IN, _OUT
+ *					or _DENIED, student (0xFF unknown), students inside
+ * A class of 30 over 64 days is about 2.6 KB, 0.4 s on the line.
+ *
+ * EXPORT_TAP goes out by itself on every tap (export_tap()), for a gateway
+ * that collects the rooms (host/gateway.c). When the ring has no room, the
+ * tap is lost, and the gap in the sequence numbers shows it. The sequence
+ * starts at 1 after every reset.
+ *
+ * Needs roster.h and history.h.
+ */
+#ifndef EXPORT_H
+#define EXPORT_H
+
+#include <stdint.h>
+#include <string.h>
+#include <avr/io.h>
+#include <avr/interrupt.h>
+#include <avr/pgmspace.h>
+#include <util/crc16.h>
+
+//62500 baud
+#define EXPORT_UBRR			1
+
+//byte from the PC that starts an export
+#define EXPORT_COMMAND		'E'
+
+#define EXPORT_SOF			0x7E
+#define EXPORT_VERSION		1
+
+#define EXPORT_HELLO		'H'
+#define EXPORT_NAME			'N'
+#define EXPORT_DAY			'D'
+#define EXPORT_END			'Z'
+#define EXPORT_TAP			'T'
+
+#define EXPORT_TAP_LENGTH	9
+#define EXPORT_TAP_IN		'I'
+#define EXPORT_TAP_OUT		'O'
+#define EXPORT_TAP_DENIED	'?'
+
+//SOF, type, length and crc around the payload
+#define EXPORT_FRAMING		5
+#define EXPORT_DAY_MAX		(2 + PRESENCE_BYTES(HISTORY_STUDENTS) + HISTORY_STUDENTS)
+#define EXPORT_NAME_MAX		(1 + ROSTER_NAME_LEN)
+#define EXPORT_FRAME_MAX	(EXPORT_FRAMING + (EXPORT_DAY_MAX > EXPORT_NAME_MAX ? EXPORT_DAY_MAX : EXPORT_NAME_MAX))
+
+#if EXPORT_FRAMING + EXPORT_DAY_MAX > 255 || EXPORT_FRAMING + EXPORT_NAME_MAX > 255
+#error "a frame does not fit the ring of the export"
+#endif
+
+//what export_poll() does next
+#define EXPORT_STEP_IDLE	0
+#define EXPORT_STEP_HELLO	1
+#define EXPORT_STEP_NAMES	2
+#define EXPORT_STEP_DAYS	3
+#define EXPORT_STEP_END		4
+
+//256 bytes, the uint8_t indices wrap with it
+uint8_t export_ring[256];
+volatile uint8_t export_head;		//end of the frames handed over
+volatile uint8_t export_tail;		//next byte the interrupt sends
+uint8_t export_fill;				//end of the frame being packed
+uint16_t export_crc;
+
+volatile uint8_t export_request;
+uint8_t export_step;
+uint16_t export_item;				//student or day
+uint16_t export_frames;
+uint16_t export_tap_seq;
+
+void export_init(void)
+{
+	UBRRH = 0;
+	UBRRL = EXPORT_UBRR;
+	UCSRA = (1<<U2X);
+	UCSRC = (1<<URSEL) | (1<<UCSZ1) | (1<<UCSZ0);
+	UCSRB = (1<<RXCIE) | (1<<RXEN) | (1<<TXEN);
+}
+
+ISR(USART_RXC_vect)
+{
+	if(UDR == EXPORT_COMMAND)
+	{
+		export_request = 1;
+	}
+}
+
+//the ring a byte at a time, off when it is empty
+ISR(USART_UDRE_vect)
+{
+	if(export_tail != export_head)
+	{
+		UDR = export_ring[export_tail++];
+	}
+	else
+	{
+		UCSRB &= ~(1<<UDRIE);
+	}
+}
+
+void export_put(uint8_t byte)
+{
+	export_crc = _crc_ccitt_update(export_crc, byte);
+	export_ring[export_fill++] = byte;
+}
+
+void export_put16(uint16_t value)
+{
+	export_put(value & 0xFF);
+	export_put(value >> 8);
+}
+
+void export_begin(uint8_t type, uint8_t length)
+{
+	export_fill = export_head;
+	export_ring[export_fill++] = EXPORT_SOF;
+	export_crc = 0xFFFF;
+	export_put(type);
+	export_put(length);
+}
+
+//the frame goes to the interrupt
+void export_end(void)
+{
+	uint16_t crc = export_crc;
+
+	export_put16(crc);
+	export_head = export_fill;
+	export_frames++;
+	UCSRB |= (1<<UDRIE);
+}
+
+//a tap as it happens, `student` is ROSTER_NONE for a card that is not in the roster
+void export_tap(uint8_t kind, int16_t student, uint8_t inside, uint16_t time)
+{
+	export_tap_seq++;
+	if((uint8_t)(export_tail - export_head - 1) < EXPORT_FRAMING + EXPORT_TAP_LENGTH)
+	{
+		return;
+	}
+	export_begin(EXPORT_TAP, EXPORT_TAP_LENGTH);
+	export_put16(export_tap_seq);
+	export_put16(journal_day);
+	export_put16(time);
+	export_put(kind);
+	export_put(student < 0 ? 0xFF : student);
+	export_put(inside);
+	export_end();
+}
+
+//packs the next frames while the ring has room for them
+void export_poll(void)
+{
+	uint8_t present[PRESENCE_BYTES(HISTORY_STUDENTS)];
+	uint8_t arrival[HISTORY_STUDENTS];
+	const char *name;
+	uint16_t first = history.count ? history.first_day : journal_day;
+	uint16_t i;
+	uint8_t n;
+
+	if(export_request && export_step == EXPORT_STEP_IDLE)
+	{
+		export_request = 0;
+		export_frames = 0;
+		export_step = EXPORT_STEP_HELLO;
+	}
+	while(export_step != EXPORT_STEP_IDLE && (uint8_t)(export_tail - export_head - 1) >= EXPORT_FRAME_MAX)
+	{
+		switch(export_step)
+		{
+			case EXPORT_STEP_HELLO:
+				export_begin(EXPORT_HELLO, 8);
+				export_put(EXPORT_VERSION);
+				export_put(HISTORY_STUDENTS);
+				export_put16(HISTORY_ARRIVAL_UNIT);
+				export_put16(first);
+				export_put16(journal_day);
+				export_end();
+				export_item = 0;
+				export_step = EXPORT_STEP_NAMES;
+				break;
+			case EXPORT_STEP_NAMES:
+				if(export_item == HISTORY_STUDENTS)
+				{
+					export_item = first;
+					export_step = EXPORT_STEP_DAYS;
+					break;
+				}
+				name = roster_name(export_item);
+				n = strlen_P(name);
+				export_begin(EXPORT_NAME, 1 + n);
+				export_put(export_item);
+				for(i = 0; i < n; i++)
+				{
+					export_put(pgm_read_byte(name + i));
+				}
+				export_end();
+				export_item++;
+				break;
+			case EXPORT_STEP_DAYS:
+				if(export_item == 0 || export_item > journal_day)
+				{
+					export_step = EXPORT_STEP_END;
+					break;
+				}
+				//the days before today from the history, today from the journal
+				if(export_item < journal_day ? history_day(export_item, present, arrival) : history_replay_journal(present, arrival))
+				{
+					export_begin(EXPORT_DAY, 2 + PRESENCE_BYTES(HISTORY_STUDENTS) + presence_count(present, HISTORY_STUDENTS));
+					export_put16(export_item);
+					for(i = 0; i < PRESENCE_BYTES(HISTORY_STUDENTS); i++)
+					{
+						export_put(present[i]);
+					}
+					for(i = presence_next(present, HISTORY_STUDENTS, 0); i != PRESENCE_END; i = presence_next(present, HISTORY_STUDENTS, i + 1))
+					{
+						export_put(arrival[i]);
+					}
+					export_end();
+				}
+				export_item++;
+				break;
+			default:
+				export_begin(EXPORT_END, 2);
+				export_put16(export_frames);
+				export_end();
+				export_step = EXPORT_STEP_IDLE;
+				break;
+		}
+	}
+}
+
+#endif /* EXPORT_H */
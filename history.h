@@ -0,0 +1,414 @@
+/*
+ * history.h
+ * Attendance history of past days, compressed, in the EEPROM the journal
+ * leaves free.
+ *
+ * When a day is over its taps are folded from the journal into one block:
+ *   k			3 bits, Rice parameter of the day
+ *   present	one bit per student
+ *   arrivals	for every student present, in roster order, the time of the
+ *				(last) entry since the device was switched on, in units of
+ *				HISTORY_ARRIVAL_UNIT seconds, Rice coded with k: value >> k
+ *				in unary (1s ended by a 0), then the low k bits
+ * The bits are packed LSB first. Most students come in the first minutes,
+ * so an arrival takes one to three bits; k is the one that packs the day
+ * smallest. host/history_bench.c measures a class of 30: 12.6 bytes a day,
+ * a semester of 42 lectures fits.
+ *
+ * The blocks follow each other in a ring of HISTORY_BYTES bytes, the
+ * directory holds the length of every day's block. A day is found by adding
+ * up the lengths of the days before it in the directory, the blocks
+ * themselves are not read. The header (first day, where it starts, how much
+ * is used) is written after the block in one of two copies in turn; a copy
+ * torn by a power loss fails its CRC and the other one is used. When the
+ * ring is full the oldest days make room.
+ *
+ * How many were present is kept in RAM for every day of the directory,
+ * counted when the day is packed or unpacked the first time after start-up;
+ * history_total() only decodes a day it has not seen yet.
+ */
+#ifndef HISTORY_H
+#define HISTORY_H
+
+#include <stdint.h>
+#include <string.h>
+#include <avr/eeprom.h>
+#include <util/crc16.h>
+#include "eeprom_queue.h"
+#include "journal.h"
+#include "presence.h"
+
+#ifndef HISTORY_STUDENTS
+#define HISTORY_STUDENTS		ROSTER_SIZE
+#endif
+
+//resolution of the arrival times and their largest value: an arrival is kept in a
+//byte, 4 h 15 min after switch-on with the unit of a minute; a later one is stored
+//as HISTORY_ARRIVAL_MAX and stands for that time or later (the view marks it "+")
+#ifndef HISTORY_ARRIVAL_UNIT
+#define HISTORY_ARRIVAL_UNIT	60		//seconds
+#endif
+#define HISTORY_ARRIVAL_MAX		255
+
+//days in the directory, a semester of three lectures a week and then some
+#define HISTORY_DAYS			64
+
+#define HISTORY_HEADER			10
+//what is left of the 1 KB EEPROM for the blocks
+#define HISTORY_BYTES			(1024 - JOURNAL_SLOTS * JOURNAL_RECORD - HISTORY_DAYS - 2 * HISTORY_HEADER)
+
+//largest block: with k = 7 no arrival takes more than 9 bits
+#define HISTORY_BLOCK_MAX		((3 + HISTORY_STUDENTS + 9 * HISTORY_STUDENTS + 7) / 8)
+
+#if HISTORY_BLOCK_MAX > 255
+#error "the directory holds a block length in a byte, the class is too big"
+#endif
+//the largest class is 52 students: 1024 - 6 * (2n + 8) - 84 bytes hold 4 blocks of
+//(10n + 10) / 8; it follows JOURNAL_SLOTS, keep the README in step when that changes
+#if HISTORY_BYTES < 4 * HISTORY_BLOCK_MAX
+#error "the class is too big for the history in the 1 KB EEPROM"
+#endif
+
+uint8_t EEMEM history_header_copy[2][HISTORY_HEADER];
+uint8_t EEMEM history_dir[HISTORY_DAYS];
+uint8_t EEMEM history_data[HISTORY_BYTES];
+
+struct history_state
+{
+	uint8_t seq;		//of the header copy in use, the next one goes to the other copy
+	uint8_t count;		//days in the history
+	uint8_t oldest;		//directory entry of the oldest day
+	uint16_t first_day;	//number of the oldest day
+	uint16_t start;		//where the block of the oldest day starts in history_data
+	uint16_t used;		//bytes of all blocks
+};
+
+struct history_state history;
+
+//students present, by directory entry
+#define HISTORY_TOTAL_UNKNOWN	0xFF
+uint8_t history_totals[HISTORY_DAYS];
+
+//bits in RAM (writer) or in the ring (reader)
+struct history_bits
+{
+	uint8_t *block;
+	uint16_t at;		//byte in history_data, for the reader
+	uint16_t pos;		//bit
+	uint8_t byte;		//current byte of the reader
+};
+
+void history_put(struct history_bits *w, uint8_t value, uint8_t bits)
+{
+	while(bits--)
+	{
+		if(value & 1)
+		{
+			w->block[w->pos >> 3] |= 1 << (w->pos & 7);
+		}
+		value >>= 1;
+		w->pos++;
+	}
+}
+
+uint8_t history_get(struct history_bits *r, uint8_t bits)
+{
+	uint8_t value = 0;
+	
+	for(uint8_t i = 0; i < bits; i++)
+	{
+		if((r->pos & 7) == 0)
+		{
+			r->byte = eeprom_read_byte(&history_data[r->at]);
+			r->at = (r->at + 1) % HISTORY_BYTES;
+		}
+		value |= ((r->byte >> (r->pos & 7)) & 1) << i;
+		r->pos++;
+	}
+	return value;
+}
+
+uint8_t history_header_crc(const uint8_t *bytes)
+{
+	uint8_t crc = 0;
+	
+	for(uint8_t i = 0; i < HISTORY_HEADER - 1; i++)
+	{
+		crc = _crc8_ccitt_update(crc, bytes[i]);
+	}
+	return crc;
+}
+
+//the newer of the two header copies that are intact, an empty history without one
+void history_open(void)
+{
+	uint8_t bytes[HISTORY_HEADER];
+	uint8_t found = 0;
+	
+	memset(&history, 0, sizeof(history));
+	memset(history_totals, HISTORY_TOTAL_UNKNOWN, sizeof(history_totals));
+	eeprom_queue_flush();
+	for(uint8_t c = 0; c < 2; c++)
+	{
+		eeprom_read_block(bytes, history_header_copy[c], HISTORY_HEADER);
+		if(history_header_crc(bytes) != bytes[HISTORY_HEADER - 1] || bytes[2] >= HISTORY_DAYS)
+		{
+			continue;
+		}
+		if(found && (int8_t)(bytes[0] - history.seq) <= 0)
+		{
+			continue;
+		}
+		found = 1;
+		history.seq = bytes[0];
+		history.count = bytes[1];
+		history.oldest = bytes[2];
+		history.first_day = bytes[3] | ((uint16_t)bytes[4] << 8);
+		history.start = bytes[5] | ((uint16_t)bytes[6] << 8);
+		history.used = bytes[7] | ((uint16_t)bytes[8] << 8);
+	}
+}
+
+void history_write_header(void)
+{
+	uint8_t bytes[HISTORY_HEADER];
+	
+	history.seq++;
+	bytes[0] = history.seq;
+	bytes[1] = history.count;
+	bytes[2] = history.oldest;
+	bytes[3] = history.first_day & 0xFF;
+	bytes[4] = history.first_day >> 8;
+	bytes[5] = history.start & 0xFF;
+	bytes[6] = history.start >> 8;
+	bytes[7] = history.used & 0xFF;
+	bytes[8] = history.used >> 8;
+	bytes[9] = history_header_crc(bytes);
+	eeprom_queue_write_block(bytes, history_header_copy[history.seq & 1], HISTORY_HEADER);
+}
+
+//packs a day into `block` (HISTORY_BLOCK_MAX bytes), returns its length in bytes
+uint8_t history_encode(uint8_t *block, const uint8_t *present, const uint8_t *arrival)
+{
+	struct history_bits w = { block, 0, 0, 0 };
+	uint16_t size, best_size = 0xFFFF;
+	uint8_t k, best = 0;
+	uint16_t i;
+	
+	//the Rice parameter that packs this day smallest
+	for(k = 0; k < 8; k++)
+	{
+		size = 0;
+		for(i = presence_next(present, HISTORY_STUDENTS, 0); i != PRESENCE_END; i = presence_next(present, HISTORY_STUDENTS, i + 1))
+		{
+			size += (arrival[i] >> k) + 1 + k;
+		}
+		if(size < best_size)
+		{
+			best_size = size;
+			best = k;
+		}
+	}
+	
+	memset(block, 0, HISTORY_BLOCK_MAX);
+	history_put(&w, best, 3);
+	for(i = 0; i < HISTORY_STUDENTS; i++)
+	{
+		history_put(&w, presence_test(present, i), 1);
+	}
+	for(i = presence_next(present, HISTORY_STUDENTS, 0); i != PRESENCE_END; i = presence_next(present, HISTORY_STUDENTS, i + 1))
+	{
+		for(uint8_t q = arrival[i] >> best; q > 0; q--)
+		{
+			history_put(&w, 1, 1);
+		}
+		history_put(&w, 0, 1);
+		history_put(&w, arrival[i], best);
+	}
+	return (w.pos + 7) >> 3;
+}
+
+//the oldest day leaves the history
+void history_drop_oldest(void)
+{
+	uint8_t len = eeprom_read_byte(&history_dir[history.oldest]);
+	
+	history.start = (history.start + len) % HISTORY_BYTES;
+	history.used -= len;
+	history.oldest = (history.oldest + 1) % HISTORY_DAYS;
+	history.first_day++;
+	history.count--;
+}
+
+//adds `day`, the days in between (if any) are empty
+void history_append(uint16_t day, const uint8_t *present, const uint8_t *arrival)
+{
+	uint8_t block[HISTORY_BLOCK_MAX];
+	uint8_t len, i;
+	uint16_t at;
+	
+	//already in the history
+	if(history.count != 0 && day < history.first_day + history.count)
+	{
+		return;
+	}
+	//days the device was not used are empty blocks, a gap longer than the history starts over
+	if(history.count == 0 || day - (history.first_day + history.count) >= HISTORY_DAYS)
+	{
+		history.count = 0;
+		history.used = 0;
+		history.first_day = day;
+	}
+	while(history.first_day + history.count < day)
+	{
+		if(history.count == HISTORY_DAYS)
+		{
+			history_drop_oldest();
+		}
+		eeprom_queue_write(&history_dir[(history.oldest + history.count) % HISTORY_DAYS], 0);
+		history_totals[(history.oldest + history.count) % HISTORY_DAYS] = 0;
+		history.count++;
+	}
+	
+	len = history_encode(block, present, arrival);
+	while(history.count == HISTORY_DAYS || history.used + len > HISTORY_BYTES)
+	{
+		history_drop_oldest();
+	}
+	if(history.count == 0)
+	{
+		history.first_day = day;
+	}
+	at = (history.start + history.used) % HISTORY_BYTES;
+	for(i = 0; i < len; i++)
+	{
+		eeprom_queue_write(&history_data[at], block[i]);
+		at = (at + 1) % HISTORY_BYTES;
+	}
+	eeprom_queue_write(&history_dir[(history.oldest + history.count) % HISTORY_DAYS], len);
+	history_totals[(history.oldest + history.count) % HISTORY_DAYS] = presence_count(present, HISTORY_STUDENTS);
+	history.count++;
+	history.used += len;
+	
+	//the day counts once the header says so
+	history_write_header();
+}
+
+//unpacks `day`, returns 0 if it is not in the history
+uint8_t history_day(uint16_t day, uint8_t *present, uint8_t *arrival)
+{
+	struct history_bits r = { NULL, history.start, 0, 0 };
+	uint8_t k, len;
+	uint16_t i, n;
+	
+	if(history.count == 0 || day < history.first_day || day - history.first_day >= history.count)
+	{
+		return 0;
+	}
+	eeprom_queue_flush();
+	//the lengths of the days before it in the directory
+	n = day - history.first_day;
+	for(i = 0; i < n; i++)
+	{
+		r.at += eeprom_read_byte(&history_dir[(history.oldest + i) % HISTORY_DAYS]);
+	}
+	r.at %= HISTORY_BYTES;
+	
+	presence_fill(present, HISTORY_STUDENTS, 0);
+	len = eeprom_read_byte(&history_dir[(history.oldest + n) % HISTORY_DAYS]);
+	if(len == 0)
+	{
+		//the device was not used that day
+		history_totals[(history.oldest + n) % HISTORY_DAYS] = 0;
+		return 1;
+	}
+	k = history_get(&r, 3);
+	for(i = 0; i < HISTORY_STUDENTS; i++)
+	{
+		if(history_get(&r, 1))
+		{
+			presence_set(present, i);
+		}
+	}
+	for(i = presence_next(present, HISTORY_STUDENTS, 0); i != PRESENCE_END; i = presence_next(present, HISTORY_STUDENTS, i + 1))
+	{
+		uint8_t q = 0;
+		
+		while(history_get(&r, 1))
+		{
+			q++;
+		}
+		arrival[i] = (q << k) | history_get(&r, k);
+	}
+	history_totals[(history.oldest + n) % HISTORY_DAYS] = presence_count(present, HISTORY_STUDENTS);
+	return 1;
+}
+
+//students present on `day`, HISTORY_TOTAL_UNKNOWN if it is not in the history
+uint8_t history_total(uint16_t day)
+{
+	uint8_t present[PRESENCE_BYTES(HISTORY_STUDENTS)];
+	uint8_t arrival[HISTORY_STUDENTS];
+	uint8_t entry;
+	
+	if(history.count == 0 || day < history.first_day || day - history.first_day >= history.count)
+	{
+		return HISTORY_TOTAL_UNKNOWN;
+	}
+	entry = (history.oldest + (day - history.first_day)) % HISTORY_DAYS;
+	if(history_totals[entry] == HISTORY_TOTAL_UNKNOWN)
+	{
+		history_day(day, present, arrival);
+	}
+	return history_totals[entry];
+}
+
+//presence and arrivals of the journal's current day, returns 0 before the first day
+uint8_t history_replay_journal(uint8_t *present, uint8_t *arrival)
+{
+	struct journal_record r;
+	uint8_t n;
+	
+	presence_fill(present, HISTORY_STUDENTS, 0);
+	memset(arrival, 0, HISTORY_STUDENTS);
+	if(journal_day == 0)
+	{
+		return 0;
+	}
+	//the taps after the newest day record, and the copies before it of a continued day
+	for(n = journal_first(); n < journal_count; n++)
+	{
+		journal_read(journal_slot(n), &r);
+		if(r.value >= HISTORY_STUDENTS)
+		{
+			continue;
+		}
+		if(r.type == JOURNAL_IN)
+		{
+			//a student who left and came back counts from the last entry
+			uint16_t units = r.time / HISTORY_ARRIVAL_UNIT;
+			
+			presence_set(present, r.value);
+			arrival[r.value] = units < HISTORY_ARRIVAL_MAX ? units : HISTORY_ARRIVAL_MAX;
+		}
+		else if(r.type == JOURNAL_OUT)
+		{
+			presence_clear(present, r.value);
+		}
+	}
+	return 1;
+}
+
+//folds the taps of the journal's current day into the history, before the next day starts
+void history_close_day(void)
+{
+	uint8_t present[PRESENCE_BYTES(HISTORY_STUDENTS)];
+	uint8_t arrival[HISTORY_STUDENTS];
+	
+	if(history_replay_journal(present, arrival))
+	{
+		history_append(journal_day, present, arrival);
+	}
+}
+
+#endif /* HISTORY_H */
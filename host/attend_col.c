@@ -0,0 +1,82 @@
+/*
+ * attend_col.c
+ * Maps a columnar attendance file (attend_col.h) and checks that its columns
+ * lie inside it.
+ */
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "attend_col.h"
+
+static int inside(const struct attend_header *h, uint64_t off, uint64_t bytes)
+{
+	return off % ATTEND_ALIGN == 0 && off <= h->size && bytes <= h->size - off;
+}
+
+int attend_col_map(const char *path, struct attend_col *col)
+{
+	const struct attend_header *h;
+	struct stat st;
+	void *p;
+	int fd = open(path, O_RDONLY);
+
+	if (fd < 0 || fstat(fd, &st) != 0)
+	{
+		perror(path);
+		return -1;
+	}
+	if ((size_t)st.st_size < sizeof(*h))
+	{
+		fprintf(stderr, "%s: too short\n", path);
+		close(fd);
+		return -1;
+	}
+	p = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);
+	if (p == MAP_FAILED)
+	{
+		perror(path);
+		return -1;
+	}
+	h = p;
+	if (memcmp(h->magic, ATTEND_MAGIC, sizeof(h->magic)) != 0 || h->size != (uint64_t)st.st_size ||
+		!inside(h, h->room_off, (uint64_t)h->rooms * sizeof(struct attend_room)) ||
+		!inside(h, h->day_off, (uint64_t)h->rows * sizeof(uint16_t)) ||
+		!inside(h, h->present_off, (uint64_t)h->rows * h->words * sizeof(uint64_t)) ||
+		!inside(h, h->arrival_off, (uint64_t)h->rows * h->stride))
+	{
+		fprintf(stderr, "%s: not a columnar attendance file\n", path);
+		munmap(p, st.st_size);
+		return -1;
+	}
+	col->h = h;
+	col->room = (const void *)((const char *)p + h->room_off);
+	col->day = (const void *)((const char *)p + h->day_off);
+	col->present = (const void *)((const char *)p + h->present_off);
+	col->arrival = (const uint8_t *)p + h->arrival_off;
+	col->attended = (const void *)((const char *)p + h->attended_off);
+	col->size = st.st_size;
+	for (uint32_t i = 0; i < h->rooms; i++)
+	{
+		const struct attend_room *r = &col->room[i];
+
+		if (r->students > h->stride || r->students > 64 * h->words || (uint64_t)r->row + r->days > h->rows ||
+			r->day_words != (r->days + 63) / 64 ||
+			!inside(h, h->attended_off, (r->attended + (uint64_t)r->students * r->day_words) * sizeof(uint64_t)))
+		{
+			fprintf(stderr, "%s: room %u is damaged\n", path, i);
+			munmap(p, st.st_size);
+			return -1;
+		}
+	}
+	return 0;
+}
+
+void attend_col_unmap(struct attend_col *col)
+{
+	munmap((void *)col->h, col->size);
+}
@@ -0,0 +1,70 @@
+/*
+ * attend_col.h
+ * The attendance of many rooms in one columnar file, written by
+ * attend_ingest.c from EEPROM dumps and mapped by attend_query.c.
+ *
+ * A row is a day of a room; the rows are sorted by room, then day. Every
+ * column starts at a multiple of ATTEND_ALIGN and is an array indexed by
+ * row:
+ *   day		uint16_t, the device's day number
+ *   present	`words` uint64_t per row, a bit per student (bit i of word
+ *				i / 64), the days one after the other
+ *   arrival	`stride` bytes per row, the arrival of every student in
+ *				`arrival_unit` s since the device was switched on, 0 when
+ *				absent, ATTEND_ARRIVAL_MAX for that time or later
+ *   attended	the present column transposed: for every room and student,
+ *				`day_words` uint64_t with a bit per day of the room
+ * The rooms table comes first. A query on days scans `present`, and a query
+ * on students scans `attended`, each as one stretch of memory per room.
+ */
+#ifndef ATTEND_COL_H
+#define ATTEND_COL_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define ATTEND_MAGIC		"RFIDCOL1"
+#define ATTEND_ALIGN		64
+#define ATTEND_NAME_LEN		24
+#define ATTEND_ARRIVAL_MAX	255		/* the largest arrival of the device, or later */
+
+struct attend_header
+{
+	char magic[8];
+	uint32_t rooms, rows;
+	uint32_t words;				/* of a present row */
+	uint32_t stride;			/* bytes of an arrival row, the largest class */
+	uint32_t arrival_unit;		/* s */
+	uint32_t reserved;
+	uint64_t room_off, day_off, present_off, arrival_off, attended_off;
+	uint64_t size;
+};
+
+struct attend_room
+{
+	char name[ATTEND_NAME_LEN];
+	uint32_t row, days;			/* its first row and how many */
+	uint32_t students;
+	uint32_t day_words;			/* of a student in the attended column */
+	uint64_t attended;			/* its first word in the attended column */
+};
+
+/* the file mapped */
+struct attend_col
+{
+	const struct attend_header *h;
+	const struct attend_room *room;
+	const uint16_t *day;
+	const uint64_t *present;
+	const uint8_t *arrival;
+	const uint64_t *attended;
+	size_t size;
+};
+
+#define ATTEND_ROUND(n)		(((n) + ATTEND_ALIGN - 1) & ~(uint64_t)(ATTEND_ALIGN - 1))
+
+/* maps `path` read-only, -1 with a message if it is not a valid file */
+int attend_col_map(const char *path, struct attend_col *col);
+void attend_col_unmap(struct attend_col *col);
+
+#endif /* ATTEND_COL_H */
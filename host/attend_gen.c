@@ -0,0 +1,146 @@
+/*
+ * attend_gen.c
+ * EEPROM dumps of many rooms over a semester for attend_ingest, written by
+ * the firmware's history.h into the simulated EEPROM.
+ *
+ *   attend_gen [-r ROOMS] [-d DAYS] [-e EVERY] DIR
+ *
+ * Every room (default 1000) has a class of 30 and DAYS lectures (default
+ * 120). Its EEPROM is dumped every EVERY days (default 30) and after the last
+ * day, to DIR/rNNNN-dDDD.eeprom. The history holds about 42 days of a class
+ * of 30 (make bench), so the dumps overlap; with EVERY above that days are
+ * lost between two dumps and attend_query finds fewer than went in.
+ *
+ * The attendance is synthetic, as in history_bench.c: a student comes on 90%
+ * of the days, one in ten only on half of them; three in four come in the
+ * first two minutes, the rest over an entrance period of 15 min. What went in is
+ * printed in the terms of attend_query, to compare.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "sim.h"
+
+#define ROSTER_SIZE			30
+#define HISTORY_STUDENTS	ROSTER_SIZE
+
+/*
+ * The dumps are written at once: the write queue waits out every EEPROM
+ * write a cycle at a time, which is right for the firmware and only slow
+ * here.
+ */
+#define EEPROM_QUEUE_H
+#include <avr/eeprom.h>
+#define eeprom_queue_write(addr, data)	eeprom_write_byte((addr), (data))
+#define eeprom_queue_flush()			do {} while (0)
+
+static void eeprom_queue_write_block(const void *src, void *dst, uint8_t n)
+{
+	for (uint8_t i = 0; i < n; i++)
+	{
+		eeprom_write_byte((uint8_t *)dst + i, ((const uint8_t *)src)[i]);
+	}
+}
+
+#include "../history.h"
+
+#define ENTRANCE_S		900
+#define LATE_MIN		10
+#define CHRONIC_PCT		80
+
+int main(int argc, char **argv)
+{
+	unsigned rooms = 1000, n_days = 120, every = 30, dumps = 0;
+	unsigned long long present_n = 0, late_n = 0, chronic_n = 0, student_days = 0;
+	uint8_t present[PRESENCE_BYTES(HISTORY_STUDENTS)];
+	uint8_t arrival[HISTORY_STUDENTS];
+	const char *dir;
+	char path[4096];
+	int opt;
+
+	while ((opt = getopt(argc, argv, "r:d:e:")) != -1)
+	{
+		switch (opt)
+		{
+			case 'r':
+				rooms = atoi(optarg);
+				break;
+			case 'd':
+				n_days = atoi(optarg);
+				break;
+			case 'e':
+				every = atoi(optarg);
+				break;
+			default:
+				optind = argc;
+				break;
+		}
+	}
+	if (optind != argc - 1 || rooms < 1 || n_days < 1 || every < 1)
+	{
+		fprintf(stderr, "usage: %s [-r ROOMS] [-d DAYS] [-e EVERY] DIR\n", argv[0]);
+		return 2;
+	}
+	dir = argv[optind];
+	mkdir(dir, 0755);
+	srand(23);
+	/* every write waits out the 8.5 ms of the one before, in virtual time */
+	sim_run_limit = UINT64_MAX;
+
+	for (unsigned room = 1; room <= rooms; room++)
+	{
+		unsigned rate[HISTORY_STUDENTS], came[HISTORY_STUDENTS] = { 0 };
+
+		/* a blank EEPROM */
+		sim_start();
+		history_open();
+		for (int i = 0; i < HISTORY_STUDENTS; i++)
+		{
+			rate[i] = rand() % 10 ? 90 : 50;
+		}
+		for (unsigned day = 1; day <= n_days; day++)
+		{
+			presence_fill(present, HISTORY_STUDENTS, 0);
+			memset(arrival, 0, sizeof(arrival));
+			for (int i = 0; i < HISTORY_STUDENTS; i++)
+			{
+				unsigned s;
+
+				if ((unsigned)(rand() % 100) >= rate[i])
+				{
+					continue;
+				}
+				s = rand() % 4 ? rand() % 120 : rand() % ENTRANCE_S;
+				presence_set(present, i);
+				arrival[i] = s / HISTORY_ARRIVAL_UNIT < HISTORY_ARRIVAL_MAX ? s / HISTORY_ARRIVAL_UNIT : HISTORY_ARRIVAL_MAX;
+				came[i]++;
+				present_n++;
+				late_n += arrival[i] * HISTORY_ARRIVAL_UNIT >= LATE_MIN * 60;
+			}
+			history_append(day, present, arrival);
+			if (day % every == 0 || day == n_days)
+			{
+				snprintf(path, sizeof(path), "%s/r%04u-d%03u.eeprom", dir, room, day);
+				if (sim_eeprom_save(path) != 0)
+				{
+					perror(path);
+					return 1;
+				}
+				dumps++;
+			}
+		}
+		for (int i = 0; i < HISTORY_STUDENTS; i++)
+		{
+			chronic_n += came[i] * 100 < CHRONIC_PCT * n_days;
+		}
+		student_days += (unsigned long long)n_days * HISTORY_STUDENTS;
+	}
+
+	printf("%u rooms, %u dumps, %llu student-days: %llu present, %llu arrivals %u min or more after switch-on, "
+		"%llu students present on fewer than %u%% of their days\n", rooms, dumps, student_days, present_n, late_n,
+		LATE_MIN, chronic_n, CHRONIC_PCT);
+	return 0;
+}
@@ -0,0 +1,413 @@
+/*
+ * attend_ingest.c
+ * Reads EEPROM dumps of many devices into one columnar attendance file
+ * (attend_col.h) for attend_query.
+ *
+ *   attend_ingest -n STUDENTS -o FILE IMAGE...
+ *
+ * An IMAGE is the 1 KB EEPROM of a device, as avrdude reads it or as
+ * sim_firmware --eeprom saves it. The room is its file name up to the first
+ * '-' or '.', so r101-oct.eeprom and r101-dec.eeprom are two dumps of room
+ * r101. Dumps of a room may overlap; a day in several of them is taken from
+ * the one given last. STUDENTS is the class size the devices were built for
+ * (ROSTER_SIZE, the students of their roster.csv); the EEPROM layout depends
+ * on it.
+ *
+ * The days are decoded from the history (../history.h), whose layout is
+ * mirrored here. A header copy that fails its CRC is skipped as on the
+ * device. The day still in the journal is left out, it is not over yet.
+ * Days on which the device was not used are not rows.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <util/crc16.h>
+#include "attend_col.h"
+
+/* as in ../journal.h and ../history.h */
+#define EEPROM_SIZE				1024
+#define JOURNAL_RECORD			6
+#define JOURNAL_SLOTS(n)		(2 * (n) + 8)
+#define HISTORY_DAYS			64
+#define HISTORY_HEADER			10
+#define HISTORY_ARRIVAL_UNIT	60
+
+#define MAX_STUDENTS			160
+
+struct day
+{
+	uint32_t room, image;
+	uint16_t day;
+	uint8_t present[MAX_STUDENTS / 8];
+	uint8_t arrival[MAX_STUDENTS];
+};
+
+struct room_info
+{
+	char name[ATTEND_NAME_LEN];
+	unsigned students;
+};
+
+static struct day *days;
+static size_t n_days, max_days;
+static struct room_info *rooms;
+static unsigned n_rooms, max_rooms;
+
+struct bits
+{
+	const uint8_t *data;
+	unsigned size, at, pos;
+	uint8_t byte;
+};
+
+/* history_get() */
+static unsigned get(struct bits *r, unsigned n)
+{
+	unsigned value = 0;
+
+	for (unsigned i = 0; i < n; i++)
+	{
+		if ((r->pos & 7) == 0)
+		{
+			r->byte = r->data[r->at];
+			r->at = (r->at + 1) % r->size;
+		}
+		value |= ((r->byte >> (r->pos & 7)) & 1) << i;
+		r->pos++;
+	}
+	return value;
+}
+
+static unsigned room_find(const char *path, unsigned students)
+{
+	const char *base = strrchr(path, '/') ? strrchr(path, '/') + 1 : path;
+	char name[ATTEND_NAME_LEN] = { 0 };
+	size_t len = strcspn(base, "-.");
+
+	memcpy(name, base, len < sizeof(name) - 1 ? len : sizeof(name) - 1);
+	for (unsigned i = 0; i < n_rooms; i++)
+	{
+		if (strcmp(rooms[i].name, name) == 0)
+		{
+			return i;
+		}
+	}
+	if (n_rooms == max_rooms)
+	{
+		max_rooms = max_rooms ? 2 * max_rooms : 256;
+		rooms = realloc(rooms, max_rooms * sizeof(*rooms));
+	}
+	memcpy(rooms[n_rooms].name, name, sizeof(name));
+	rooms[n_rooms].students = students;
+	return n_rooms++;
+}
+
+/*
+ * the days of the history in `ee`, -1 if it has none that can be trusted; the
+ * EEMEM variables lie in the image the last defined first: history_data,
+ * history_dir, history_header_copy, then journal_ring
+ */
+static int image_read(const uint8_t *ee, unsigned students, uint32_t room, uint32_t image)
+{
+	unsigned size = EEPROM_SIZE - JOURNAL_SLOTS(students) * JOURNAL_RECORD - HISTORY_DAYS - 2 * HISTORY_HEADER;
+	const uint8_t *dir = ee + size;
+	const uint8_t *header = dir + HISTORY_DAYS;
+	struct bits r = { ee, size, 0, 0, 0 };
+	const uint8_t *best = NULL;
+	unsigned count, oldest, first_day, start, used, sum = 0;
+
+	/* history_open() */
+	for (int c = 0; c < 2; c++)
+	{
+		const uint8_t *h = header + c * HISTORY_HEADER;
+		uint8_t crc = 0;
+
+		for (int i = 0; i < HISTORY_HEADER - 1; i++)
+		{
+			crc = _crc8_ccitt_update(crc, h[i]);
+		}
+		if (crc != h[HISTORY_HEADER - 1] || h[2] >= HISTORY_DAYS || (best && (int8_t)(h[0] - best[0]) <= 0))
+		{
+			continue;
+		}
+		best = h;
+	}
+	if (!best)
+	{
+		return -1;
+	}
+	count = best[1];
+	oldest = best[2];
+	first_day = best[3] | best[4] << 8;
+	start = best[5] | best[6] << 8;
+	used = best[7] | best[8] << 8;
+	if (count > HISTORY_DAYS || start >= r.size || used > r.size)
+	{
+		return -1;
+	}
+
+	/* history_day() for every day, the blocks follow each other */
+	r.at = start;
+	for (unsigned n = 0; n < count; n++)
+	{
+		unsigned len = dir[(oldest + n) % HISTORY_DAYS], k, end = r.at;
+		struct day *d;
+
+		sum += len;
+		if (sum > used)
+		{
+			return -1;
+		}
+		if (len == 0)
+		{
+			continue;
+		}
+		if (n_days == max_days)
+		{
+			max_days = max_days ? 2 * max_days : 4096;
+			days = realloc(days, max_days * sizeof(*days));
+		}
+		d = &days[n_days];
+		memset(d, 0, sizeof(*d));
+		d->room = room;
+		d->image = image;
+		d->day = first_day + n;
+		r.pos = 0;
+		k = get(&r, 3);
+		for (unsigned i = 0; i < students; i++)
+		{
+			d->present[i / 8] |= get(&r, 1) << (i % 8);
+		}
+		for (unsigned i = 0; i < students; i++)
+		{
+			unsigned q = 0;
+
+			if (!(d->present[i / 8] >> (i % 8) & 1))
+			{
+				continue;
+			}
+			while (get(&r, 1) && q < 256)
+			{
+				q++;
+			}
+			d->arrival[i] = (q << k) | get(&r, k);
+		}
+		/* the next block starts `len` bytes on, whatever was read of this one */
+		r.at = (end + len) % r.size;
+		n_days++;
+	}
+	return 0;
+}
+
+static int day_order(const void *a, const void *b)
+{
+	const struct day *x = a, *y = b;
+
+	if (x->room != y->room)
+	{
+		return x->room < y->room ? -1 : 1;
+	}
+	if (x->day != y->day)
+	{
+		return x->day < y->day ? -1 : 1;
+	}
+	/* the later dump first, it is kept */
+	return x->image > y->image ? -1 : x->image < y->image;
+}
+
+static void pad(FILE *f)
+{
+	static const uint8_t zero[ATTEND_ALIGN];
+	long at = ftell(f);
+
+	fwrite(zero, 1, ATTEND_ROUND(at) - at, f);
+}
+
+static int write_columns(const char *path, size_t rows, unsigned stride)
+{
+	struct attend_header h = { ATTEND_MAGIC };
+	struct attend_room *room = calloc(n_rooms, sizeof(*room));
+	unsigned words = (stride + 63) / 64;
+	uint64_t *present = calloc(words, sizeof(uint64_t)), attended = 0;
+	char tmp[4096];
+	FILE *f;
+
+	snprintf(tmp, sizeof(tmp), "%s.tmp", path);
+	f = fopen(tmp, "wb");
+	if (!f || !room || !present)
+	{
+		perror(tmp);
+		return -1;
+	}
+	for (size_t i = 0; i < rows; i++)
+	{
+		struct attend_room *r = &room[days[i].room];
+
+		if (r->days++ == 0)
+		{
+			r->row = i;
+		}
+	}
+	for (unsigned i = 0; i < n_rooms; i++)
+	{
+		memcpy(room[i].name, rooms[i].name, ATTEND_NAME_LEN);
+		room[i].students = rooms[i].students;
+		room[i].day_words = (room[i].days + 63) / 64;
+		room[i].attended = attended;
+		attended += (uint64_t)room[i].students * room[i].day_words;
+	}
+
+	h.rooms = n_rooms;
+	h.rows = rows;
+	h.words = words;
+	h.stride = stride;
+	h.arrival_unit = HISTORY_ARRIVAL_UNIT;
+	h.room_off = ATTEND_ROUND(sizeof(h));
+	h.day_off = ATTEND_ROUND(h.room_off + n_rooms * sizeof(*room));
+	h.present_off = ATTEND_ROUND(h.day_off + rows * sizeof(uint16_t));
+	h.arrival_off = ATTEND_ROUND(h.present_off + rows * words * sizeof(uint64_t));
+	h.attended_off = ATTEND_ROUND(h.arrival_off + rows * stride);
+	h.size = h.attended_off + attended * sizeof(uint64_t);
+
+	fwrite(&h, sizeof(h), 1, f);
+	pad(f);
+	fwrite(room, sizeof(*room), n_rooms, f);
+	pad(f);
+	for (size_t i = 0; i < rows; i++)
+	{
+		fwrite(&days[i].day, sizeof(uint16_t), 1, f);
+	}
+	pad(f);
+	for (size_t i = 0; i < rows; i++)
+	{
+		memset(present, 0, words * sizeof(uint64_t));
+		for (unsigned s = 0; s < stride; s++)
+		{
+			present[s / 64] |= (uint64_t)(days[i].present[s / 8] >> (s % 8) & 1) << (s % 64);
+		}
+		fwrite(present, sizeof(uint64_t), words, f);
+	}
+	pad(f);
+	for (size_t i = 0; i < rows; i++)
+	{
+		fwrite(days[i].arrival, 1, stride, f);
+	}
+	pad(f);
+	/* the transpose, room by room and student by student */
+	for (unsigned i = 0; i < n_rooms; i++)
+	{
+		for (unsigned s = 0; s < room[i].students; s++)
+		{
+			for (unsigned w = 0; w < room[i].day_words; w++)
+			{
+				uint64_t bits = 0;
+
+				for (unsigned b = 0; b < 64 && 64 * w + b < room[i].days; b++)
+				{
+					const struct day *d = &days[room[i].row + 64 * w + b];
+
+					bits |= (uint64_t)(d->present[s / 8] >> (s % 8) & 1) << b;
+				}
+				fwrite(&bits, sizeof(bits), 1, f);
+			}
+		}
+	}
+	if (fclose(f) != 0 || rename(tmp, path) != 0)
+	{
+		perror(path);
+		return -1;
+	}
+	free(room);
+	free(present);
+	return 0;
+}
+
+int main(int argc, char **argv)
+{
+	const char *out = NULL;
+	unsigned students = 0, stride = 0, bad = 0, images = 0;
+	unsigned long long student_days = 0;
+	size_t rows = 0;
+	struct timespec t0, t1;
+	int opt;
+
+	while ((opt = getopt(argc, argv, "n:o:")) != -1)
+	{
+		switch (opt)
+		{
+			case 'n':
+				students = atoi(optarg);
+				break;
+			case 'o':
+				out = optarg;
+				break;
+			default:
+				out = NULL;
+				optind = argc;
+				break;
+		}
+	}
+	/* the directory holds a block length in a byte, the journal counts its slots in a byte */
+	if (!out || optind == argc || students < 1 || students > MAX_STUDENTS || JOURNAL_SLOTS(students) > 255 ||
+		(3 + 10 * students + 7) / 8 > 255)
+	{
+		fprintf(stderr, "usage: %s -n STUDENTS (1 to %d) -o FILE IMAGE...\n", argv[0], MAX_STUDENTS);
+		return 2;
+	}
+	clock_gettime(CLOCK_MONOTONIC, &t0);
+
+	for (int i = optind; i < argc; i++)
+	{
+		uint8_t ee[EEPROM_SIZE];
+		FILE *f = fopen(argv[i], "rb");
+		unsigned room;
+
+		if (!f || fread(ee, 1, sizeof(ee), f) != sizeof(ee))
+		{
+			fprintf(stderr, "%s: not a 1 KB EEPROM image\n", argv[i]);
+			bad++;
+			if (f)
+			{
+				fclose(f);
+			}
+			continue;
+		}
+		fclose(f);
+		room = room_find(argv[i], students);
+		if (image_read(ee, students, room, i) != 0)
+		{
+			fprintf(stderr, "%s: no history\n", argv[i]);
+			bad++;
+			continue;
+		}
+		images++;
+	}
+
+	/* one row per day and room, from the last dump that has it */
+	qsort(days, n_days, sizeof(*days), day_order);
+	for (size_t i = 0; i < n_days; i++)
+	{
+		if (rows == 0 || days[i].room != days[rows - 1].room || days[i].day != days[rows - 1].day)
+		{
+			days[rows++] = days[i];
+			student_days += rooms[days[i].room].students;
+		}
+	}
+	for (unsigned i = 0; i < n_rooms; i++)
+	{
+		stride = rooms[i].students > stride ? rooms[i].students : stride;
+	}
+	if (write_columns(out, rows, stride) != 0)
+	{
+		return 1;
+	}
+	clock_gettime(CLOCK_MONOTONIC, &t1);
+
+	printf("%u images (%u unreadable), %u rooms, %zu days (%zu more in overlapping dumps), %llu student-days, "
+		"%.2f s\n", images, bad, n_rooms, rows, n_days - rows, student_days,
+		(t1.tv_sec - t0.tv_sec) + (t1.tv_nsec - t0.tv_nsec) / 1e9);
+	return bad ? 1 : 0;
+}
@@ -0,0 +1,351 @@
+/*
+ * attend_query.c
+ * Queries a columnar attendance file (attend_col.h) with scans spread over
+ * threads.
+ *
+ *   attend_query [-j THREADS] [-l LATE_MIN] [-c PCT] [-n LIST] FILE
+ *
+ * attendance	present student-days against all of them, and the rooms with
+ *				the lowest rate: a popcount of the present column
+ * late		how late the students came, in minutes since the device was
+ *				switched on, and how many came LATE_MIN (default 10) or more
+ *				minutes after it: a histogram over the arrival column, the
+ *				present column tells who came. The device keeps 255 units
+ *				at most, the arrivals at that cap are counted apart, they
+ *				came then or later
+ * absentees	students present on fewer than PCT % (default 80) of the days
+ *				of their room: a popcount per student of the attended column
+ *
+ * The rooms are split into THREADS (default: the cores) ranges of about as
+ * many rows, each thread scans its own and the partial results are added
+ * up. The popcount loop is compiled for AVX-512 VPOPCNTQ, POPCNT and plain
+ * x86-64, the widest the CPU has is picked at start-up. Every
+ * query is run five times and the fastest run is printed; the file is
+ * mapped once and stays in the page cache between runs.
+ */
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include "attend_col.h"
+
+#define MAX_THREADS		64
+#define RUNS			5
+
+struct part
+{
+	unsigned room_lo, room_hi;
+	/* attendance */
+	uint64_t present;
+	/* late */
+	uint64_t arrivals[256];
+	/* absentees */
+	uint64_t absentees;
+};
+
+static struct attend_col col;
+static struct part parts[MAX_THREADS];
+static int n_threads;
+static unsigned late_units, chronic_pct = 80;
+static uint64_t *room_present;		/* by room, from the attendance query */
+
+#define POPCOUNT_LOOP \
+	uint64_t count = 0; \
+	for (size_t i = 0; i < n; i++) \
+	{ \
+		count += __builtin_popcountll(w[i]); \
+	} \
+	return count;
+
+static uint64_t popcount_plain(const uint64_t *w, size_t n)
+{
+	POPCOUNT_LOOP
+}
+
+#if defined(__x86_64__) && defined(__GNUC__)
+/* the same loop, which the compiler turns into POPCNT or eight words at a time with VPOPCNTQ */
+__attribute__((target("popcnt")))
+static uint64_t popcount_popcnt(const uint64_t *w, size_t n)
+{
+	POPCOUNT_LOOP
+}
+
+__attribute__((target("avx512f,avx512vpopcntdq")))
+static uint64_t popcount_avx512(const uint64_t *w, size_t n)
+{
+	POPCOUNT_LOOP
+}
+#endif
+
+static uint64_t (*popcount_words)(const uint64_t *w, size_t n) = popcount_plain;
+static const char *popcount_kind = "plain";
+
+static void popcount_pick(void)
+{
+#if defined(__x86_64__) && defined(__GNUC__)
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("avx512vpopcntdq"))
+	{
+		popcount_words = popcount_avx512;
+		popcount_kind = "AVX-512 VPOPCNTQ";
+	}
+	else if (__builtin_cpu_supports("popcnt"))
+	{
+		popcount_words = popcount_popcnt;
+		popcount_kind = "POPCNT";
+	}
+#endif
+}
+
+static void *attendance(void *arg)
+{
+	struct part *p = arg;
+
+	p->present = 0;
+	for (unsigned i = p->room_lo; i < p->room_hi; i++)
+	{
+		const struct attend_room *r = &col.room[i];
+
+		room_present[i] = popcount_words(col.present + (size_t)r->row * col.h->words, (size_t)r->days * col.h->words);
+		p->present += room_present[i];
+	}
+	return NULL;
+}
+
+static void *late(void *arg)
+{
+	struct part *p = arg;
+
+	memset(p->arrivals, 0, sizeof(p->arrivals));
+	for (unsigned i = p->room_lo; i < p->room_hi; i++)
+	{
+		const struct attend_room *r = &col.room[i];
+
+		for (uint32_t row = r->row; row < r->row + r->days; row++)
+		{
+			const uint64_t *present = col.present + (size_t)row * col.h->words;
+			const uint8_t *arrival = col.arrival + (size_t)row * col.h->stride;
+
+			for (unsigned w = 0; w < col.h->words; w++)
+			{
+				/* only the students present, lowest bit first */
+				for (uint64_t bits = present[w]; bits; bits &= bits - 1)
+				{
+					p->arrivals[arrival[64 * w + __builtin_ctzll(bits)]]++;
+				}
+			}
+		}
+	}
+	return NULL;
+}
+
+static void *absentees(void *arg)
+{
+	struct part *p = arg;
+
+	p->absentees = 0;
+	for (unsigned i = p->room_lo; i < p->room_hi; i++)
+	{
+		const struct attend_room *r = &col.room[i];
+		const uint64_t *w = col.attended + r->attended;
+
+		for (unsigned s = 0; s < r->students; s++, w += r->day_words)
+		{
+			if (popcount_words(w, r->day_words) * 100 < (uint64_t)chronic_pct * r->days)
+			{
+				p->absentees++;
+			}
+		}
+	}
+	return NULL;
+}
+
+/* the fastest of RUNS runs of `scan` on every range, in ms */
+static double run(void *(*scan)(void *))
+{
+	pthread_t threads[MAX_THREADS];
+	double best = 1e30;
+
+	for (int n = 0; n < RUNS; n++)
+	{
+		struct timespec t0, t1;
+		double ms;
+
+		clock_gettime(CLOCK_MONOTONIC, &t0);
+		for (int i = 1; i < n_threads; i++)
+		{
+			pthread_create(&threads[i], NULL, scan, &parts[i]);
+		}
+		scan(&parts[0]);
+		for (int i = 1; i < n_threads; i++)
+		{
+			pthread_join(threads[i], NULL);
+		}
+		clock_gettime(CLOCK_MONOTONIC, &t1);
+		ms = (t1.tv_sec - t0.tv_sec) * 1e3 + (t1.tv_nsec - t0.tv_nsec) / 1e6;
+		best = ms < best ? ms : best;
+	}
+	return best;
+}
+
+/* ranges of rooms with about as many rows each */
+static void split(void)
+{
+	unsigned room = 0;
+
+	for (int i = 0; i < n_threads; i++)
+	{
+		uint64_t end = (uint64_t)col.h->rows * (i + 1) / n_threads;
+
+		parts[i].room_lo = room;
+		while (room < col.h->rooms && (i == n_threads - 1 || col.room[room].row < end))
+		{
+			room++;
+		}
+		parts[i].room_hi = room;
+	}
+}
+
+static int rate_order(const void *a, const void *b)
+{
+	const struct attend_room *x = &col.room[*(const unsigned *)a], *y = &col.room[*(const unsigned *)b];
+	double rx = x->days ? (double)room_present[x - col.room] / ((uint64_t)x->days * x->students) : 1;
+	double ry = y->days ? (double)room_present[y - col.room] / ((uint64_t)y->days * y->students) : 1;
+
+	return rx < ry ? -1 : rx > ry;
+}
+
+static void usage(const char *argv0)
+{
+	fprintf(stderr, "usage: %s [-j THREADS] [-l LATE_MIN] [-c PCT] [-n LIST] FILE\n", argv0);
+	exit(2);
+}
+
+int main(int argc, char **argv)
+{
+	static const unsigned bucket_min[] = { 0, 1, 2, 3, 5, 10, 20, 30 };
+	unsigned late_min = 10, list = 5, *order;
+	uint64_t student_days = 0, present = 0, arrivals[256] = { 0 }, late_n = 0, absent_n = 0;
+	double ms;
+	int opt;
+
+	n_threads = sysconf(_SC_NPROCESSORS_ONLN);
+	while ((opt = getopt(argc, argv, "j:l:c:n:")) != -1)
+	{
+		switch (opt)
+		{
+			case 'j':
+				n_threads = atoi(optarg);
+				break;
+			case 'l':
+				late_min = atoi(optarg);
+				break;
+			case 'c':
+				chronic_pct = atoi(optarg);
+				break;
+			case 'n':
+				list = atoi(optarg);
+				break;
+			default:
+				usage(argv[0]);
+		}
+	}
+	if (optind != argc - 1)
+	{
+		usage(argv[0]);
+	}
+	if (attend_col_map(argv[optind], &col) != 0)
+	{
+		return 1;
+	}
+	n_threads = n_threads < 1 ? 1 : n_threads > MAX_THREADS ? MAX_THREADS : n_threads;
+	popcount_pick();
+	split();
+	room_present = calloc(col.h->rooms + 1, sizeof(*room_present));
+	order = calloc(col.h->rooms + 1, sizeof(*order));
+	for (unsigned i = 0; i < col.h->rooms; i++)
+	{
+		student_days += (uint64_t)col.room[i].days * col.room[i].students;
+		order[i] = i;
+	}
+	printf("%s: %u rooms, %u days, %llu student-days, %.1f MB, %d threads, %s popcount\n", argv[optind],
+		col.h->rooms, col.h->rows, (unsigned long long)student_days, col.size / 1e6, n_threads, popcount_kind);
+
+	ms = run(attendance);
+	for (int i = 0; i < n_threads; i++)
+	{
+		present += parts[i].present;
+	}
+	printf("attendance: %llu present, %.1f%% (%.3f ms)\n", (unsigned long long)present,
+		student_days ? 100.0 * present / student_days : 0.0, ms);
+	qsort(order, col.h->rooms, sizeof(*order), rate_order);
+	for (unsigned i = 0; i < list && i < col.h->rooms; i++)
+	{
+		const struct attend_room *r = &col.room[order[i]];
+
+		printf("  %-24s %5.1f%% over %u days\n", r->name,
+			r->days ? 100.0 * room_present[order[i]] / ((uint64_t)r->days * r->students) : 0.0, r->days);
+	}
+
+	late_units = (late_min * 60 + col.h->arrival_unit - 1) / col.h->arrival_unit;
+	ms = run(late);
+	for (int i = 0; i < n_threads; i++)
+	{
+		for (int a = 0; a < 256; a++)
+		{
+			arrivals[a] += parts[i].arrivals[a];
+		}
+	}
+	for (unsigned a = late_units; a < 256; a++)
+	{
+		late_n += arrivals[a];
+	}
+	printf("late: %llu of %llu arrivals %u min or more after switch-on (%.3f ms)\n", (unsigned long long)late_n,
+		(unsigned long long)present, late_min, ms);
+	if (arrivals[ATTEND_ARRIVAL_MAX] != 0)
+	{
+		printf("  %llu at the cap of %u min, that or later\n", (unsigned long long)arrivals[ATTEND_ARRIVAL_MAX],
+			ATTEND_ARRIVAL_MAX * col.h->arrival_unit / 60);
+	}
+	for (unsigned b = 0; b < sizeof(bucket_min) / sizeof(bucket_min[0]); b++)
+	{
+		unsigned lo = bucket_min[b] * 60 / col.h->arrival_unit;
+		unsigned hi = b + 1 < sizeof(bucket_min) / sizeof(bucket_min[0]) ? bucket_min[b + 1] * 60 / col.h->arrival_unit : 256;
+		uint64_t n = 0;
+
+		for (unsigned a = lo; a < hi && a < 256; a++)
+		{
+			n += arrivals[a];
+		}
+		printf("  %3u min %s %10llu  %5.1f%%\n", bucket_min[b], hi == 256 ? "and on" : "      ",
+			(unsigned long long)n, present ? 100.0 * n / present : 0.0);
+	}
+
+	ms = run(absentees);
+	for (int i = 0; i < n_threads; i++)
+	{
+		absent_n += parts[i].absentees;
+	}
+	printf("absentees: %llu students present on fewer than %u%% of their days (%.3f ms)\n",
+		(unsigned long long)absent_n, chronic_pct, ms);
+	for (unsigned i = 0, shown = 0; i < col.h->rooms && shown < list; i++)
+	{
+		const struct attend_room *r = &col.room[i];
+
+		for (unsigned s = 0; s < r->students && shown < list; s++)
+		{
+			uint64_t n = popcount_words(col.attended + r->attended + (size_t)s * r->day_words, r->day_words);
+
+			if (n * 100 < (uint64_t)chronic_pct * r->days)
+			{
+				printf("  %-24s student %3u present %llu of %u days\n", r->name, s, (unsigned long long)n, r->days);
+				shown++;
+			}
+		}
+	}
+	attend_col_unmap(&col);
+	return 0;
+}
@@ -0,0 +1,165 @@
+/*
+ * export_decode.c
+ * Reads the attendance database from the device over a serial line (see
+ * ../export.h for the frames) and prints it.
+ *
+ *   export_decode TTY
+ *
+ * TTY is the USB serial adapter on the device's USART, or the pty of
+ * sim_firmware --uart-pty. The line is set to 62500 baud 8N1 raw, the export
+ * command is sent, and frames are read until EXPORT_END. A frame that fails
+ * its CRC is counted and skipped (export_frame.c). The exit status is 0 only if the export
+ * came through complete.
+ */
+
+#include <poll.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include "export_frame.h"
+
+#define MAX_STUDENTS	256
+#define TIMEOUT_MS		5000
+
+static struct
+{
+	int hello;
+	unsigned version, students, unit, first_day, last_day;
+	char names[MAX_STUDENTS][32];
+	unsigned frames, days;
+	int bad_end;
+} db;
+
+static void print_time(unsigned s)
+{
+	printf("%02u:%02u:%02u", s / 3600, s / 60 % 60, s % 60);
+}
+
+/* returns 1 at EXPORT_END */
+static int frame(void *ctx, uint8_t type, const uint8_t *p, unsigned len)
+{
+	(void)ctx;
+	switch (type)
+	{
+		case EXPORT_HELLO:
+			if (len < 8)
+			{
+				break;
+			}
+			db.hello = 1;
+			db.version = p[0];
+			db.students = p[1];
+			db.unit = export_get16(p + 2);
+			db.first_day = export_get16(p + 4);
+			db.last_day = export_get16(p + 6);
+			printf("%u students, arrivals in %u s units, days %u to %u\n", db.students, db.unit, db.first_day,
+				db.last_day);
+			if (db.version != EXPORT_VERSION)
+			{
+				fprintf(stderr, "export version %u, this decoder knows %u\n", db.version, EXPORT_VERSION);
+			}
+			break;
+		case EXPORT_NAME:
+			if (len >= 1)
+			{
+				unsigned n = len - 1 < sizeof(db.names[0]) - 1 ? len - 1 : sizeof(db.names[0]) - 1;
+
+				memcpy(db.names[p[0]], p + 1, n);
+				db.names[p[0]][n] = '\0';
+			}
+			break;
+		case EXPORT_DAY:
+		{
+			unsigned bytes = (db.students + 7) / 8, at, present = 0;
+
+			if (!db.hello || len < 2 + bytes)
+			{
+				break;
+			}
+			at = 2 + bytes;
+			for (unsigned i = 0; i < db.students; i++)
+			{
+				present += (p[2 + i / 8] >> (i % 8)) & 1;
+			}
+			printf("day %u: %u present\n", export_get16(p), present);
+			for (unsigned i = 0; i < db.students && at < len; i++)
+			{
+				if ((p[2 + i / 8] >> (i % 8)) & 1)
+				{
+					printf("  %-16s in at ", db.names[i][0] ? db.names[i] : "?");
+					print_time(p[at] * db.unit);
+					printf(p[at++] == EXPORT_ARRIVAL_MAX ? " or later\n" : "\n");
+				}
+			}
+			db.days++;
+			break;
+		}
+		case EXPORT_END:
+			if (len >= 2 && export_get16(p) != db.frames)
+			{
+				fprintf(stderr, "%u frames sent, %u received\n", export_get16(p), db.frames);
+				db.bad_end = 1;
+			}
+			return 1;
+		default:
+			/* taps on the line meanwhile */
+			break;
+	}
+	db.frames++;
+	return 0;
+}
+
+int main(int argc, char **argv)
+{
+	struct export_parser parser = { 0 };
+	uint8_t buf[4096];
+	int fd, done = 0;
+	uint8_t command = EXPORT_COMMAND;
+	struct timespec t0, t1;
+
+	if (argc != 2)
+	{
+		fprintf(stderr, "usage: %s TTY\n", argv[0]);
+		return 2;
+	}
+	fd = export_open_line(argv[1], 0);
+	if (fd < 0)
+	{
+		return 1;
+	}
+	clock_gettime(CLOCK_MONOTONIC, &t0);
+	if (write(fd, &command, 1) != 1)
+	{
+		perror("write");
+		return 1;
+	}
+
+	while (!done)
+	{
+		struct pollfd p = { fd, POLLIN, 0 };
+		ssize_t got;
+
+		if (poll(&p, 1, TIMEOUT_MS) <= 0)
+		{
+			fprintf(stderr, "no data for %d ms\n", TIMEOUT_MS);
+			break;
+		}
+		got = read(fd, buf, sizeof(buf));
+		if (got <= 0)
+		{
+			fprintf(stderr, "the line closed\n");
+			break;
+		}
+		done = export_parse(&parser, buf, got, frame, NULL);
+	}
+	clock_gettime(CLOCK_MONOTONIC, &t1);
+	close(fd);
+
+	printf("%u frames, %u days, %llu bad frames, %s in %.3f s\n", db.frames, db.days,
+		(unsigned long long)parser.bad_frames, done ? "complete" : "incomplete",
+		(t1.tv_sec - t0.tv_sec) + (t1.tv_nsec - t0.tv_nsec) / 1e9);
+	return done && db.hello && !db.bad_end && !parser.bad_frames ? 0 : 1;
+}
@@ -0,0 +1,154 @@
+/*
+ * export_frame.c
+ * See export_frame.h.
+ */
+
+#include <asm/termbits.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <unistd.h>
+#include "export_frame.h"
+
+/* the avr-libc _crc_ccitt_update() */
+uint16_t export_crc_update(uint16_t crc, uint8_t data)
+{
+	data ^= crc & 0xFF;
+	data ^= data << 4;
+	return ((((uint16_t)data << 8) | (crc >> 8)) ^ (uint8_t)(data >> 4) ^ ((uint16_t)data << 3));
+}
+
+unsigned export_get16(const uint8_t *p)
+{
+	return p[0] | (p[1] << 8);
+}
+
+int export_open_line(const char *path, int flags)
+{
+	struct termios2 tio;
+	int fd = -1;
+
+	/* the simulator may still be creating its pty */
+	for (int i = 0; i < 100 && fd < 0; i++)
+	{
+		fd = open(path, O_RDWR | O_NOCTTY | flags);
+		if (fd < 0 && errno == ENOENT)
+		{
+			usleep(50000);
+		}
+		else if (fd < 0)
+		{
+			break;
+		}
+	}
+	if (fd < 0)
+	{
+		perror(path);
+		return -1;
+	}
+	/* 62500 is no Bxxx constant, termios2 takes it as it is; a pty ignores it */
+	if (ioctl(fd, TCGETS2, &tio) == 0)
+	{
+		tio.c_iflag = 0;
+		tio.c_oflag = 0;
+		tio.c_lflag = 0;
+		tio.c_cflag = CS8 | CREAD | CLOCAL | BOTHER;
+		tio.c_ispeed = tio.c_ospeed = EXPORT_BAUD;
+		tio.c_cc[VMIN] = 1;
+		tio.c_cc[VTIME] = 0;
+		if (ioctl(fd, TCSETS2, &tio) != 0)
+		{
+			perror("TCSETS2");
+		}
+	}
+	return fd;
+}
+
+int export_parse(struct export_parser *p, const uint8_t *data, size_t len, export_frame_fn fn, void *ctx)
+{
+	int stop = 0;
+
+	while (len > 0 && !stop)
+	{
+		size_t take = sizeof(p->buf) - p->n < len ? sizeof(p->buf) - p->n : len;
+		unsigned at = 0;
+
+		memcpy(p->buf + p->n, data, take);
+		p->n += take;
+		data += take;
+		len -= take;
+
+		/* every complete frame in the buffer, a bad one is skipped from its SOF on */
+		while (!stop && p->n - at >= EXPORT_FRAMING)
+		{
+			unsigned flen;
+			uint16_t crc = 0xFFFF;
+
+			if (p->buf[at] != EXPORT_SOF)
+			{
+				at++;
+				continue;
+			}
+			flen = p->buf[at + 2];
+			if (p->n - at < flen + EXPORT_FRAMING)
+			{
+				break;
+			}
+			for (unsigned i = 1; i < flen + 3; i++)
+			{
+				crc = export_crc_update(crc, p->buf[at + i]);
+			}
+			if (crc != export_get16(p->buf + at + flen + 3))
+			{
+				p->bad_frames++;
+				at++;
+				continue;
+			}
+			p->frames++;
+			stop = fn(ctx, p->buf[at + 1], p->buf + at + 3, flen);
+			at += flen + EXPORT_FRAMING;
+		}
+		memmove(p->buf, p->buf + at, p->n - at);
+		p->n -= at;
+	}
+	return stop;
+}
+
+unsigned export_pack(uint8_t *out, uint8_t type, const uint8_t *payload, uint8_t len)
+{
+	uint16_t crc = 0xFFFF;
+
+	out[0] = EXPORT_SOF;
+	out[1] = type;
+	out[2] = len;
+	memcpy(out + 3, payload, len);
+	for (unsigned i = 1; i < len + 3u; i++)
+	{
+		crc = export_crc_update(crc, out[i]);
+	}
+	out[len + 3] = crc & 0xFF;
+	out[len + 4] = crc >> 8;
+	return len + EXPORT_FRAMING;
+}
+
+void export_tap_unpack(struct export_tap *tap, const uint8_t *payload)
+{
+	tap->seq = export_get16(payload);
+	tap->day = export_get16(payload + 2);
+	tap->time = export_get16(payload + 4);
+	tap->kind = payload[6];
+	tap->student = payload[7];
+	tap->inside = payload[8];
+}
+
+unsigned export_tap_pack(uint8_t *out, const struct export_tap *tap)
+{
+	uint8_t payload[EXPORT_TAP_LENGTH] = {
+		tap->seq & 0xFF, tap->seq >> 8, tap->day & 0xFF, tap->day >> 8, tap->time & 0xFF, tap->time >> 8,
+		tap->kind, tap->student, tap->inside,
+	};
+
+	return export_pack(out, EXPORT_TAP, payload, EXPORT_TAP_LENGTH);
+}
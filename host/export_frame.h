@@ -0,0 +1,65 @@
+/*
+ * export_frame.h
+ * The frames of ../export.h on the PC side: the serial line to a device and
+ * a parser that is fed whatever arrived and hands over every intact frame.
+ */
+#ifndef EXPORT_FRAME_H
+#define EXPORT_FRAME_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* as in ../export.h */
+#define EXPORT_UBRR			1
+#define EXPORT_COMMAND		'E'
+#define EXPORT_SOF			0x7E
+#define EXPORT_VERSION		1
+#define EXPORT_ARRIVAL_MAX	255		/* that many units or later */
+#define EXPORT_HELLO		'H'
+#define EXPORT_NAME			'N'
+#define EXPORT_DAY			'D'
+#define EXPORT_END			'Z'
+#define EXPORT_TAP			'T'
+#define EXPORT_TAP_LENGTH	9
+#define EXPORT_TAP_IN		'I'
+#define EXPORT_TAP_OUT		'O'
+#define EXPORT_TAP_DENIED	'?'
+#define EXPORT_FRAMING		5
+
+/* 62500 at the 1 MHz of the device */
+#define EXPORT_BAUD			(1000000UL / 8 / (EXPORT_UBRR + 1))
+
+#define EXPORT_FRAME_MAX	(EXPORT_FRAMING + 255)
+
+struct export_parser
+{
+	uint8_t buf[2 * EXPORT_FRAME_MAX];
+	unsigned n;
+	uint64_t frames, bad_frames;
+};
+
+/* called for every intact frame, a non-zero return stops export_parse() */
+typedef int (*export_frame_fn)(void *ctx, uint8_t type, const uint8_t *payload, unsigned len);
+
+struct export_tap
+{
+	uint16_t seq, day, time;
+	uint8_t kind, student, inside;
+};
+
+uint16_t export_crc_update(uint16_t crc, uint8_t data);
+unsigned export_get16(const uint8_t *p);
+
+/* opens a tty (waiting up to 5 s for it to appear) raw at EXPORT_BAUD, -1 on failure */
+int export_open_line(const char *path, int flags);
+
+/* feeds `len` bytes, returns what the last call of `fn` returned, or 0 */
+int export_parse(struct export_parser *p, const uint8_t *data, size_t len, export_frame_fn fn, void *ctx);
+
+/* packs a frame into `out` (EXPORT_FRAMING + len bytes), returns its length */
+unsigned export_pack(uint8_t *out, uint8_t type, const uint8_t *payload, uint8_t len);
+
+void export_tap_unpack(struct export_tap *tap, const uint8_t *payload);
+unsigned export_tap_pack(uint8_t *out, const struct export_tap *tap);
+
+#endif /* EXPORT_FRAME_H */
@@ -0,0 +1,622 @@
+/*
+ * gateway.c
+ * Collects the taps of many classrooms. Every device sends an EXPORT_TAP
+ * frame per tap on its USART (../export.h); the gateway reads dozens of
+ * serial lines at once with epoll.
+ *
+ *   gateway [-s STORE] [-b BATCH] [-f FLUSH_US] [-t SECONDS] TTY...
+ *
+ * The rooms are numbered in the order of the TTYs, which has to stay the
+ * same between runs.
+ *
+ * Every tap is appended to STORE (default taps.store) as a record of
+ * STORE_RECORD bytes with its own CRC. The taps are written in batches, one
+ * write() and one fdatasync() per batch, when BATCH taps wait or the oldest
+ * has waited FLUSH_US. A tap counts as stored after the fdatasync(). At
+ * start-up the store is read back: a torn record at its end is cut off and
+ * the occupancy is rebuilt from the rest.
+ *
+ * The occupancy index is in memory. For each room it holds who is inside
+ * (from the IN and OUT taps), the count the device reported, its last
+ * sequence number, and the taps lost on the line (gaps in the sequence).
+ * SIGUSR1 prints it with the latency histograms. The gateway prints it and
+ * exits on SIGINT or SIGTERM, after -t seconds, or when every line has
+ * closed, once the last batch is stored.
+ *
+ * Two latencies are kept in power-of-two histograms of microseconds: from
+ * the read() that brought a tap to its fdatasync(), and of the fdatasync()
+ * alone.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <getopt.h>
+#include <signal.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/signalfd.h>
+#include <sys/timerfd.h>
+#include <time.h>
+#include <unistd.h>
+#include "export_frame.h"
+
+#define STORE_MAGIC		"RFIDTAP1"
+#define STORE_RECORD	24
+
+#define MAX_ROOMS		1024
+#define MAX_STUDENTS	256
+#define HIST_BUCKETS	32
+
+/* epoll data of the timer and the signals, the rooms are their index */
+#define EV_TIMER		(MAX_ROOMS + 0)
+#define EV_SIGNAL		(MAX_ROOMS + 1)
+
+struct room
+{
+	const char *path;
+	int fd;
+	struct export_parser parser;
+	uint8_t present[MAX_STUDENTS / 8];
+	unsigned inside;		/* students inside by the taps */
+	unsigned reported;		/* as the device counts them */
+	uint16_t last_seq;
+	uint64_t taps, lost, resets;
+};
+
+struct record
+{
+	uint16_t room;
+	struct export_tap tap;
+	uint64_t received_us;	/* wall clock */
+	uint64_t read_ns;		/* monotonic, for the latency */
+};
+
+struct histogram
+{
+	uint64_t count[HIST_BUCKETS];
+	uint64_t n, max_us;
+};
+
+static struct room rooms[MAX_ROOMS];
+static int n_rooms, open_rooms;
+
+static struct record *batch;
+static int batch_n, batch_max = 256;
+static long flush_us = 2000;
+static int store_fd, timer_fd;
+static const char *store_path = "taps.store";
+
+static uint64_t read_ns;		/* of the read() being parsed */
+static uint64_t start_ns;
+static struct histogram latency, sync_time;
+static uint64_t stored, batches, recovered, cut_bytes;
+
+static uint64_t mono_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static uint64_t wall_us(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_REALTIME, &ts);
+	return (uint64_t)ts.tv_sec * 1000000ULL + ts.tv_nsec / 1000;
+}
+
+static void hist_add(struct histogram *h, uint64_t us)
+{
+	int b = 0;
+
+	while (b < HIST_BUCKETS - 1 && (1ULL << b) <= us)
+	{
+		b++;
+	}
+	h->count[b]++;
+	h->n++;
+	if (us > h->max_us)
+	{
+		h->max_us = us;
+	}
+}
+
+/* upper bound of the bucket holding the q-quantile */
+static uint64_t hist_quantile(const struct histogram *h, double q)
+{
+	uint64_t want = (uint64_t)(q * h->n), seen = 0;
+
+	for (int b = 0; b < HIST_BUCKETS; b++)
+	{
+		seen += h->count[b];
+		if (seen > want)
+		{
+			return 1ULL << b;
+		}
+	}
+	return h->max_us;
+}
+
+static void hist_print(const char *what, const struct histogram *h)
+{
+	printf("%s: %llu, p50 < %llu us, p99 < %llu us, p99.9 < %llu us, max %llu us\n", what,
+		(unsigned long long)h->n, (unsigned long long)hist_quantile(h, 0.5),
+		(unsigned long long)hist_quantile(h, 0.99), (unsigned long long)hist_quantile(h, 0.999),
+		(unsigned long long)h->max_us);
+	for (int b = 0; b < HIST_BUCKETS; b++)
+	{
+		if (h->count[b])
+		{
+			printf("  < %8llu us %10llu\n", 1ULL << b, (unsigned long long)h->count[b]);
+		}
+	}
+}
+
+/***************************************************
+The occupancy index
+***************************************************/
+static void occupancy_apply(struct room *r, const struct export_tap *tap)
+{
+	uint8_t bit = 1 << (tap->student & 7);
+	uint8_t *byte = &r->present[tap->student >> 3];
+
+	if (tap->kind == EXPORT_TAP_IN && !(*byte & bit))
+	{
+		*byte |= bit;
+		r->inside++;
+	}
+	else if (tap->kind == EXPORT_TAP_OUT && (*byte & bit))
+	{
+		*byte &= ~bit;
+		r->inside--;
+	}
+	r->reported = tap->inside;
+	r->taps++;
+}
+
+/* gaps in the sequence are taps the device could not send; 1 again is a reset */
+static void occupancy_sequence(struct room *r, uint16_t seq)
+{
+	uint16_t expected = r->last_seq + 1;
+
+	if (r->last_seq != 0 && seq == 1)
+	{
+		r->resets++;
+		memset(r->present, 0, sizeof(r->present));
+		r->inside = 0;
+	}
+	else if (r->last_seq != 0 && seq != expected)
+	{
+		r->lost += (uint16_t)(seq - expected);
+	}
+	r->last_seq = seq;
+}
+
+/***************************************************
+The store
+***************************************************/
+static void record_pack(uint8_t *out, const struct record *rec)
+{
+	uint16_t crc = 0xFFFF;
+
+	memset(out, 0, STORE_RECORD);
+	out[0] = rec->room & 0xFF;
+	out[1] = rec->room >> 8;
+	out[2] = rec->tap.seq & 0xFF;
+	out[3] = rec->tap.seq >> 8;
+	out[4] = rec->tap.day & 0xFF;
+	out[5] = rec->tap.day >> 8;
+	out[6] = rec->tap.time & 0xFF;
+	out[7] = rec->tap.time >> 8;
+	out[8] = rec->tap.kind;
+	out[9] = rec->tap.student;
+	out[10] = rec->tap.inside;
+	for (int i = 0; i < 8; i++)
+	{
+		out[12 + i] = rec->received_us >> (8 * i);
+	}
+	for (int i = 0; i < 20; i++)
+	{
+		crc = export_crc_update(crc, out[i]);
+	}
+	out[20] = crc & 0xFF;
+	out[21] = crc >> 8;
+}
+
+/* 0 if the record is torn */
+static int record_unpack(struct record *rec, const uint8_t *in)
+{
+	uint16_t crc = 0xFFFF;
+
+	for (int i = 0; i < 20; i++)
+	{
+		crc = export_crc_update(crc, in[i]);
+	}
+	if (crc != export_get16(in + 20))
+	{
+		return 0;
+	}
+	rec->room = export_get16(in);
+	rec->tap.seq = export_get16(in + 2);
+	rec->tap.day = export_get16(in + 4);
+	rec->tap.time = export_get16(in + 6);
+	rec->tap.kind = in[8];
+	rec->tap.student = in[9];
+	rec->tap.inside = in[10];
+	rec->received_us = 0;
+	for (int i = 0; i < 8; i++)
+	{
+		rec->received_us |= (uint64_t)in[12 + i] << (8 * i);
+	}
+	return 1;
+}
+
+/* reads the store back into the index, cuts a torn end off */
+static void store_open(void)
+{
+	uint8_t buf[STORE_RECORD * 512];
+	uint8_t magic[8];
+	off_t good = sizeof(magic), size;
+	ssize_t got;
+	int torn = 0;
+
+	store_fd = open(store_path, O_RDWR | O_CREAT, 0644);
+	if (store_fd < 0)
+	{
+		perror(store_path);
+		exit(1);
+	}
+	size = lseek(store_fd, 0, SEEK_END);
+	lseek(store_fd, 0, SEEK_SET);
+	if (size < (off_t)sizeof(magic) || read(store_fd, magic, sizeof(magic)) != sizeof(magic) ||
+		memcmp(magic, STORE_MAGIC, sizeof(magic)) != 0)
+	{
+		if (size >= (off_t)sizeof(magic))
+		{
+			fprintf(stderr, "%s: not a store of taps\n", store_path);
+			exit(1);
+		}
+		/* new, or torn before its header was complete */
+		if (ftruncate(store_fd, 0) != 0 || pwrite(store_fd, STORE_MAGIC, sizeof(magic), 0) != sizeof(magic) ||
+			fdatasync(store_fd) != 0)
+		{
+			perror(store_path);
+			exit(1);
+		}
+		size = sizeof(magic);
+	}
+
+	while (!torn && (got = read(store_fd, buf, sizeof(buf))) > 0)
+	{
+		for (ssize_t at = 0; at + STORE_RECORD <= got; at += STORE_RECORD)
+		{
+			struct record rec;
+
+			if (!record_unpack(&rec, buf + at))
+			{
+				torn = 1;
+				break;
+			}
+			if (rec.room < n_rooms)
+			{
+				occupancy_sequence(&rooms[rec.room], rec.tap.seq);
+				occupancy_apply(&rooms[rec.room], &rec.tap);
+			}
+			recovered++;
+			good += STORE_RECORD;
+		}
+		if (got % STORE_RECORD)
+		{
+			/* a partial record is only possible at the end */
+			break;
+		}
+	}
+	if (good < size)
+	{
+		cut_bytes = size - good;
+		if (ftruncate(store_fd, good) != 0 || fdatasync(store_fd) != 0)
+		{
+			perror(store_path);
+			exit(1);
+		}
+	}
+	lseek(store_fd, good, SEEK_SET);
+	/* the taps in the index so far are not this run's */
+	for (int i = 0; i < n_rooms; i++)
+	{
+		rooms[i].taps = 0;
+	}
+}
+
+/* one write and one fdatasync for all waiting taps */
+static void store_flush(void)
+{
+	static uint8_t buf[STORE_RECORD * 4096];
+	struct itimerspec off = { { 0, 0 }, { 0, 0 } };
+	uint64_t t0, t1;
+	size_t len = 0, done = 0;
+
+	if (batch_n == 0)
+	{
+		return;
+	}
+	for (int i = 0; i < batch_n; i++)
+	{
+		record_pack(buf + len, &batch[i]);
+		len += STORE_RECORD;
+	}
+	while (done < len)
+	{
+		ssize_t w = write(store_fd, buf + done, len - done);
+
+		if (w < 0 && errno != EINTR)
+		{
+			perror(store_path);
+			exit(1);
+		}
+		done += w > 0 ? w : 0;
+	}
+	t0 = mono_ns();
+	if (fdatasync(store_fd) != 0)
+	{
+		perror(store_path);
+		exit(1);
+	}
+	t1 = mono_ns();
+	hist_add(&sync_time, (t1 - t0) / 1000);
+	for (int i = 0; i < batch_n; i++)
+	{
+		hist_add(&latency, (t1 - batch[i].read_ns) / 1000);
+	}
+	stored += batch_n;
+	batches++;
+	batch_n = 0;
+	timerfd_settime(timer_fd, 0, &off, NULL);
+}
+
+/***************************************************
+The lines
+***************************************************/
+static int frame(void *ctx, uint8_t type, const uint8_t *payload, unsigned len)
+{
+	struct room *r = ctx;
+	struct record *rec;
+
+	/* an export somebody asked for, or a frame of another kind */
+	if (type != EXPORT_TAP || len < EXPORT_TAP_LENGTH)
+	{
+		return 0;
+	}
+	rec = &batch[batch_n];
+	rec->room = r - rooms;
+	export_tap_unpack(&rec->tap, payload);
+	rec->received_us = wall_us();
+	rec->read_ns = read_ns;
+	occupancy_sequence(r, rec->tap.seq);
+	occupancy_apply(r, &rec->tap);
+	if (batch_n++ == 0)
+	{
+		struct itimerspec due = { { 0, 0 }, { flush_us / 1000000, flush_us % 1000000 * 1000 } };
+
+		timerfd_settime(timer_fd, 0, &due, NULL);
+	}
+	if (batch_n == batch_max)
+	{
+		store_flush();
+	}
+	return 0;
+}
+
+static void line_close(int epfd, struct room *r)
+{
+	epoll_ctl(epfd, EPOLL_CTL_DEL, r->fd, NULL);
+	close(r->fd);
+	r->fd = -1;
+	open_rooms--;
+}
+
+static void line_read(int epfd, struct room *r)
+{
+	uint8_t buf[4096];
+
+	for (;;)
+	{
+		ssize_t got = read(r->fd, buf, sizeof(buf));
+
+		if (got > 0)
+		{
+			read_ns = mono_ns();
+			export_parse(&r->parser, buf, got, frame, r);
+		}
+		else if (got < 0 && (errno == EAGAIN || errno == EINTR))
+		{
+			return;
+		}
+		else
+		{
+			/* the device is gone, or the other end of the pty closed */
+			line_close(epfd, r);
+			return;
+		}
+	}
+}
+
+static void report(void)
+{
+	uint64_t taps = 0, lost = 0, bad = 0, inside = 0;
+	double s = (mono_ns() - start_ns) / 1e9;
+
+	printf("room  %-24s %8s %8s %10s %6s %6s %6s\n", "line", "inside", "device", "taps", "lost", "resets", "bad");
+	for (int i = 0; i < n_rooms; i++)
+	{
+		struct room *r = &rooms[i];
+
+		if (i < 32)
+		{
+			printf("%4d  %-24s %8u %8u %10llu %6llu %6llu %6llu%s\n", i, r->path, r->inside, r->reported,
+				(unsigned long long)r->taps, (unsigned long long)r->lost, (unsigned long long)r->resets,
+				(unsigned long long)r->parser.bad_frames, r->fd < 0 ? " closed" : "");
+		}
+		taps += r->taps;
+		lost += r->lost;
+		bad += r->parser.bad_frames;
+		inside += r->inside;
+	}
+	if (n_rooms > 32)
+	{
+		printf("      ... %d rooms more\n", n_rooms - 32);
+	}
+	printf("%d rooms, %llu inside, %llu taps in %.2f s (%.0f/s), %llu lost on the lines, %llu bad frames\n",
+		n_rooms, (unsigned long long)inside, (unsigned long long)taps, s, s > 0 ? taps / s : 0.0,
+		(unsigned long long)lost, (unsigned long long)bad);
+	printf("store %s: %llu taps recovered (%llu torn bytes cut), %llu stored in %llu batches (%.1f per batch)\n",
+		store_path, (unsigned long long)recovered, (unsigned long long)cut_bytes, (unsigned long long)stored,
+		(unsigned long long)batches, batches ? (double)stored / batches : 0.0);
+	hist_print("read to stored", &latency);
+	hist_print("fdatasync", &sync_time);
+	fflush(stdout);
+}
+
+static void usage(const char *argv0)
+{
+	fprintf(stderr, "usage: %s [-s STORE] [-b BATCH] [-f FLUSH_US] [-t SECONDS] TTY...\n", argv0);
+	exit(2);
+}
+
+int main(int argc, char **argv)
+{
+	struct epoll_event ev, events[64];
+	sigset_t sigs;
+	int epfd, sig_fd, opt, running = 1;
+	double seconds = 0;
+
+	while ((opt = getopt(argc, argv, "s:b:f:t:")) != -1)
+	{
+		switch (opt)
+		{
+			case 's':
+				store_path = optarg;
+				break;
+			case 'b':
+				batch_max = atoi(optarg);
+				break;
+			case 'f':
+				flush_us = atol(optarg);
+				break;
+			case 't':
+				seconds = atof(optarg);
+				break;
+			default:
+				usage(argv[0]);
+		}
+	}
+	n_rooms = argc - optind;
+	if (n_rooms < 1 || n_rooms > MAX_ROOMS || batch_max < 1 || batch_max > 4096 || flush_us < 1)
+	{
+		usage(argv[0]);
+	}
+	batch = calloc(batch_max, sizeof(*batch));
+
+	epfd = epoll_create1(0);
+	timer_fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK);
+	sigemptyset(&sigs);
+	sigaddset(&sigs, SIGINT);
+	sigaddset(&sigs, SIGTERM);
+	sigaddset(&sigs, SIGUSR1);
+	sigprocmask(SIG_BLOCK, &sigs, NULL);
+	sig_fd = signalfd(-1, &sigs, SFD_NONBLOCK);
+	if (!batch || epfd < 0 || timer_fd < 0 || sig_fd < 0)
+	{
+		perror("gateway");
+		return 1;
+	}
+	ev.events = EPOLLIN;
+	ev.data.u32 = EV_TIMER;
+	epoll_ctl(epfd, EPOLL_CTL_ADD, timer_fd, &ev);
+	ev.data.u32 = EV_SIGNAL;
+	epoll_ctl(epfd, EPOLL_CTL_ADD, sig_fd, &ev);
+
+	for (int i = 0; i < n_rooms; i++)
+	{
+		rooms[i].path = argv[optind + i];
+		rooms[i].fd = export_open_line(rooms[i].path, O_NONBLOCK);
+		if (rooms[i].fd < 0)
+		{
+			return 1;
+		}
+		ev.events = EPOLLIN;
+		ev.data.u32 = i;
+		if (epoll_ctl(epfd, EPOLL_CTL_ADD, rooms[i].fd, &ev) != 0)
+		{
+			perror(rooms[i].path);
+			return 1;
+		}
+		open_rooms++;
+	}
+	store_open();
+	start_ns = mono_ns();
+
+	while (running && open_rooms > 0)
+	{
+		int timeout = -1, n;
+
+		if (seconds > 0)
+		{
+			double left = seconds - (mono_ns() - start_ns) / 1e9;
+
+			if (left <= 0)
+			{
+				break;
+			}
+			timeout = (int)(left * 1000) + 1;
+		}
+		n = epoll_wait(epfd, events, 64, timeout);
+		if (n < 0 && errno != EINTR)
+		{
+			perror("epoll_wait");
+			break;
+		}
+		for (int i = 0; i < n; i++)
+		{
+			uint32_t id = events[i].data.u32;
+
+			if (id == EV_TIMER)
+			{
+				uint64_t expirations;
+
+				if (read(timer_fd, &expirations, sizeof(expirations)) > 0)
+				{
+					store_flush();
+				}
+			}
+			else if (id == EV_SIGNAL)
+			{
+				struct signalfd_siginfo si;
+
+				while (read(sig_fd, &si, sizeof(si)) == sizeof(si))
+				{
+					if (si.ssi_signo == SIGUSR1)
+					{
+						report();
+					}
+					else
+					{
+						running = 0;
+					}
+				}
+			}
+			else if (rooms[id].fd >= 0)
+			{
+				line_read(epfd, &rooms[id]);
+			}
+		}
+	}
+	store_flush();
+	report();
+	return 0;
+}
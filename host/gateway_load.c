@@ -0,0 +1,318 @@
+/*
+ * gateway_load.c
+ * Drives the gateway with pseudo-terminals standing in for the devices, at
+ * rates far beyond a door, then checks its store.
+ *
+ *   gateway_load [-r ROOMS] [-e TAPS_PER_S] [-t SECONDS] [-s STORE] [-- GATEWAY ARGS...]
+ *
+ * ROOMS ptys are made (default 48) and the gateway (default ./gateway) is
+ * started on their other ends, with -s STORE and any further ARGS. Every
+ * room has a class of STUDENTS that taps in and out at random, plus a card
+ * that is not in the roster now and then, in EXPORT_TAP frames with the
+ * room's own sequence, spread over the rooms at TAPS_PER_S in all
+ * (default 20000) for SECONDS (default 5).
+ *
+ * The writes block when the gateway falls behind and a pty is full; the rate
+ * reached is printed. At the end the ptys are closed, which makes the
+ * gateway store its last batch and exit. The store must then hold every
+ * tap of every room once, in sequence order, and the occupancy it gives must
+ * match the rooms. The exit status is 0 only then.
+ */
+
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <getopt.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <termios.h>
+#include <time.h>
+#include <unistd.h>
+#include "export_frame.h"
+
+#define STUDENTS		40
+#define MAX_ROOMS		1024
+
+/* as in gateway.c */
+#define STORE_MAGIC		"RFIDTAP1"
+#define STORE_RECORD	24
+
+struct room
+{
+	int fd;
+	char path[64];
+	uint8_t present[STUDENTS];
+	unsigned inside;
+	uint16_t seq;
+};
+
+static struct room rooms[MAX_ROOMS];
+static int n_rooms = 48;
+
+static double now_s(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/* a pty master, its slave opened and closed once so that POLLHUP tells when the gateway has it */
+static int room_open(struct room *r)
+{
+	struct termios tio;
+	int slave;
+
+	r->fd = posix_openpt(O_RDWR | O_NOCTTY);
+	if (r->fd < 0 || grantpt(r->fd) != 0 || unlockpt(r->fd) != 0)
+	{
+		perror("posix_openpt");
+		return -1;
+	}
+	snprintf(r->path, sizeof(r->path), "%s", ptsname(r->fd));
+	tcgetattr(r->fd, &tio);
+	cfmakeraw(&tio);
+	tcsetattr(r->fd, TCSANOW, &tio);
+	slave = open(r->path, O_RDWR | O_NOCTTY);
+	if (slave >= 0)
+	{
+		close(slave);
+	}
+	return 0;
+}
+
+static void write_all(int fd, const uint8_t *p, size_t len)
+{
+	while (len > 0)
+	{
+		ssize_t w = write(fd, p, len);
+
+		if (w < 0 && errno != EINTR)
+		{
+			perror("write");
+			exit(1);
+		}
+		if (w > 0)
+		{
+			p += w;
+			len -= w;
+		}
+	}
+}
+
+/* the next tap of a room: a student of its class in or out, or an unknown card */
+static unsigned room_tap(struct room *r, uint8_t *out, uint16_t time)
+{
+	struct export_tap tap;
+	int s = rand() % (STUDENTS + 1);
+
+	tap.seq = ++r->seq;
+	tap.day = 1;
+	tap.time = time;
+	if (s == STUDENTS)
+	{
+		tap.kind = EXPORT_TAP_DENIED;
+		tap.student = 0xFF;
+	}
+	else
+	{
+		tap.kind = r->present[s] ? EXPORT_TAP_OUT : EXPORT_TAP_IN;
+		tap.student = s;
+		r->present[s] = !r->present[s];
+		r->inside += r->present[s] ? 1 : -1;
+	}
+	tap.inside = r->inside;
+	return export_tap_pack(out, &tap);
+}
+
+/* every tap once and in order, the occupancy as the rooms have it */
+static int check_store(const char *path)
+{
+	static uint8_t present[MAX_ROOMS][STUDENTS];
+	static uint16_t seq[MAX_ROOMS];
+	uint8_t rec[STORE_RECORD], magic[8];
+	unsigned long long records = 0, out_of_order = 0, bad = 0;
+	int fd = open(path, O_RDONLY), wrong_rooms = 0;
+	unsigned long long sent = 0, missing = 0;
+
+	if (fd < 0 || read(fd, magic, sizeof(magic)) != sizeof(magic) || memcmp(magic, STORE_MAGIC, 8) != 0)
+	{
+		fprintf(stderr, "%s: no store\n", path);
+		return 1;
+	}
+	while (read(fd, rec, sizeof(rec)) == sizeof(rec))
+	{
+		uint16_t crc = 0xFFFF, room, s;
+
+		for (int i = 0; i < 20; i++)
+		{
+			crc = export_crc_update(crc, rec[i]);
+		}
+		room = export_get16(rec);
+		if (crc != export_get16(rec + 20) || room >= n_rooms)
+		{
+			bad++;
+			continue;
+		}
+		s = export_get16(rec + 2);
+		if (s != (uint16_t)(seq[room] + 1))
+		{
+			out_of_order++;
+		}
+		seq[room] = s;
+		if (rec[9] < STUDENTS)
+		{
+			present[room][rec[9]] = rec[8] == EXPORT_TAP_IN;
+		}
+		records++;
+	}
+	close(fd);
+
+	for (int i = 0; i < n_rooms; i++)
+	{
+		sent += rooms[i].seq;
+		if (seq[i] != rooms[i].seq)
+		{
+			missing += (uint16_t)(rooms[i].seq - seq[i]);
+		}
+		if (memcmp(present[i], rooms[i].present, STUDENTS) != 0)
+		{
+			wrong_rooms++;
+		}
+	}
+	printf("store: %llu taps of %llu sent, %llu missing, %llu out of order, %llu bad records, "
+		"occupancy right in %d of %d rooms\n", records, sent, missing, out_of_order, bad,
+		n_rooms - wrong_rooms, n_rooms);
+	return records == sent && !missing && !out_of_order && !bad && !wrong_rooms ? 0 : 1;
+}
+
+int main(int argc, char **argv)
+{
+	const char *store = "load.store";
+	double rate = 20000, seconds = 5, t0, t, waited = 0;
+	unsigned long long sent = 0;
+	int opt, status, extra;
+	char **gw_argv;
+	pid_t gw;
+
+	while ((opt = getopt(argc, argv, "r:e:t:s:")) != -1)
+	{
+		switch (opt)
+		{
+			case 'r':
+				n_rooms = atoi(optarg);
+				break;
+			case 'e':
+				rate = atof(optarg);
+				break;
+			case 't':
+				seconds = atof(optarg);
+				break;
+			case 's':
+				store = optarg;
+				break;
+			default:
+				fprintf(stderr, "usage: %s [-r ROOMS] [-e TAPS_PER_S] [-t SECONDS] [-s STORE] [-- GATEWAY ARGS...]\n",
+					argv[0]);
+				return 2;
+		}
+	}
+	if (n_rooms < 1 || n_rooms > MAX_ROOMS || rate <= 0 || seconds * rate / n_rooms >= 65535)
+	{
+		fprintf(stderr, "1 to %d rooms, and less than 65535 taps per room\n", MAX_ROOMS);
+		return 2;
+	}
+	extra = argc - optind;
+	srand(1);
+	unlink(store);
+	for (int i = 0; i < n_rooms; i++)
+	{
+		if (room_open(&rooms[i]) != 0)
+		{
+			return 1;
+		}
+	}
+
+	/* gateway -s STORE ARGS... TTY... */
+	gw_argv = calloc(4 + extra + n_rooms, sizeof(*gw_argv));
+	gw_argv[0] = extra ? argv[optind] : "./gateway";
+	gw_argv[1] = "-s";
+	gw_argv[2] = (char *)store;
+	for (int i = 1; i < extra; i++)
+	{
+		gw_argv[2 + i] = argv[optind + i];
+	}
+	for (int i = 0; i < n_rooms; i++)
+	{
+		gw_argv[2 + (extra ? extra : 1) + i] = rooms[i].path;
+	}
+	gw = fork();
+	if (gw == 0)
+	{
+		for (int i = 0; i < n_rooms; i++)
+		{
+			close(rooms[i].fd);
+		}
+		execv(gw_argv[0], gw_argv);
+		perror(gw_argv[0]);
+		_exit(127);
+	}
+
+	/* the gateway has a pty when its POLLHUP is gone */
+	for (int i = 0; i < n_rooms; i++)
+	{
+		struct pollfd p = { rooms[i].fd, 0, 0 };
+
+		while (poll(&p, 1, 0) >= 0 && (p.revents & POLLHUP))
+		{
+			if (waited > 10 || waitpid(gw, &status, WNOHANG) == gw)
+			{
+				fprintf(stderr, "the gateway did not open %s\n", rooms[i].path);
+				kill(gw, SIGTERM);
+				return 1;
+			}
+			usleep(1000);
+			waited += 0.001;
+		}
+	}
+
+	t0 = now_s();
+	while ((t = now_s() - t0) < seconds)
+	{
+		unsigned long long due = (unsigned long long)(t * rate);
+
+		for (; sent < due; sent++)
+		{
+			uint8_t frame[EXPORT_FRAMING + EXPORT_TAP_LENGTH];
+			struct room *r = &rooms[sent % n_rooms];
+
+			write_all(r->fd, frame, room_tap(r, frame, (uint16_t)t));
+		}
+		usleep(500);
+	}
+	t = now_s() - t0;
+	printf("load: %d rooms, %llu taps in %.2f s, %.0f taps/s (%.0f asked)\n", n_rooms, sent, t, sent / t, rate);
+	fflush(stdout);
+
+	/* the gateway reads what is left in the ptys, then sees them hang up */
+	for (int i = 0; i < n_rooms; i++)
+	{
+		tcdrain(rooms[i].fd);
+	}
+	usleep(500000);
+	for (int i = 0; i < n_rooms; i++)
+	{
+		close(rooms[i].fd);
+	}
+	if (waitpid(gw, &status, 0) != gw || !WIFEXITED(status) || WEXITSTATUS(status) != 0)
+	{
+		fprintf(stderr, "the gateway failed\n");
+		return 1;
+	}
+	return check_store(store);
+}
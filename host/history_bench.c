@@ -0,0 +1,119 @@
+/*
+ * history_bench.c
+ * Size and decode cost of the compressed attendance history (history.h) for
+ * a class of 30 over a semester of 42 lectures, against the three bytes per
+ * student and day of the NonVolatileHour/Minute/Second matrices.
+ *
+ * The attendance is synthetic: every student comes on 90% of the days, most
+ * of them in the first two minutes of the entrance period, a few up to its
+ * end. The EEPROM reads are charged by the simulator; the bit loop around them
+ * is estimated from what avr-gcc -Os makes of history_get().
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include "sim.h"
+
+#define ROSTER_SIZE			30
+#define HISTORY_STUDENTS	ROSTER_SIZE
+
+#include "../history.h"
+
+/* shift, AND, OR into value, pos++ and the loop compare, per bit */
+#define BIT_CYCLES		18
+/* the modulo of the ring and the directory index, per directory entry */
+#define DIR_CYCLES		40
+
+#define SEMESTER		42
+#define ENTRANCE_S		600
+
+static uint8_t days_present[SEMESTER][PRESENCE_BYTES(HISTORY_STUDENTS)];
+static uint8_t days_arrival[SEMESTER][HISTORY_STUDENTS];
+
+static void make_day(int d)
+{
+	presence_fill(days_present[d], HISTORY_STUDENTS, 0);
+	memset(days_arrival[d], 0, HISTORY_STUDENTS);
+	for (int i = 0; i < HISTORY_STUDENTS; i++)
+	{
+		unsigned s;
+
+		if (rand() % 10 == 0)
+		{
+			continue;
+		}
+		/* three in four within two minutes, the rest spread over the period */
+		s = rand() % 4 ? rand() % 120 : rand() % ENTRANCE_S;
+		presence_set(days_present[d], i);
+		days_arrival[d][i] = s / HISTORY_ARRIVAL_UNIT < HISTORY_ARRIVAL_MAX ? s / HISTORY_ARRIVAL_UNIT : HISTORY_ARRIVAL_MAX;
+	}
+}
+
+int main(void)
+{
+	uint8_t present[PRESENCE_BYTES(HISTORY_STUDENTS)];
+	uint8_t arrival[HISTORY_STUDENTS];
+	uint64_t bits, reads, start, worst = 0, total = 0;
+	unsigned bytes = 0, decoded = 0;
+
+	srand(14);
+	sim_start();
+	for (int d = 0; d < SEMESTER; d++)
+	{
+		make_day(d);
+		history_append(d + 1, days_present[d], days_arrival[d]);
+	}
+	eeprom_queue_flush();
+	for (int d = 0; d < SEMESTER; d++)
+	{
+		bytes += history_encode((uint8_t[HISTORY_BLOCK_MAX]){ 0 }, days_present[d], days_arrival[d]);
+	}
+
+	/* every day still in the history, checked against what went in */
+	for (uint16_t day = history.first_day; day < history.first_day + history.count; day++)
+	{
+		uint8_t block[HISTORY_BLOCK_MAX];
+		uint16_t n = day - history.first_day;
+
+		start = sim_now();
+		if (!history_day(day, present, arrival))
+		{
+			fprintf(stderr, "day %u is missing\n", day);
+			return 1;
+		}
+		/* the instructions around the reads: the directory walk and one bit at a time */
+		bits = 8 * history_encode(block, days_present[day - 1], days_arrival[day - 1]);
+		reads = sim_now() - start + n * DIR_CYCLES + bits * BIT_CYCLES;
+		total += reads;
+		if (reads > worst)
+		{
+			worst = reads;
+		}
+		if (memcmp(present, days_present[day - 1], sizeof(present)) != 0)
+		{
+			fprintf(stderr, "day %u decodes to other students\n", day);
+			return 1;
+		}
+		for (int i = 0; i < HISTORY_STUDENTS; i++)
+		{
+			if (presence_test(present, i) && arrival[i] != days_arrival[day - 1][i])
+			{
+				fprintf(stderr, "day %u decodes to other arrivals\n", day);
+				return 1;
+			}
+		}
+		decoded++;
+	}
+
+	printf("history of %d students, %d days, arrivals in %d s units\n", HISTORY_STUDENTS, SEMESTER,
+		HISTORY_ARRIVAL_UNIT);
+	printf("  %-28s %8d bytes/day\n", "hour/min/sec matrices", 3 * HISTORY_STUDENTS);
+	printf("  %-28s %8.1f bytes/day\n", "compressed", (double)bytes / SEMESTER);
+	printf("  %-28s %8d bytes (%d journal, %d directory)\n", "room for the blocks", HISTORY_BYTES,
+		JOURNAL_SLOTS * JOURNAL_RECORD, HISTORY_DAYS);
+	printf("  %-28s %8u of %d (%u bytes used)\n", "days kept", history.count, SEMESTER, history.used);
+	printf("  %-28s %8u\n", "days decoded and checked", decoded);
+	printf("  %-28s %8llu cycles avg, %llu worst\n", "decode one day", (unsigned long long)(decoded ? total / decoded : 0),
+		(unsigned long long)worst);
+	return 0;
+}
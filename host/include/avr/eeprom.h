@@ -0,0 +1,98 @@
+/*
+ * avr/eeprom.h (host)
+ * EEMEM variables are collected in their own section and only serve as
+ * addresses into the simulated 1 KB EEPROM, exactly like on the device.
+ */
+#ifndef SIM_AVR_EEPROM_H
+#define SIM_AVR_EEPROM_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "sim.h"
+
+/* packed back to back like avr-gcc does, the host compiler would align larger arrays */
+#define EEMEM __attribute__((section("sim_eeprom"), used, aligned(1)))
+
+#define eeprom_is_ready()	(sim_eeprom_ready())
+#define eeprom_busy_wait()	do {} while (!eeprom_is_ready())
+
+static inline uint8_t eeprom_read_byte(const uint8_t *p)
+{
+	return sim_eeprom_read(sim_eeprom_addr(p));
+}
+
+static inline uint16_t eeprom_read_word(const uint16_t *p)
+{
+	uint16_t a = sim_eeprom_addr(p);
+	return sim_eeprom_read(a) | ((uint16_t)sim_eeprom_read(a + 1) << 8);
+}
+
+static inline uint32_t eeprom_read_dword(const uint32_t *p)
+{
+	uint16_t a = sim_eeprom_addr(p);
+	uint32_t v = 0;
+	for (uint8_t i = 0; i < 4; i++)
+		v |= (uint32_t)sim_eeprom_read(a + i) << (8 * i);
+	return v;
+}
+
+static inline void eeprom_read_block(void *dst, const void *src, size_t n)
+{
+	uint16_t a = sim_eeprom_addr(src);
+	for (size_t i = 0; i < n; i++)
+		((uint8_t *)dst)[i] = sim_eeprom_read(a + i);
+}
+
+static inline void eeprom_write_byte(uint8_t *p, uint8_t v)
+{
+	sim_eeprom_write(sim_eeprom_addr(p), v, 0);
+}
+
+static inline void eeprom_update_byte(uint8_t *p, uint8_t v)
+{
+	sim_eeprom_write(sim_eeprom_addr(p), v, 1);
+}
+
+static inline void eeprom_write_word(uint16_t *p, uint16_t v)
+{
+	uint16_t a = sim_eeprom_addr(p);
+	sim_eeprom_write(a, v & 0xFF, 0);
+	sim_eeprom_write(a + 1, v >> 8, 0);
+}
+
+static inline void eeprom_update_word(uint16_t *p, uint16_t v)
+{
+	uint16_t a = sim_eeprom_addr(p);
+	sim_eeprom_write(a, v & 0xFF, 1);
+	sim_eeprom_write(a + 1, v >> 8, 1);
+}
+
+static inline void eeprom_write_dword(uint32_t *p, uint32_t v)
+{
+	uint16_t a = sim_eeprom_addr(p);
+	for (uint8_t i = 0; i < 4; i++)
+		sim_eeprom_write(a + i, (v >> (8 * i)) & 0xFF, 0);
+}
+
+static inline void eeprom_update_dword(uint32_t *p, uint32_t v)
+{
+	uint16_t a = sim_eeprom_addr(p);
+	for (uint8_t i = 0; i < 4; i++)
+		sim_eeprom_write(a + i, (v >> (8 * i)) & 0xFF, 1);
+}
+
+static inline void eeprom_write_block(const void *src, void *dst, size_t n)
+{
+	uint16_t a = sim_eeprom_addr(dst);
+	for (size_t i = 0; i < n; i++)
+		sim_eeprom_write(a + i, ((const uint8_t *)src)[i], 0);
+}
+
+static inline void eeprom_update_block(const void *src, void *dst, size_t n)
+{
+	uint16_t a = sim_eeprom_addr(dst);
+	for (size_t i = 0; i < n; i++)
+		sim_eeprom_write(a + i, ((const uint8_t *)src)[i], 1);
+}
+
+#endif /* SIM_AVR_EEPROM_H */
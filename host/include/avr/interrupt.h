@@ -0,0 +1,15 @@
+/*
+ * avr/interrupt.h (host)
+ * ISR() defines a plain function named after the vector; host/sim.c dispatches it.
+ */
+#ifndef SIM_AVR_INTERRUPT_H
+#define SIM_AVR_INTERRUPT_H
+
+#include "sim.h"
+
+#define ISR(vector, ...)	void vector(void); void vector(void)
+
+#define sei()	sim_sei()
+#define cli()	sim_cli()
+
+#endif /* SIM_AVR_INTERRUPT_H */
@@ -0,0 +1,263 @@
+/*
+ * avr/io.h (host)
+ * ATmega32 register map routed through the simulator in host/sim.c
+ */
+#ifndef SIM_AVR_IO_H
+#define SIM_AVR_IO_H
+
+#include <stdint.h>
+#include "sim.h"
+
+#define _SFR_IO8(a)		(*sim_io8(a))
+#define _SFR_IO16(a)	(*sim_io16(a))
+#define _BV(bit)		(1 << (bit))
+
+/* Ports */
+#define PINA	_SFR_IO8(0x19)
+#define DDRA	_SFR_IO8(0x1A)
+#define PORTA	_SFR_IO8(0x1B)
+#define PINB	_SFR_IO8(0x16)
+#define DDRB	_SFR_IO8(0x17)
+#define PORTB	_SFR_IO8(0x18)
+#define PINC	_SFR_IO8(0x13)
+#define DDRC	_SFR_IO8(0x14)
+#define PORTC	_SFR_IO8(0x15)
+#define PIND	_SFR_IO8(0x10)
+#define DDRD	_SFR_IO8(0x11)
+#define PORTD	_SFR_IO8(0x12)
+
+/* SPI */
+#define SPCR	_SFR_IO8(0x0D)
+#define SPSR	_SFR_IO8(0x0E)
+#define SPDR	_SFR_IO8(0x0F)
+
+/* USART */
+#define UBRRL	_SFR_IO8(0x09)
+#define UCSRB	_SFR_IO8(0x0A)
+#define UCSRA	_SFR_IO8(0x0B)
+#define UDR		_SFR_IO8(0x0C)
+#define UCSRC	_SFR_IO8(0x20)
+#define UBRRH	_SFR_IO8(0x20)
+
+/* EEPROM */
+#define EECR	_SFR_IO8(0x1C)
+#define EEDR	_SFR_IO8(0x1D)
+#define EEAR	_SFR_IO16(0x1E)
+#define EEARL	_SFR_IO8(0x1E)
+#define EEARH	_SFR_IO8(0x1F)
+
+/* Timers */
+#define OCR2	_SFR_IO8(0x23)
+#define TCNT2	_SFR_IO8(0x24)
+#define TCCR2	_SFR_IO8(0x25)
+#define ICR1	_SFR_IO16(0x26)
+#define OCR1B	_SFR_IO16(0x28)
+#define OCR1A	_SFR_IO16(0x2A)
+#define TCNT1	_SFR_IO16(0x2C)
+#define TCCR1B	_SFR_IO8(0x2E)
+#define TCCR1A	_SFR_IO8(0x2F)
+#define TCNT0	_SFR_IO8(0x32)
+#define TCCR0	_SFR_IO8(0x33)
+#define OCR0	_SFR_IO8(0x3C)
+#define TIFR	_SFR_IO8(0x38)
+#define TIMSK	_SFR_IO8(0x39)
+
+/* System */
+#define ACSR	_SFR_IO8(0x08)
+#define SFIOR	_SFR_IO8(0x30)
+#define MCUCSR	_SFR_IO8(0x34)
+#define MCUCR	_SFR_IO8(0x35)
+#define GIFR	_SFR_IO8(0x3A)
+#define GICR	_SFR_IO8(0x3B)
+#define SREG	_SFR_IO8(0x3F)
+
+/* Port bits */
+#define PA0 0
+#define PA1 1
+#define PA2 2
+#define PA3 3
+#define PA4 4
+#define PA5 5
+#define PA6 6
+#define PA7 7
+#define PB0 0
+#define PB1 1
+#define PB2 2
+#define PB3 3
+#define PB4 4
+#define PB5 5
+#define PB6 6
+#define PB7 7
+#define PC0 0
+#define PC1 1
+#define PC2 2
+#define PC3 3
+#define PC4 4
+#define PC5 5
+#define PC6 6
+#define PC7 7
+#define PD0 0
+#define PD1 1
+#define PD2 2
+#define PD3 3
+#define PD4 4
+#define PD5 5
+#define PD6 6
+#define PD7 7
+
+/* SPCR */
+#define SPIE	7
+#define SPE		6
+#define DORD	5
+#define MSTR	4
+#define CPOL	3
+#define CPHA	2
+#define SPR1	1
+#define SPR0	0
+/* SPSR */
+#define SPIF	7
+#define WCOL	6
+#define SPI2X	0
+
+/* UCSRA */
+#define RXC		7
+#define TXC		6
+#define UDRE	5
+#define FE		4
+#define DOR		3
+#define PE		2
+#define U2X		1
+#define MPCM	0
+/* UCSRB */
+#define RXCIE	7
+#define TXCIE	6
+#define UDRIE	5
+#define RXEN	4
+#define TXEN	3
+#define UCSZ2	2
+#define RXB8	1
+#define TXB8	0
+/* UCSRC */
+#define URSEL	7
+#define UMSEL	6
+#define UPM1	5
+#define UPM0	4
+#define USBS	3
+#define UCSZ1	2
+#define UCSZ0	1
+#define UCPOL	0
+
+/* SREG */
+#define SREG_I	7
+
+/* EECR */
+#define EERIE	3
+#define EEMWE	2
+#define EEWE	1
+#define EERE	0
+
+/* TCCR0 */
+#define FOC0	7
+#define WGM00	6
+#define COM01	5
+#define COM00	4
+#define WGM01	3
+#define CS02	2
+#define CS01	1
+#define CS00	0
+/* TCCR1A */
+#define COM1A1	7
+#define COM1A0	6
+#define COM1B1	5
+#define COM1B0	4
+#define FOC1A	3
+#define FOC1B	2
+#define WGM11	1
+#define WGM10	0
+/* TCCR1B */
+#define ICNC1	7
+#define ICES1	6
+#define WGM13	4
+#define WGM12	3
+#define CS12	2
+#define CS11	1
+#define CS10	0
+/* TCCR2 */
+#define FOC2	7
+#define WGM20	6
+#define COM21	5
+#define COM20	4
+#define WGM21	3
+#define CS22	2
+#define CS21	1
+#define CS20	0
+/* TIMSK / TIFR */
+#define OCIE2	7
+#define TOIE2	6
+#define TICIE1	5
+#define OCIE1A	4
+#define OCIE1B	3
+#define TOIE1	2
+#define OCIE0	1
+#define TOIE0	0
+#define OCF2	7
+#define TOV2	6
+#define ICF1	5
+#define OCF1A	4
+#define OCF1B	3
+#define TOV1	2
+#define OCF0	1
+#define TOV0	0
+
+/* MCUCR */
+#define SE		7
+#define SM2		6
+#define SM1		5
+#define SM0		4
+#define ISC11	3
+#define ISC10	2
+#define ISC01	1
+#define ISC00	0
+/* MCUCSR */
+#define JTD		7
+#define ISC2	6
+#define JTRF	4
+#define WDRF	3
+#define BORF	2
+#define EXTRF	1
+#define PORF	0
+/* GICR */
+#define INT1	7
+#define INT0	6
+#define INT2	5
+#define IVSEL	1
+#define IVCE	0
+/* GIFR */
+#define INTF1	7
+#define INTF0	6
+#define INTF2	5
+
+/* Interrupt vectors */
+#define _VECTOR(N)			__vector_ ## N
+#define INT0_vect			_VECTOR(1)
+#define INT1_vect			_VECTOR(2)
+#define INT2_vect			_VECTOR(3)
+#define TIMER2_COMP_vect	_VECTOR(4)
+#define TIMER2_OVF_vect		_VECTOR(5)
+#define TIMER1_CAPT_vect	_VECTOR(6)
+#define TIMER1_COMPA_vect	_VECTOR(7)
+#define TIMER1_COMPB_vect	_VECTOR(8)
+#define TIMER1_OVF_vect		_VECTOR(9)
+#define TIMER0_COMP_vect	_VECTOR(10)
+#define TIMER0_OVF_vect		_VECTOR(11)
+#define SPI_STC_vect		_VECTOR(12)
+#define USART_RXC_vect		_VECTOR(13)
+#define USART_UDRE_vect		_VECTOR(14)
+#define USART_TXC_vect		_VECTOR(15)
+#define ADC_vect			_VECTOR(16)
+#define EE_RDY_vect			_VECTOR(17)
+#define ANA_COMP_vect		_VECTOR(18)
+#define TWI_vect			_VECTOR(19)
+#define SPM_RDY_vect		_VECTOR(20)
+
+#endif /* SIM_AVR_IO_H */
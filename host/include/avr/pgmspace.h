@@ -0,0 +1,52 @@
+/*
+ * avr/pgmspace.h (host)
+ * PROGMEM data stays in ordinary memory, every pgm_read_* is charged the
+ * 3 cycles per byte of LPM on the device.
+ */
+#ifndef SIM_AVR_PGMSPACE_H
+#define SIM_AVR_PGMSPACE_H
+
+#include <stdint.h>
+#include <string.h>
+#include "sim.h"
+
+#define PROGMEM
+#define PSTR(s)		(s)
+
+static inline uint8_t pgm_read_byte(const void *p)
+{
+	sim_advance(3);
+	return *(const uint8_t *)p;
+}
+
+static inline uint16_t pgm_read_word(const void *p)
+{
+	sim_advance(6);
+	return *(const uint16_t *)p;
+}
+
+static inline uint32_t pgm_read_dword(const void *p)
+{
+	sim_advance(12);
+	return *(const uint32_t *)p;
+}
+
+static inline char *strcpy_P(char *dst, const char *src)
+{
+	sim_advance(3 * (strlen(src) + 1));
+	return strcpy(dst, src);
+}
+
+static inline size_t strlen_P(const char *s)
+{
+	sim_advance(3 * (strlen(s) + 1));
+	return strlen(s);
+}
+
+static inline char *strcat_P(char *dst, const char *src)
+{
+	sim_advance(3 * (strlen(src) + 1));
+	return strcat(dst, src);
+}
+
+#endif /* SIM_AVR_PGMSPACE_H */
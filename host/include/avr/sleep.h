@@ -0,0 +1,23 @@
+/*
+ * avr/sleep.h (host)
+ * sleep_cpu() idles the simulated CPU until the next interrupt has been served.
+ */
+#ifndef SIM_AVR_SLEEP_H
+#define SIM_AVR_SLEEP_H
+
+#include <avr/io.h>
+
+#define SLEEP_MODE_IDLE			0
+#define SLEEP_MODE_ADC			(1 << SM0)
+#define SLEEP_MODE_PWR_DOWN		(1 << SM1)
+#define SLEEP_MODE_PWR_SAVE		((1 << SM0) | (1 << SM1))
+#define SLEEP_MODE_STANDBY		((1 << SM1) | (1 << SM2))
+#define SLEEP_MODE_EXT_STANDBY	((1 << SM0) | (1 << SM1) | (1 << SM2))
+
+#define set_sleep_mode(mode)	(MCUCR = (MCUCR & ~((1 << SM0) | (1 << SM1) | (1 << SM2))) | (mode))
+#define sleep_enable()			(MCUCR |= (1 << SE))
+#define sleep_disable()			(MCUCR &= ~(1 << SE))
+#define sleep_cpu()				sim_sleep()
+#define sleep_mode()			do { sleep_enable(); sleep_cpu(); sleep_disable(); } while (0)
+
+#endif /* SIM_AVR_SLEEP_H */
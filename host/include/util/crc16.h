@@ -0,0 +1,51 @@
+/*
+ * util/crc16.h (host)
+ * The C equivalents given in the avr-libc documentation of the inline
+ * assembler versions.
+ */
+#ifndef SIM_UTIL_CRC16_H
+#define SIM_UTIL_CRC16_H
+
+#include <stdint.h>
+
+static inline uint16_t _crc16_update(uint16_t crc, uint8_t a)
+{
+	crc ^= a;
+	for (int i = 0; i < 8; ++i)
+	{
+		if (crc & 1)
+			crc = (crc >> 1) ^ 0xA001;
+		else
+			crc = (crc >> 1);
+	}
+	return crc;
+}
+
+static inline uint16_t _crc_ccitt_update(uint16_t crc, uint8_t data)
+{
+	data ^= crc & 0xFF;
+	data ^= data << 4;
+	return ((((uint16_t)data << 8) | (crc >> 8)) ^ (uint8_t)(data >> 4) ^ ((uint16_t)data << 3));
+}
+
+static inline uint8_t _crc8_ccitt_update(uint8_t crc, uint8_t data)
+{
+	uint8_t i;
+
+	data ^= crc;
+	for (i = 0; i < 8; i++)
+	{
+		if ((data & 0x80) != 0)
+		{
+			data <<= 1;
+			data ^= 0x07;
+		}
+		else
+		{
+			data <<= 1;
+		}
+	}
+	return data;
+}
+
+#endif /* SIM_UTIL_CRC16_H */
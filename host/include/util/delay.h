@@ -0,0 +1,13 @@
+/*
+ * util/delay.h (host)
+ * Busy-wait delays advance the simulator clock instead of spinning.
+ */
+#ifndef SIM_UTIL_DELAY_H
+#define SIM_UTIL_DELAY_H
+
+#include "sim.h"
+
+#define _delay_us(us)	sim_delay_us((double)(us))
+#define _delay_ms(ms)	sim_delay_us((double)(ms) * 1000.0)
+
+#endif /* SIM_UTIL_DELAY_H */
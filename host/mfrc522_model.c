@@ -0,0 +1,1100 @@
+/*
+ * mfrc522_model.c
+ * Register-level model of the RC522 and of the ISO/IEC 14443-3 type A tags in its field.
+ *
+ * SPI (datasheet 8.1.2): the first byte of a frame is (addr << 1), with bit 7 set for
+ * reads. In a read frame every following MOSI byte is the next address to read, in a
+ * write frame every following byte goes to the same address. FIFODataReg can therefore
+ * be burst-read and burst-written within one chip select.
+ *
+ * Modelled: CommandReg (Idle, Transmit, Transceive, CalcCRC, SoftReset, PowerDown),
+ * ComIrqReg/DivIrqReg with their Set bits, ComIEnReg/DivIEnReg and Status1Reg IRq,
+ * the 64 byte FIFO with FIFOLevelReg flush, BitFramingReg StartSend/TxLastBits/RxAlign,
+ * ControlReg RxLastBits and timer start/stop, ErrorReg, CollReg, TxModeReg/RxModeReg
+ * CRC, TxControlReg antenna, the TMode/TPrescaler/TReload timer and VersionReg 0x92.
+ * Tags answer REQA, WUPA, anticollision and SELECT on cascade levels 1-3, and HLTA,
+ * with air times of 106 kbit/s framing plus the frame delay time.
+ *
+ * Soft power-down (CommandReg PowerDown) turns the field off; after PowerDown is
+ * cleared it reads 1 until the oscillator runs again, and only then the field is
+ * back. The report adds up the time in power-down, awake and with the field on
+ * into the supply of the chip.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include "sim.h"
+#include "mfrc522_model.h"
+#include "../mfrc522_cmd.h"
+#include "../mfrc522_reg.h"
+
+#define MAX_TAGS		4096
+#define FIFO_SIZE		64
+#define MAX_READERS		3
+
+/* ISO/IEC 14443 type A at 106 kbit/s */
+#define FC_HZ			13560000.0
+#define BIT_NS			9440		/* 128 / fc */
+#define FDT_NS			86430		/* 1172 / fc, PCD end of frame to PICC start of frame */
+#define POWER_UP_US		2500		/* a tag needs a few ms of field before it answers */
+#define OSC_START_US	1000		/* the 27.12 MHz oscillator after soft power-down */
+
+/* supply, datasheet typical values */
+#define SUPPLY_DOWN_MA	0.01		/* soft power-down */
+#define SUPPLY_ON_MA	13.5		/* IDDD + IDDA */
+#define SUPPLY_FIELD_MA	60.0		/* and ITVDD with the field on */
+
+enum power { POWER_DOWN, POWER_ON, POWER_FIELD };
+
+/* ComIrqReg */
+#define IRQ_TX			0x40
+#define IRQ_RX			0x20
+#define IRQ_IDLE		0x10
+#define IRQ_HIALERT		0x08
+#define IRQ_LOALERT		0x04
+#define IRQ_ERR			0x02
+#define IRQ_TIMER		0x01
+/* DivIrqReg */
+#define DIVIRQ_CRC		0x04
+/* ErrorReg */
+#define ERR_BUFFEROVFL	0x10
+#define ERR_COLL		0x08
+#define ERR_CRC			0x04
+
+/* PICC commands */
+#define PICC_REQA		0x26
+#define PICC_WUPA		0x52
+#define PICC_HLTA		0x50
+
+enum tag_state { TAG_OFF, TAG_IDLE, TAG_READY, TAG_ACTIVE, TAG_HALT };
+
+struct tag
+{
+	uint8_t uid[10];
+	uint8_t uid_len;
+	uint8_t sak;
+	uint64_t enter, leave;
+	enum tag_state state;
+	int from_halt;			/* READY* / ACTIVE* of the standard */
+	uint8_t level;			/* cascade level being resolved */
+	uint64_t epoch;			/* power-up the state belongs to */
+	uint64_t read_at;		/* first time the reader got the complete UID */
+	int read_this_round;	/* UID delivered since the last REQA/WUPA */
+	uint32_t reads;
+};
+
+struct mfrc522_model
+{
+	uint8_t reg[64];
+	uint8_t fifo[FIFO_SIZE];
+	uint8_t fifo_len;
+	uint8_t ss_port, ss_bit;
+	int irq_wired;
+	uint8_t irq_port, irq_bit;
+	int irq_level;			/* last level driven on the IRQ pin, -1 before the first */
+
+	/* SPI frame */
+	int first;
+	int reading;
+	uint8_t addr;
+
+	/* RF field */
+	int field_on;
+	uint64_t field_since;
+	uint64_t osc_ready;		/* soft power-down left, the oscillator runs from then on */
+
+	/* supply */
+	enum power power;
+	uint64_t power_since;
+	uint64_t power_cycles[3];
+
+	/* command in flight */
+	int busy;
+	int tx_only;
+	int tx_irq_done;
+	uint64_t tx_end, rx_start, rx_end;
+	int responded;
+	uint8_t rx[FIFO_SIZE];
+	uint8_t rx_len, rx_lastbits, rx_error, rx_coll;
+	int timer_on;
+	uint64_t timer_fire;
+
+	struct tag tags[MAX_TAGS];
+	int n_tags;
+
+	struct
+	{
+		uint64_t spi_bytes, spi_frames, irq_reads;
+		uint64_t reqa, wupa, anticoll, select, hlta, other, crc, resets, brownouts, collisions;
+		uint64_t polls, empty_polls, empty_bytes, empty_irq, tap_polls, tap_bytes, tap_irq;
+	} stats;
+	uint64_t poll_bytes, poll_irq;
+	int poll_started, poll_read;
+};
+
+static const uint8_t reset_values[][2] = {
+	{ CommandReg, 0x20 }, { ComIEnReg, 0x80 }, { ComIrqReg, 0x14 }, { Status1Reg, 0x21 },
+	{ WaterLevelReg, 0x08 }, { ControlReg, 0x10 }, { CollReg, 0x80 }, { ModeReg, 0x3F },
+	{ TxControlReg, 0x80 }, { TxSelReg, 0x10 }, { RxSelReg, 0x84 }, { RxThresholdReg, 0x84 },
+	{ DemodReg, 0x4D }, { MfTxReg, 0x62 }, { SerialSpeedReg, 0xEB }, { CRCResultReg_1, 0xFF },
+	{ CRCResultReg_2, 0xFF }, { ModWidthReg, 0x26 }, { RFCfgReg, 0x48 }, { GsNReg, 0x88 },
+	{ CWGsPReg, 0x20 }, { ModGsPReg, 0x20 }, { VersionReg, 0x92 },
+};
+
+static struct mfrc522_model models[MAX_READERS];
+static int n_models;
+
+/***************************************************
+Helpers
+***************************************************/
+static uint64_t ns_to_cycles(uint64_t ns)
+{
+	return (ns * (F_CPU / 1000000UL) + 999) / 1000;
+}
+
+/* air time of a frame of `bits` data bits: parity per full byte, start and end of frame */
+static uint64_t air_cycles(int bits)
+{
+	return ns_to_cycles((uint64_t)(bits + bits / 8 + 2) * BIT_NS);
+}
+
+static uint16_t crc_a(const uint8_t *data, int len)
+{
+	uint16_t crc = 0x6363;
+
+	for (int i = 0; i < len; i++)
+	{
+		uint8_t b = data[i] ^ (crc & 0xFF);
+		b ^= b << 4;
+		crc = (crc >> 8) ^ ((uint16_t)b << 8) ^ ((uint16_t)b << 3) ^ (b >> 4);
+	}
+	return crc;
+}
+
+static int get_bit(const uint8_t *buf, int i)
+{
+	return (buf[i / 8] >> (i % 8)) & 1;
+}
+
+static void put_bit(uint8_t *buf, int i, int v)
+{
+	if (v)
+	{
+		buf[i / 8] |= 1 << (i % 8);
+	}
+	else
+	{
+		buf[i / 8] &= ~(1 << (i % 8));
+	}
+}
+
+static void fifo_alerts(struct mfrc522_model *m)
+{
+	uint8_t water = m->reg[WaterLevelReg] & 0x3F;
+
+	if (m->fifo_len <= water)
+	{
+		m->reg[ComIrqReg] |= IRQ_LOALERT;
+	}
+	if (FIFO_SIZE - m->fifo_len <= water)
+	{
+		m->reg[ComIrqReg] |= IRQ_HIALERT;
+	}
+}
+
+static void fifo_push(struct mfrc522_model *m, uint8_t v)
+{
+	if (m->fifo_len == FIFO_SIZE)
+	{
+		m->reg[ErrorReg] |= ERR_BUFFEROVFL;
+		return;
+	}
+	m->fifo[m->fifo_len++] = v;
+	fifo_alerts(m);
+}
+
+static uint8_t fifo_pop(struct mfrc522_model *m)
+{
+	uint8_t v;
+
+	if (!m->fifo_len)
+	{
+		return 0;
+	}
+	v = m->fifo[0];
+	memmove(m->fifo, m->fifo + 1, --m->fifo_len);
+	fifo_alerts(m);
+	return v;
+}
+
+static const char *uid_hex(const struct tag *t)
+{
+	static char buf[21];
+
+	for (int i = 0; i < t->uid_len; i++)
+	{
+		sprintf(buf + 2 * i, "%02X", t->uid[i]);
+	}
+	return buf;
+}
+
+/***************************************************
+RF field and tags
+***************************************************/
+/* the time in the power state so far counts, a new one starts */
+static void power_update(struct mfrc522_model *m)
+{
+	uint64_t now = sim_now();
+
+	m->power_cycles[m->power] += now - m->power_since;
+	m->power_since = now;
+	m->power = (m->reg[CommandReg] & 0x10) ? POWER_DOWN : m->field_on ? POWER_FIELD : POWER_ON;
+}
+
+static void field_update(struct mfrc522_model *m)
+{
+	int on = (m->reg[TxControlReg] & 0x03) && !(m->reg[CommandReg] & 0x10);
+
+	if (on && !m->field_on)
+	{
+		m->field_since = sim_now() > m->osc_ready ? sim_now() : m->osc_ready;
+	}
+	m->field_on = on;
+	power_update(m);
+}
+
+static void tag_power(struct mfrc522_model *m, struct tag *t)
+{
+	uint64_t now = sim_now();
+	uint64_t since = t->enter > m->field_since ? t->enter : m->field_since;
+
+	if (!m->field_on || now < since + SIM_US(POWER_UP_US) || now >= t->leave)
+	{
+		t->state = TAG_OFF;
+		return;
+	}
+	if (t->state == TAG_OFF || t->epoch != since)
+	{
+		t->epoch = since;
+		t->state = TAG_IDLE;
+		t->from_halt = 0;
+		t->level = 0;
+	}
+}
+
+static uint8_t tag_levels(const struct tag *t)
+{
+	return t->uid_len == 4 ? 1 : t->uid_len == 7 ? 2 : 3;
+}
+
+/* UID CLn of cascade level `level` followed by its BCC */
+static void tag_cl(const struct tag *t, uint8_t level, uint8_t cl[5])
+{
+	const uint8_t *u = t->uid + 3 * level;
+
+	if (level + 1 < tag_levels(t))
+	{
+		cl[0] = 0x88;	/* cascade tag */
+		memcpy(cl + 1, u, 3);
+	}
+	else
+	{
+		memcpy(cl, u, 4);
+	}
+	cl[4] = cl[0] ^ cl[1] ^ cl[2] ^ cl[3];
+}
+
+static void tag_mark_read(struct mfrc522_model *m, struct tag *t)
+{
+	/* the SELECT after a complete anticollision answer is not another read */
+	if (t->read_this_round)
+	{
+		return;
+	}
+	t->read_this_round = 1;
+	t->reads++;
+	m->poll_read = 1;
+	if (!t->read_at)
+	{
+		t->read_at = m->rx_end;
+		if (sim_trace)
+		{
+			sim_log("tag %s read %.1f ms after entering the field", uid_hex(t),
+				(double)(t->read_at - t->enter) * 1000.0 / F_CPU);
+		}
+	}
+}
+
+/* a tag that gets a frame it does not expect falls back to IDLE (or HALT) */
+static void tag_drop(struct tag *t)
+{
+	if (t->state == TAG_READY || t->state == TAG_ACTIVE)
+	{
+		t->state = t->from_halt ? TAG_HALT : TAG_IDLE;
+	}
+}
+
+/*
+ * Returns the number of response bits written to resp, 0 if the tag stays silent.
+ * *completes is set when an undisturbed answer hands the reader the complete UID.
+ */
+static int tag_receive(struct tag *t, const uint8_t *f, int bits, uint8_t *resp, int *completes)
+{
+	*completes = 0;
+	if (bits == 7 && (f[0] == PICC_REQA || f[0] == PICC_WUPA))
+	{
+		if (t->state == TAG_IDLE || (t->state == TAG_HALT && f[0] == PICC_WUPA))
+		{
+			t->from_halt = t->state == TAG_HALT;
+			t->state = TAG_READY;
+			t->level = 0;
+			t->read_this_round = 0;
+			resp[0] = t->uid_len == 4 ? 0x04 : t->uid_len == 7 ? 0x44 : 0x84;
+			resp[1] = 0x00;
+			return 16;
+		}
+		tag_drop(t);
+		return 0;
+	}
+
+	if (bits >= 16 && (f[0] == 0x93 || f[0] == 0x95 || f[0] == 0x97))
+	{
+		uint8_t level = (f[0] - 0x93) / 2;
+		uint8_t cl[5];
+		int known = bits - 16;
+
+		if (t->state != TAG_READY || t->level != level)
+		{
+			tag_drop(t);
+			return 0;
+		}
+		tag_cl(t, level, cl);
+		if (f[1] == 0x70 && bits == 72)
+		{
+			uint16_t crc = crc_a(f, 7);
+			if (f[7] != (crc & 0xFF) || f[8] != (crc >> 8) || memcmp(f + 2, cl, 5) != 0)
+			{
+				tag_drop(t);
+				return 0;
+			}
+			if (level + 1 < tag_levels(t))
+			{
+				resp[0] = 0x04;		/* UID not complete */
+				t->level++;
+			}
+			else
+			{
+				resp[0] = t->sak;
+				t->state = TAG_ACTIVE;
+				*completes = 1;
+			}
+			crc = crc_a(resp, 1);
+			resp[1] = crc & 0xFF;
+			resp[2] = crc >> 8;
+			return 24;
+		}
+		if (known >= 40 || (f[1] >> 4) * 8 + (f[1] & 0x0F) != bits)
+		{
+			return 0;
+		}
+		for (int i = 0; i < known; i++)
+		{
+			if (get_bit(f + 2, i) != get_bit(cl, i))
+			{
+				return 0;
+			}
+		}
+		memset(resp, 0, 5);
+		for (int i = known; i < 40; i++)
+		{
+			put_bit(resp, i - known, get_bit(cl, i));
+		}
+		*completes = level + 1 == tag_levels(t);
+		return 40 - known;
+	}
+
+	if (bits == 32 && f[0] == PICC_HLTA && f[1] == 0x00)
+	{
+		uint16_t crc = crc_a(f, 2);
+		if (t->state == TAG_ACTIVE && f[2] == (crc & 0xFF) && f[3] == (crc >> 8))
+		{
+			t->state = TAG_HALT;
+		}
+		else
+		{
+			tag_drop(t);
+		}
+		return 0;
+	}
+
+	tag_drop(t);
+	return 0;
+}
+
+static void count_command(struct mfrc522_model *m, const uint8_t *f, int bits)
+{
+	if (bits == 7 && (f[0] == PICC_REQA || f[0] == PICC_WUPA))
+	{
+		if (f[0] == PICC_REQA)
+		{
+			m->stats.reqa++;
+		}
+		else
+		{
+			m->stats.wupa++;
+		}
+		/* a REQA/WUPA starts a new poll cycle */
+		if (m->poll_started)
+		{
+			m->stats.polls++;
+			if (m->poll_read)
+			{
+				m->stats.tap_polls++;
+				m->stats.tap_bytes += m->poll_bytes;
+				m->stats.tap_irq += m->poll_irq;
+			}
+			else
+			{
+				m->stats.empty_polls++;
+				m->stats.empty_bytes += m->poll_bytes;
+				m->stats.empty_irq += m->poll_irq;
+			}
+		}
+		m->poll_started = 1;
+		m->poll_read = 0;
+		m->poll_bytes = 0;
+		m->poll_irq = 0;
+	}
+	else if (bits >= 16 && (f[0] == 0x93 || f[0] == 0x95 || f[0] == 0x97))
+	{
+		if (f[1] == 0x70)
+		{
+			m->stats.select++;
+		}
+		else
+		{
+			m->stats.anticoll++;
+		}
+	}
+	else if (bits >= 8 && f[0] == PICC_HLTA)
+	{
+		m->stats.hlta++;
+	}
+	else
+	{
+		m->stats.other++;
+	}
+}
+
+/***************************************************
+Commands
+***************************************************/
+static void wake_at(struct mfrc522_model *m, uint64_t when);
+
+static void timer_start(struct mfrc522_model *m, uint64_t at)
+{
+	uint32_t presc = ((m->reg[TModeReg] & 0x0F) << 8) | m->reg[TPrescalerReg];
+	uint32_t reload = (m->reg[TReloadReg_1] << 8) | m->reg[TReloadReg_2];
+	double divider = (m->reg[DemodReg] & 0x10) ? 2.0 * presc + 2 : 2.0 * presc + 1;
+
+	m->timer_on = 1;
+	m->timer_fire = at + ns_to_cycles((uint64_t)((reload + 1.0) * divider / FC_HZ * 1e9));
+	wake_at(m, m->timer_fire);
+}
+
+static void soft_reset(struct mfrc522_model *m)
+{
+	memset(m->reg, 0, sizeof(m->reg));
+	for (size_t i = 0; i < sizeof(reset_values) / sizeof(reset_values[0]); i++)
+	{
+		m->reg[reset_values[i][0]] = reset_values[i][1];
+	}
+	m->fifo_len = 0;
+	m->busy = 0;
+	m->timer_on = 0;
+	m->stats.resets++;
+	field_update(m);
+}
+
+
+static void transmit(struct mfrc522_model *m, int tx_only)
+{
+	uint8_t frame[FIFO_SIZE + 2];
+	uint8_t resp[MAX_TAGS][FIFO_SIZE];
+	int resp_bits[MAX_TAGS], completes[MAX_TAGS];
+	struct tag *responders[MAX_TAGS];
+	uint8_t last = m->reg[BitFramingReg] & 0x07;
+	uint8_t align = (m->reg[BitFramingReg] >> 4) & 0x07;
+	int len = m->fifo_len, bits, n = 0, max_bits = 0, coll = -1;
+
+	memcpy(frame, m->fifo, len);
+	m->fifo_len = 0;
+	fifo_alerts(m);
+	if ((m->reg[TxModeReg] & 0x80) && len)
+	{
+		uint16_t crc = crc_a(frame, len);
+		frame[len++] = crc & 0xFF;
+		frame[len++] = crc >> 8;
+		last = 0;
+	}
+	bits = len ? (len - 1) * 8 + (last ? last : 8) : 0;
+
+	m->busy = 1;
+	m->tx_only = tx_only;
+	m->tx_irq_done = 0;
+	m->tx_end = sim_now() + air_cycles(bits);
+	m->responded = 0;
+	m->timer_on = 0;
+	count_command(m, frame, bits);
+	wake_at(m, m->tx_end);
+	if (!m->field_on)
+	{
+		return;
+	}
+
+	for (int i = 0; i < m->n_tags; i++)
+	{
+		struct tag *t = &m->tags[i];
+		tag_power(m, t);
+		if (t->state == TAG_OFF)
+		{
+			continue;
+		}
+		resp_bits[n] = tag_receive(t, frame, bits, resp[n], &completes[n]);
+		/* after Transmit the receiver is off, answers are lost */
+		if (resp_bits[n] && !tx_only)
+		{
+			responders[n] = t;
+			if (resp_bits[n] > max_bits)
+			{
+				max_bits = resp_bits[n];
+			}
+			n++;
+		}
+	}
+	if (!n)
+	{
+		return;
+	}
+
+	/* superpose the answers; the first bit the tags disagree on is a collision */
+	memset(m->rx, 0, sizeof(m->rx));
+	for (int b = 0; b < max_bits; b++)
+	{
+		int ones = 0, zeros = 0;
+		for (int r = 0; r < n; r++)
+		{
+			if (b < resp_bits[r])
+			{
+				if (get_bit(resp[r], b))
+				{
+					ones++;
+				}
+				else
+				{
+					zeros++;
+				}
+			}
+		}
+		if (ones && zeros && coll < 0)
+		{
+			coll = b;
+		}
+		/* ValuesAfterColl = 0 clears every bit from the collision on */
+		put_bit(m->rx, align + b, ones && !(coll >= 0 && !(m->reg[CollReg] & 0x80)));
+	}
+	m->rx_len = (align + max_bits + 7) / 8;
+	m->rx_lastbits = (align + max_bits) % 8;
+	m->rx_error = 0;
+	m->rx_coll = 0x20;		/* CollPosNotValid */
+	if (coll >= 0)
+	{
+		int pos = align + coll + 1;
+		m->rx_error |= ERR_COLL;
+		m->rx_coll = pos <= 32 ? (pos & 0x1F) : 0x20;
+		m->stats.collisions++;
+	}
+	else if ((m->reg[RxModeReg] & 0x80) && m->rx_len >= 3)
+	{
+		uint16_t crc = crc_a(m->rx, m->rx_len - 2);
+		if (m->rx[m->rx_len - 2] != (crc & 0xFF) || m->rx[m->rx_len - 1] != (crc >> 8))
+		{
+			m->rx_error |= ERR_CRC;
+		}
+		m->rx_len -= 2;
+	}
+	m->responded = 1;
+	m->rx_start = m->tx_end + ns_to_cycles(FDT_NS);
+	m->rx_end = m->rx_start + air_cycles(max_bits);
+	wake_at(m, m->rx_end);
+	for (int r = 0; r < n && coll < 0; r++)
+	{
+		if (completes[r])
+		{
+			tag_mark_read(m, responders[r]);
+		}
+	}
+}
+
+static void calc_crc(struct mfrc522_model *m)
+{
+	uint16_t crc = crc_a(m->fifo, m->fifo_len);
+
+	m->stats.crc++;
+	m->fifo_len = 0;
+	fifo_alerts(m);
+	m->reg[CRCResultReg_1] = crc >> 8;
+	m->reg[CRCResultReg_2] = crc & 0xFF;
+	m->reg[DivIrqReg] |= DIVIRQ_CRC;
+}
+
+/* bring the chip up to the current time */
+static void update(struct mfrc522_model *m)
+{
+	uint64_t now = sim_now();
+
+	if (m->busy && !m->tx_irq_done && now >= m->tx_end)
+	{
+		m->tx_irq_done = 1;
+		m->reg[ComIrqReg] |= IRQ_TX;
+		if (m->reg[TModeReg] & 0x80)
+		{
+			timer_start(m, m->tx_end);
+		}
+		if (m->tx_only)
+		{
+			/* Transmit terminates by itself */
+			m->busy = 0;
+			m->reg[CommandReg] &= ~0x0F;
+			m->reg[ComIrqReg] |= IRQ_IDLE;
+		}
+	}
+	/* the timer stops when the receiver sees the first bits of an answer */
+	if (m->timer_on && m->busy && m->responded && m->rx_start < m->timer_fire && now >= m->rx_start)
+	{
+		m->timer_on = 0;
+	}
+	if (m->timer_on && now >= m->timer_fire)
+	{
+		m->timer_on = 0;
+		m->reg[ComIrqReg] |= IRQ_TIMER;
+	}
+	if (m->busy && m->responded && now >= m->rx_end)
+	{
+		m->busy = 0;
+		for (int i = 0; i < m->rx_len; i++)
+		{
+			fifo_push(m, m->rx[i]);
+		}
+		m->reg[ControlReg] = (m->reg[ControlReg] & ~0x07) | m->rx_lastbits;
+		m->reg[ErrorReg] = (m->reg[ErrorReg] & ERR_BUFFEROVFL) | m->rx_error;
+		m->reg[CollReg] = (m->reg[CollReg] & 0x80) | m->rx_coll;
+		m->reg[ComIrqReg] |= IRQ_RX | (m->rx_error ? IRQ_ERR : 0);
+	}
+}
+
+/*
+ * IRQ pin, datasheet 9.3.1.3: Status1Reg IRq, inverted by ComIEnReg IRqInv, open drain unless DivIEnReg IRQPushPull.
+ * The readers wired to the same pin make a wired-AND: it is low while any of them pulls it low.
+ */
+static void irq_pin(struct mfrc522_model *m)
+{
+	int irq = (m->reg[ComIrqReg] & m->reg[ComIEnReg] & 0x7F) || (m->reg[DivIrqReg] & m->reg[DivIEnReg] & 0x14);
+	int level = (m->reg[ComIEnReg] & 0x80) ? !irq : irq;
+	int low = 0, high = 0;
+
+	if (!m->irq_wired || level == m->irq_level)
+	{
+		return;
+	}
+	m->irq_level = level;
+	for (int i = 0; i < n_models; i++)
+	{
+		struct mfrc522_model *o = &models[i];
+
+		if (!o->irq_wired || o->irq_port != m->irq_port || o->irq_bit != m->irq_bit || o->irq_level < 0)
+		{
+			continue;
+		}
+		if (!o->irq_level)
+		{
+			low = 1;
+		}
+		else if (o->reg[DivIEnReg] & 0x80)
+		{
+			high = 1;
+		}
+	}
+	if (low)
+	{
+		sim_pin_drive(m->irq_port, m->irq_bit, 0);
+	}
+	else if (high)
+	{
+		sim_pin_drive(m->irq_port, m->irq_bit, 1);
+	}
+	else
+	{
+		sim_pin_release(m->irq_port, m->irq_bit);
+	}
+}
+
+static void wake(void *arg)
+{
+	struct mfrc522_model *m = arg;
+
+	update(m);
+	irq_pin(m);
+}
+
+/* with the IRQ line wired the chip has to act on its own at `when`, not only on the next SPI access */
+static void wake_at(struct mfrc522_model *m, uint64_t when)
+{
+	if (m->irq_wired)
+	{
+		sim_at(when, wake, m);
+	}
+}
+
+/***************************************************
+Registers
+***************************************************/
+static uint8_t reg_read(struct mfrc522_model *m, uint8_t a)
+{
+	switch (a)
+	{
+		case FIFODataReg:
+			return fifo_pop(m);
+		case FIFOLevelReg:
+			return m->fifo_len;
+		case CommandReg:
+			return m->reg[a] | (sim_now() < m->osc_ready ? 0x10 : 0);
+		case ComIrqReg:
+			m->stats.irq_reads++;
+			m->poll_irq++;
+			return m->reg[a] & 0x7F;
+		case Status1Reg:
+		{
+			int irq = (m->reg[ComIrqReg] & m->reg[ComIEnReg] & 0x7F) || (m->reg[DivIrqReg] & m->reg[DivIEnReg] & 0x14);
+			return (m->reg[DivIrqReg] & DIVIRQ_CRC ? 0x20 : 0) | (irq ? 0x10 : 0) | (m->timer_on ? 0x08 : 0) | 0x01;
+		}
+		default:
+			return m->reg[a];
+	}
+}
+
+static void reg_write(struct mfrc522_model *m, uint8_t a, uint8_t v)
+{
+	switch (a)
+	{
+		case CommandReg:
+			if ((v & 0x0F) == SoftReset_CMD)
+			{
+				soft_reset(m);
+				return;
+			}
+			if ((m->reg[a] & 0x10) && !(v & 0x10))
+			{
+				m->osc_ready = sim_now() + SIM_US(OSC_START_US);
+			}
+			m->reg[a] = v & 0x3F;
+			m->busy = 0;
+			if ((v & 0x0F) == Transmit_CMD)
+			{
+				transmit(m, 1);
+			}
+			else if ((v & 0x0F) == CalcCRC_CMD)
+			{
+				calc_crc(m);
+			}
+			field_update(m);
+			break;
+		case ComIrqReg:
+		case DivIrqReg:
+			if (v & 0x80)
+			{
+				m->reg[a] |= v & 0x7F;
+			}
+			else
+			{
+				m->reg[a] &= ~v;
+			}
+			break;
+		case FIFODataReg:
+			fifo_push(m, v);
+			break;
+		case FIFOLevelReg:
+			if (v & 0x80)
+			{
+				m->fifo_len = 0;
+				m->reg[ErrorReg] &= ~ERR_BUFFEROVFL;
+				fifo_alerts(m);
+			}
+			break;
+		case BitFramingReg:
+			m->reg[a] = v;
+			if ((v & 0x80) && (m->reg[CommandReg] & 0x0F) == Transceive_CMD && !m->busy)
+			{
+				transmit(m, 0);
+			}
+			break;
+		case ControlReg:
+			if (v & 0x80)
+			{
+				m->timer_on = 0;
+			}
+			if (v & 0x40)
+			{
+				timer_start(m, sim_now());
+			}
+			break;
+		case TxControlReg:
+			m->reg[a] = v;
+			field_update(m);
+			break;
+		case ErrorReg:
+		case Status1Reg:
+		case Status2Reg:
+		case VersionReg:
+			break;
+		default:
+			m->reg[a] = v;
+			break;
+	}
+}
+
+/***************************************************
+SPI slave
+***************************************************/
+static void select_chip(void *ctx)
+{
+	struct mfrc522_model *m = ctx;
+
+	m->first = 1;
+	m->stats.spi_frames++;
+}
+
+static uint8_t transfer(void *ctx, uint8_t mosi)
+{
+	struct mfrc522_model *m = ctx;
+	uint8_t miso = 0;
+
+	m->stats.spi_bytes++;
+	m->poll_bytes++;
+	update(m);
+	if (m->first)
+	{
+		m->first = 0;
+		m->reading = mosi & 0x80;
+		m->addr = (mosi >> 1) & 0x3F;
+	}
+	else if (m->reading)
+	{
+		miso = reg_read(m, m->addr);
+		m->addr = (mosi >> 1) & 0x3F;
+	}
+	else
+	{
+		reg_write(m, m->addr, mosi);
+	}
+	irq_pin(m);
+	return miso;
+}
+
+/***************************************************
+Scenario and report
+***************************************************/
+static void tag_enter(void *arg)
+{
+	struct tag *t = arg;
+
+	if (sim_trace)
+	{
+		sim_log("tag %s enters the field", uid_hex(t));
+	}
+}
+
+static void tag_leave(void *arg)
+{
+	struct tag *t = arg;
+
+	if (sim_trace)
+	{
+		sim_log("tag %s leaves the field", uid_hex(t));
+	}
+}
+
+void mfrc522_model_add_tag(struct mfrc522_model *m, const uint8_t *uid, uint8_t uid_len, uint8_t sak,
+	uint64_t enter, uint64_t leave)
+{
+	struct tag *t;
+
+	if (m->n_tags == MAX_TAGS)
+	{
+		fprintf(stderr, "too many tags\n");
+		exit(2);
+	}
+	t = &m->tags[m->n_tags++];
+	memset(t, 0, sizeof(*t));
+	memcpy(t->uid, uid, uid_len);
+	t->uid_len = uid_len;
+	t->sak = sak;
+	t->enter = enter;
+	t->leave = leave;
+	sim_at(enter, tag_enter, t);
+	sim_at(leave, tag_leave, t);
+}
+
+static void brownout(void *arg)
+{
+	struct mfrc522_model *m = arg;
+
+	if (sim_trace)
+	{
+		sim_log("reader brown-out");
+	}
+	update(m);
+	soft_reset(m);
+	m->stats.resets--;
+	m->stats.brownouts++;
+	irq_pin(m);
+}
+
+void mfrc522_model_brownout(struct mfrc522_model *m, uint64_t when)
+{
+	sim_at(when, brownout, m);
+}
+
+int mfrc522_model_tag_option(struct mfrc522_model *m, const char *value)
+{
+	unsigned long long enter, duration;
+	unsigned sak = 0x100;
+	char hex[32];
+	uint8_t uid[10];
+	int len;
+
+	if (sscanf(value, "%llu:%llu:%31[0-9A-Fa-f]:%x", &enter, &duration, hex, &sak) < 3)
+	{
+		return -1;
+	}
+	len = strlen(hex) / 2;
+	if (strlen(hex) % 2 || (len != 4 && len != 7 && len != 10))
+	{
+		return -1;
+	}
+	for (int i = 0; i < len; i++)
+	{
+		sscanf(hex + 2 * i, "%2hhx", &uid[i]);
+	}
+	if (sak > 0xFF)
+	{
+		sak = len == 4 ? 0x08 : 0x00;	/* MIFARE Classic 1K, Ultralight */
+	}
+	mfrc522_model_add_tag(m, uid, len, sak, SIM_MS(enter), SIM_MS(enter + duration));
+	return 0;
+}
+
+static double per(uint64_t a, uint64_t b)
+{
+	return b ? (double)a / b : 0.0;
+}
+
+static void report(FILE *out, void *ctx)
+{
+	struct mfrc522_model *m = ctx;
+	double secs = (double)sim_now() / F_CPU;
+	uint64_t read = 0, rereads = 0, lat_sum = 0, lat_max = 0, first_enter = UINT64_MAX, last_read = 0;
+	uint64_t now = sim_now();
+
+	fprintf(out, "mfrc522 (SS P%c%d)\n", 'A' + m->ss_port, m->ss_bit);
+	fprintf(out, "  %-22s %12llu in %llu frames\n", "spi bytes", (unsigned long long)m->stats.spi_bytes,
+		(unsigned long long)m->stats.spi_frames);
+	fprintf(out, "  %-22s %12llu\n", "ComIrqReg reads", (unsigned long long)m->stats.irq_reads);
+	fprintf(out, "  %-22s %12llu (and %llu brown-outs)\n", "soft resets", (unsigned long long)m->stats.resets,
+		(unsigned long long)m->stats.brownouts);
+	fprintf(out, "  %-22s REQA %llu, WUPA %llu, ANTICOLL %llu, SELECT %llu, HLTA %llu, other %llu, CalcCRC %llu\n",
+		"commands", (unsigned long long)m->stats.reqa, (unsigned long long)m->stats.wupa,
+		(unsigned long long)m->stats.anticoll, (unsigned long long)m->stats.select,
+		(unsigned long long)m->stats.hlta, (unsigned long long)m->stats.other, (unsigned long long)m->stats.crc);
+	fprintf(out, "  %-22s %12llu\n", "collisions", (unsigned long long)m->stats.collisions);
+	fprintf(out, "  %-22s %12llu (%.2f per second)\n", "polls", (unsigned long long)m->stats.polls,
+		secs > 0 ? m->stats.polls / secs : 0.0);
+	fprintf(out, "  %-22s %12.1f bytes over %llu polls, %.1f ComIrqReg reads each\n", "spi per empty poll",
+		per(m->stats.empty_bytes, m->stats.empty_polls), (unsigned long long)m->stats.empty_polls,
+		per(m->stats.empty_irq, m->stats.empty_polls));
+	fprintf(out, "  %-22s %12.1f bytes over %llu polls, %.1f ComIrqReg reads each\n", "spi per tap poll",
+		per(m->stats.tap_bytes, m->stats.tap_polls), (unsigned long long)m->stats.tap_polls,
+		per(m->stats.tap_irq, m->stats.tap_polls));
+	power_update(m);
+	fprintf(out, "  %-22s %12.3f mA avg (%.1f%% power-down, %.1f%% field off, %.1f%% field on)\n", "supply",
+		now ? (SUPPLY_DOWN_MA * m->power_cycles[POWER_DOWN] + SUPPLY_ON_MA * m->power_cycles[POWER_ON] +
+			(SUPPLY_ON_MA + SUPPLY_FIELD_MA) * m->power_cycles[POWER_FIELD]) / now : 0.0,
+		100.0 * per(m->power_cycles[POWER_DOWN], now), 100.0 * per(m->power_cycles[POWER_ON], now),
+		100.0 * per(m->power_cycles[POWER_FIELD], now));
+
+	for (int i = 0; i < m->n_tags; i++)
+	{
+		struct tag *t = &m->tags[i];
+		if (t->read_at)
+		{
+			uint64_t lat = t->read_at - t->enter;
+			read++;
+			rereads += t->reads - 1;
+			lat_sum += lat;
+			if (lat > lat_max)
+			{
+				lat_max = lat;
+			}
+			if (t->read_at > last_read)
+			{
+				last_read = t->read_at;
+			}
+		}
+		if (t->enter < first_enter)
+		{
+			first_enter = t->enter;
+		}
+	}
+	if (m->n_tags)
+	{
+		fprintf(out, "tags\n");
+		fprintf(out, "  %-22s %12d (%llu read, %llu never read)\n", "presented", m->n_tags,
+			(unsigned long long)read, (unsigned long long)(m->n_tags - read));
+		fprintf(out, "  %-22s %12.1f ms avg, %.1f ms worst\n", "tap latency",
+			per(lat_sum, read) * 1000.0 / F_CPU, (double)lat_max * 1000.0 / F_CPU);
+		fprintf(out, "  %-22s %12llu\n", "repeat reads", (unsigned long long)rereads);
+		fprintf(out, "  %-22s %12.2f per second from the first tag in to the last read\n", "read rate",
+			last_read > first_enter ? read * (double)F_CPU / (last_read - first_enter) : 0.0);
+	}
+}
+
+struct mfrc522_model *mfrc522_model_attach(uint8_t port, uint8_t bit)
+{
+	struct mfrc522_model *m;
+	struct sim_spi_slave slave = { "mfrc522", select_chip, transfer, NULL, NULL };
+
+	if (n_models == MAX_READERS)
+	{
+		fprintf(stderr, "too many readers\n");
+		exit(2);
+	}
+	m = &models[n_models++];
+	slave.ctx = m;
+	memset(m, 0, sizeof(*m));
+	m->ss_port = port;
+	m->ss_bit = bit;
+	soft_reset(m);
+	m->stats.resets = 0;
+	sim_spi_attach(port, bit, &slave);
+	sim_add_report(report, m);
+	return m;
+}
+
+void mfrc522_model_irq(struct mfrc522_model *m, uint8_t port, uint8_t bit)
+{
+	m->irq_wired = 1;
+	m->irq_port = port;
+	m->irq_bit = bit;
+	m->irq_level = -1;
+	irq_pin(m);
+}
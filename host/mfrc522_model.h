@@ -0,0 +1,31 @@
+/*
+ * mfrc522_model.h
+ * Behavioral model of the RFID-RC522 reader on the simulated SPI bus.
+ */
+#ifndef MFRC522_MODEL_H
+#define MFRC522_MODEL_H
+
+#include <stdint.h>
+
+struct mfrc522_model;
+
+/* attach a reader whose SS line is bit `bit` of PORT<port> (0 = A ... 3 = D) */
+struct mfrc522_model *mfrc522_model_attach(uint8_t port, uint8_t bit);
+
+/* wire the IRQ output of the reader to bit `bit` of port `port` */
+void mfrc522_model_irq(struct mfrc522_model *m, uint8_t port, uint8_t bit);
+
+/*
+ * A virtual tag enters the RF field at `enter` and leaves it at `leave` (cycles).
+ * uid_len is 4, 7 or 10 bytes, sak is the SAK of the completed UID.
+ */
+void mfrc522_model_add_tag(struct mfrc522_model *m, const uint8_t *uid, uint8_t uid_len, uint8_t sak,
+	uint64_t enter, uint64_t leave);
+
+/* the reader loses its supply at `when` and comes back with its reset values */
+void mfrc522_model_brownout(struct mfrc522_model *m, uint64_t when);
+
+/* parse "ENTER_MS:DURATION_MS:UIDHEX[:SAK]" into a tag */
+int mfrc522_model_tag_option(struct mfrc522_model *m, const char *value);
+
+#endif /* MFRC522_MODEL_H */
@@ -0,0 +1,218 @@
+/*
+ * roster_bench.c
+ * Cost of looking a tag up in a roster of 10, 100 and 1000 students:
+ * the linear 5 byte compare over person_byte[] of the first firmware, a
+ * binary search of the sorted 32 bit keys and the minimal perfect hash of
+ * roster_lookup().
+ *
+ * The flash reads are charged by the pgmspace shim. The instructions around
+ * them are not simulated, they are estimated per step from what avr-gcc -Os
+ * makes of the two loops (ATmega32: LD/LDD/LPM 2-3 cycles, ALU 1, taken branch 2).
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include "sim.h"
+#include "roster_mph.h"
+#include "../roster.h"
+
+/* mid, address of uids[mid], 4 x CP/CPC and the branches, update of low/high */
+#define PROBE_CYCLES		20
+/* LDD tag byte, LD person byte, CP, BRNE, byte++ and the loop compare */
+#define LINEAR_BYTE_CYCLES	10
+/* row pointer, byte = 0, size check and i++ of the outer loop */
+#define LINEAR_ROW_CYCLES	8
+/* roster_hash(): two 32 x 32 bit multiplies (__mulsi3 with MUL), the xorshift by whole bytes */
+#define HASH_CYCLES			75
+/* ROSTER_RANGE(): 16 x 16 bit MUL, the top word of the product */
+#define RANGE_CYCLES		10
+/* key compare, the branch and the return */
+#define PROBE_CHECK_CYCLES	8
+
+#define ROUNDS	1000
+
+static uint64_t cycles;
+static uint64_t probes;
+
+/* only the cycle counter of the simulator is needed here */
+uint64_t sim_now(void)
+{
+	return cycles;
+}
+
+void sim_advance(uint64_t n)
+{
+	cycles += n;
+}
+
+static int cmp_key(const void *a, const void *b)
+{
+	uint32_t x = *(const uint32_t *)a, y = *(const uint32_t *)b;
+	return x < y ? -1 : x > y;
+}
+
+/* the loop main.c ran for every card before the roster, with its cost */
+static int linear_lookup(uint8_t (*person_byte)[5], int n, const struct mfrc522_uid *uid)
+{
+	for (int i = 0; i < n; i++)
+	{
+		uint8_t byte;
+
+		cycles += LINEAR_ROW_CYCLES;
+		for (byte = 0; byte < 4; byte++)
+		{
+			cycles += LINEAR_BYTE_CYCLES;
+			if (uid->bytes[byte] != person_byte[i][byte])
+			{
+				break;
+			}
+		}
+		if (byte == 4 && uid->size == 4)
+		{
+			return i;
+		}
+	}
+	return ROSTER_NONE;
+}
+
+/* binary search of the sorted key table in flash, position of uid or ROSTER_NONE */
+static int16_t roster_search(const uint32_t *uids, uint16_t size, uint32_t uid)
+{
+	uint16_t low = 0, high = size;
+
+	while (low < high)
+	{
+		uint16_t mid = (low + high) >> 1;
+		uint32_t key = pgm_read_dword(&uids[mid]);
+
+		if (key == uid)
+		{
+			return mid;
+		}
+		if (key < uid)
+		{
+			low = mid + 1;
+		}
+		else
+		{
+			high = mid;
+		}
+	}
+	return ROSTER_NONE;
+}
+
+/* roster_search() with every probe charged, the LPM reads charge themselves */
+static int16_t sorted_lookup(const uint32_t *uids, uint16_t n, const struct mfrc522_uid *uid)
+{
+	uint32_t key = ROSTER_UID(uid->bytes[0], uid->bytes[1], uid->bytes[2], uid->bytes[3]);
+	uint64_t start = cycles;
+	int16_t pos = roster_search(uids, n, key);
+
+	/* 12 LPM cycles per probe */
+	probes += (cycles - start) / 12;
+	cycles += (cycles - start) / 12 * PROBE_CYCLES;
+	return pos;
+}
+
+/* roster_slot() and roster_lookup() over tables built at run time */
+static int16_t hashed_lookup(const uint16_t *seeds, const uint32_t *slots, uint16_t n, const struct mfrc522_uid *uid)
+{
+	uint32_t key = ROSTER_UID(uid->bytes[0], uid->bytes[1], uid->bytes[2], uid->bytes[3]);
+	uint16_t bucket = ROSTER_RANGE(roster_hash(key, 0), ROSTER_MPH_BUCKETS(n));
+	uint16_t slot = ROSTER_RANGE(roster_hash(key, pgm_read_word(&seeds[bucket])), n);
+
+	cycles += 2 * (HASH_CYCLES + RANGE_CYCLES) + PROBE_CHECK_CYCLES;
+	return pgm_read_dword(&slots[slot]) == key ? slot : ROSTER_NONE;
+}
+
+static void bench(int n)
+{
+	uint8_t (*person_byte)[5] = malloc(n * sizeof(*person_byte));
+	uint32_t *uids = malloc(n * sizeof(*uids));
+	uint32_t *slots = malloc(n * sizeof(*slots));
+	uint16_t *seeds = malloc(ROSTER_MPH_BUCKETS(n) * sizeof(*seeds));
+	uint16_t *slot = malloc(n * sizeof(*slot));
+	struct mfrc522_uid uid = { .size = 4 };
+	uint64_t lin[2] = { 0, 0 }, idx[2] = { 0, 0 }, idx_probes[2] = { 0, 0 }, mph[2] = { 0, 0 };
+
+	srand(n);
+	for (int i = 0; i < n; i++)
+	{
+		for (int b = 0; b < 4; b++)
+		{
+			person_byte[i][b] = rand();
+		}
+		person_byte[i][4] = person_byte[i][0] ^ person_byte[i][1] ^ person_byte[i][2] ^ person_byte[i][3];
+		uids[i] = ROSTER_UID(person_byte[i][0], person_byte[i][1], person_byte[i][2], person_byte[i][3]);
+	}
+	if (roster_mph_build(uids, n, seeds, slot) < 0)
+	{
+		fprintf(stderr, "roster_bench: no perfect hash for %d keys\n", n);
+		exit(1);
+	}
+	for (int i = 0; i < n; i++)
+	{
+		slots[slot[i]] = uids[i];
+	}
+	qsort(uids, n, sizeof(*uids), cmp_key);
+
+	/* [0]: a student picked at random, [1]: a tag that is not in the roster */
+	for (int miss = 0; miss < 2; miss++)
+	{
+		for (int r = 0; r < ROUNDS; r++)
+		{
+			if (miss)
+			{
+				for (int b = 0; b < 4; b++)
+				{
+					uid.bytes[b] = rand();
+				}
+			}
+			else
+			{
+				memcpy(uid.bytes, person_byte[rand() % n], 4);
+			}
+
+			uint64_t start = cycles;
+			int expect = linear_lookup(person_byte, n, &uid);
+			lin[miss] += cycles - start;
+
+			start = cycles;
+			probes = 0;
+			int16_t pos = sorted_lookup(uids, n, &uid);
+			idx[miss] += cycles - start;
+			idx_probes[miss] += probes;
+
+			start = cycles;
+			int16_t hpos = hashed_lookup(seeds, slots, n, &uid);
+			mph[miss] += cycles - start;
+
+			if ((expect == ROSTER_NONE) != (pos == ROSTER_NONE) || (expect == ROSTER_NONE) != (hpos == ROSTER_NONE))
+			{
+				fprintf(stderr, "roster_bench: lookups disagree\n");
+				exit(1);
+			}
+		}
+	}
+	printf("%6d  %8.1f %8.1f %8.1f  %8.1f %8.1f %8.1f  %6.1f %6.1f\n", n,
+		(double)lin[0] / ROUNDS, (double)idx[0] / ROUNDS, (double)mph[0] / ROUNDS,
+		(double)lin[1] / ROUNDS, (double)idx[1] / ROUNDS, (double)mph[1] / ROUNDS,
+		(double)idx_probes[0] / ROUNDS, (double)idx_probes[1] / ROUNDS);
+	free(person_byte);
+	free(uids);
+	free(slots);
+	free(seeds);
+	free(slot);
+}
+
+int main(void)
+{
+	printf("cycles per lookup at 1 MHz (= us), %d lookups each\n", ROUNDS);
+	printf("%6s  %8s %8s %8s  %8s %8s %8s  %13s\n", "", "hit", "", "", "miss", "", "", "sorted probes");
+	printf("%6s  %8s %8s %8s  %8s %8s %8s  %6s %6s\n", "size", "linear", "sorted", "hashed",
+		"linear", "sorted", "hashed", "hit", "miss");
+	bench(10);
+	bench(100);
+	bench(1000);
+	return 0;
+}
@@ -0,0 +1,292 @@
+/*
+ * roster_gen.c
+ * Roster compiler: reads the roster CSV (uid,name per line) and writes
+ * roster_table.h, the minimal perfect hash of the UIDs and the name pool
+ * in flash, to stdout. A UID is 4, 7 or 10 bytes; the size and the bytes
+ * after the fourth are only written when the roster has a longer one.
+ *
+ *   roster_gen ../roster.csv > ../roster_table.h
+ */
+
+#include <ctype.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "roster_mph.h"
+#include "../roster_hash.h"
+
+/* one line of the LCD */
+#define NAME_MAX_CHARS	16
+#define ROSTER_MAX		4096
+/* a triple size UID */
+#define UID_MAX			10
+
+struct student
+{
+	uint8_t uid[UID_MAX];
+	uint8_t size;
+	uint32_t key;
+	char name[NAME_MAX_CHARS + 1];
+};
+
+static struct student roster[ROSTER_MAX];
+static uint16_t count;
+
+static void fail(const char *path, int line, const char *msg)
+{
+	fprintf(stderr, "%s:%d: %s\n", path, line, msg);
+	exit(1);
+}
+
+static char *trim(char *s)
+{
+	char *end;
+
+	while (isspace((unsigned char)*s))
+	{
+		s++;
+	}
+	end = s + strlen(s);
+	while (end > s && isspace((unsigned char)end[-1]))
+	{
+		*--end = 0;
+	}
+	return s;
+}
+
+/* returns the size of the UID, 4, 7 or 10 bytes, or -1 */
+static int parse_uid(const char *s, uint8_t *uid)
+{
+	int digits = 0;
+
+	for (; *s; s++)
+	{
+		if (*s == ' ' || *s == ':')
+		{
+			continue;
+		}
+		if (!isxdigit((unsigned char)*s) || digits == 2 * UID_MAX)
+		{
+			return -1;
+		}
+		uid[digits / 2] = (uid[digits / 2] << 4) | (isdigit((unsigned char)*s) ? *s - '0' : (toupper(*s) - 'A' + 10));
+		digits++;
+	}
+	return digits == 8 || digits == 14 || digits == 20 ? digits / 2 : -1;
+}
+
+static void read_csv(const char *path)
+{
+	char buf[256];
+	int line = 0;
+	FILE *f = fopen(path, "r");
+
+	if (!f)
+	{
+		perror(path);
+		exit(1);
+	}
+	while (fgets(buf, sizeof(buf), f))
+	{
+		char *uid, *name, *comma;
+		struct student *st;
+		int size;
+
+		line++;
+		uid = trim(buf);
+		if (!*uid || *uid == '#')
+		{
+			continue;
+		}
+		comma = strchr(uid, ',');
+		if (!comma)
+		{
+			fail(path, line, "expected uid,name");
+		}
+		*comma = 0;
+		uid = trim(uid);
+		name = trim(comma + 1);
+		if (!strcasecmp(uid, "uid") && !strcasecmp(name, "name"))
+		{
+			continue;
+		}
+		if (count == ROSTER_MAX)
+		{
+			fail(path, line, "too many students");
+		}
+		st = &roster[count];
+		size = parse_uid(uid, st->uid);
+		if (size < 0)
+		{
+			fail(path, line, "the UID must be 4, 7 or 10 bytes in hex");
+		}
+		st->size = size;
+		if (!*name || strlen(name) > NAME_MAX_CHARS)
+		{
+			fail(path, line, "the name must be 1 to 16 characters");
+		}
+		for (const char *c = name; *c; c++)
+		{
+			if (!isprint((unsigned char)*c) || *c == '"' || *c == '\\' || *c == ',')
+			{
+				fail(path, line, "the name has a character the LCD cannot show");
+			}
+		}
+		strcpy(st->name, name);
+		st->key = roster_key(st->uid, st->size);
+		for (uint16_t i = 0; i < count; i++)
+		{
+			if (roster[i].size == st->size && !memcmp(roster[i].uid, st->uid, st->size))
+			{
+				fail(path, line, "the UID is already in the roster");
+			}
+			/* the perfect hash needs distinct keys */
+			if (roster[i].key == st->key)
+			{
+				fail(path, line, "the UID has the same key as one before it, enroll another tag");
+			}
+		}
+		count++;
+	}
+	fclose(f);
+	if (count == 0)
+	{
+		fail(path, line, "no students");
+	}
+}
+
+int main(int argc, char **argv)
+{
+	uint32_t keys[ROSTER_MAX];
+	uint16_t seeds[ROSTER_MPH_BUCKETS(ROSTER_MAX)];
+	uint16_t slot[ROSTER_MAX];
+	uint16_t student_at[ROSTER_MAX];
+	uint16_t buckets, offset, name_len = 0, uid_max = 4;
+
+	if (argc != 2)
+	{
+		fprintf(stderr, "usage: %s ROSTER.CSV > roster_table.h\n", argv[0]);
+		return 2;
+	}
+	read_csv(argv[1]);
+	for (uint16_t i = 0; i < count; i++)
+	{
+		keys[i] = roster[i].key;
+		if (strlen(roster[i].name) + 1 > name_len)
+		{
+			name_len = strlen(roster[i].name) + 1;
+		}
+		if (roster[i].size > uid_max)
+		{
+			uid_max = roster[i].size;
+		}
+	}
+	if (roster_mph_build(keys, count, seeds, slot) < 0)
+	{
+		fprintf(stderr, "%s: no perfect hash found for this roster\n", argv[1]);
+		return 1;
+	}
+	buckets = ROSTER_MPH_BUCKETS(count);
+	for (uint16_t i = 0; i < count; i++)
+	{
+		student_at[slot[i]] = i;
+	}
+
+	printf("/*\n"
+		" * roster_table.h\n"
+		" * Generated by host/roster_gen from %s, do not edit.\n"
+		" * Minimal perfect hash of the UIDs of the students (see roster_hash.h)\n"
+		" * and their names.\n"
+		" */\n"
+		"#ifndef ROSTER_TABLE_H\n"
+		"#define ROSTER_TABLE_H\n"
+		"\n"
+		"#define ROSTER_SIZE\t\t%u\n"
+		"#define ROSTER_BUCKETS\t%u\n"
+		"//longest name with its terminating 0\n"
+		"#define ROSTER_NAME_LEN\t%u\n"
+		"//longest UID in bytes\n"
+		"#define ROSTER_UID_MAX\t%u\n"
+		"\n", strrchr(argv[1], '/') ? strrchr(argv[1], '/') + 1 : argv[1], count, buckets, name_len, uid_max);
+
+	printf("//seed of the slot hash of every bucket\n"
+		"const uint16_t roster_seed[ROSTER_BUCKETS] PROGMEM = {");
+	for (uint16_t b = 0; b < buckets; b++)
+	{
+		printf("%s%s%u", b ? "," : "", b % 12 ? " " : "\n\t", seeds[b]);
+	}
+	printf("\n};\n\n");
+
+	printf("//key of the student in every slot\n"
+		"const uint32_t roster_uid[ROSTER_SIZE] PROGMEM = {\n");
+	for (uint16_t s = 0; s < count; s++)
+	{
+		const struct student *st = &roster[student_at[s]];
+
+		if (st->size == 4)
+		{
+			printf("\tROSTER_UID(0x%02X, 0x%02X, 0x%02X, 0x%02X)%s\t\t//%s\n",
+				st->uid[0], st->uid[1], st->uid[2], st->uid[3], s + 1 < count ? "," : "", st->name);
+		}
+		else
+		{
+			printf("\t0x%08lXUL%s\t\t\t\t\t\t\t//%s, roster_key() of its %u bytes\n", (unsigned long)st->key,
+				s + 1 < count ? "," : "", st->name, st->size);
+		}
+	}
+	printf("};\n\n");
+
+	if (uid_max > 4)
+	{
+		printf("//size of the UID in every slot\n"
+			"const uint8_t roster_uid_size[ROSTER_SIZE] PROGMEM = {");
+		for (uint16_t s = 0; s < count; s++)
+		{
+			printf("%s%s%u", s ? "," : "", s % 12 ? " " : "\n\t", roster[student_at[s]].size);
+		}
+		printf("\n};\n\n");
+
+		printf("//the UID bytes after the fourth in every slot\n"
+			"const uint8_t roster_uid_rest[ROSTER_SIZE][ROSTER_UID_MAX - 4] PROGMEM = {\n");
+		for (uint16_t s = 0; s < count; s++)
+		{
+			const struct student *st = &roster[student_at[s]];
+
+			printf("\t{");
+			for (uint16_t b = 4; b < uid_max; b++)
+			{
+				printf("%s0x%02X", b > 4 ? ", " : "", b < st->size ? st->uid[b] : 0);
+			}
+			printf("}%s\n", s + 1 < count ? "," : "");
+		}
+		printf("};\n\n");
+	}
+
+	printf("//student of every slot, the row of the student in the roster\n"
+		"const uint16_t roster_person[ROSTER_SIZE] PROGMEM = {");
+	for (uint16_t s = 0; s < count; s++)
+	{
+		printf("%s%s%u", s ? "," : "", s % 12 ? " " : "\n\t", student_at[s]);
+	}
+	printf("\n};\n\n");
+
+	printf("//names of the students one after the other, each 0 terminated\n"
+		"const char roster_names[] PROGMEM =\n");
+	for (uint16_t i = 0; i < count; i++)
+	{
+		printf("\t\"%s%s\n", roster[i].name, i + 1 < count ? "\\0\"" : "\";");
+	}
+	printf("\n");
+
+	printf("//where the name of every student starts in roster_names\n"
+		"const uint16_t roster_name_at[ROSTER_SIZE] PROGMEM = {");
+	offset = 0;
+	for (uint16_t i = 0; i < count; i++)
+	{
+		printf("%s%s%u", i ? "," : "", i % 12 ? " " : "\n\t", offset);
+		offset += strlen(roster[i].name) + 1;
+	}
+	printf("\n};\n\n"
+		"#endif /* ROSTER_TABLE_H */\n");
+	return 0;
+}
@@ -0,0 +1,97 @@
+/*
+ * roster_mph.c
+ * Hash and displace: the buckets are placed largest first, every bucket
+ * tries seeds until all of its keys land on free slots.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include "roster_mph.h"
+#include "../roster_hash.h"
+
+static uint16_t *sort_bucket;
+static uint16_t *sort_size;
+
+/* by bucket size, largest first, the keys of a bucket next to each other */
+static int by_bucket(const void *a, const void *b)
+{
+	uint16_t x = *(const uint16_t *)a, y = *(const uint16_t *)b;
+	uint16_t bx = sort_bucket[x], by = sort_bucket[y];
+
+	if (sort_size[bx] != sort_size[by])
+	{
+		return sort_size[bx] > sort_size[by] ? -1 : 1;
+	}
+	if (bx != by)
+	{
+		return bx < by ? -1 : 1;
+	}
+	return x < y ? -1 : x > y;
+}
+
+int roster_mph_build(const uint32_t *keys, uint16_t n, uint16_t *seeds, uint16_t *slot)
+{
+	uint16_t buckets = ROSTER_MPH_BUCKETS(n);
+	uint16_t *bucket = malloc(n * sizeof(*bucket));
+	uint16_t *order = malloc(n * sizeof(*order));
+	uint16_t *size = calloc(buckets, sizeof(*size));
+	uint8_t *taken = calloc(n, 1);
+	int ret = 0;
+
+	for (uint16_t i = 0; i < n; i++)
+	{
+		bucket[i] = ROSTER_RANGE(roster_hash(keys[i], 0), buckets);
+		size[bucket[i]]++;
+		order[i] = i;
+	}
+	sort_bucket = bucket;
+	sort_size = size;
+	qsort(order, n, sizeof(*order), by_bucket);
+	memset(seeds, 0, buckets * sizeof(*seeds));
+
+	for (uint16_t first = 0; first < n && ret == 0; )
+	{
+		uint16_t b = bucket[order[first]];
+		uint16_t count = size[b];
+		uint32_t seed;
+
+		/* seed 0 is the bucket hash itself, start at 1 */
+		for (seed = 1; seed <= 0xFFFF; seed++)
+		{
+			uint16_t k;
+
+			for (k = 0; k < count; k++)
+			{
+				uint16_t key = order[first + k];
+
+				slot[key] = ROSTER_RANGE(roster_hash(keys[key], seed), n);
+				if (taken[slot[key]])
+				{
+					break;
+				}
+				taken[slot[key]] = 1;
+			}
+			if (k == count)
+			{
+				break;
+			}
+			/* undo the slots of this try */
+			while (k--)
+			{
+				taken[slot[order[first + k]]] = 0;
+			}
+		}
+		if (seed > 0xFFFF)
+		{
+			ret = -1;
+		}
+		seeds[b] = seed;
+		first += count;
+	}
+
+	free(bucket);
+	free(order);
+	free(size);
+	free(taken);
+	return ret;
+}
@@ -0,0 +1,20 @@
+/*
+ * roster_mph.h
+ * Builds the minimal perfect hash of roster_hash.h for a set of UID keys.
+ */
+#ifndef ROSTER_MPH_H
+#define ROSTER_MPH_H
+
+#include <stdint.h>
+
+/* bucket count for n keys, two keys per bucket on average */
+#define ROSTER_MPH_BUCKETS(n)	((n) / 2 + 1)
+
+/*
+ * Finds seeds[ROSTER_MPH_BUCKETS(n)] that send the n distinct keys to n
+ * distinct slots, slot[i] is the slot of keys[i].
+ * Returns 0, or -1 if a bucket has no seed that fits.
+ */
+int roster_mph_build(const uint32_t *keys, uint16_t n, uint16_t *seeds, uint16_t *slot);
+
+#endif /* ROSTER_MPH_H */
@@ -0,0 +1,1406 @@
+/*
+ * sim.c
+ * Host-side ATmega32 peripheral simulator (see sim.h for the overview).
+ */
+
+#include <math.h>
+#include <signal.h>
+#include <stdarg.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+#include <time.h>
+#include "sim.h"
+
+/***************************************************
+I/O space
+***************************************************/
+#define IO_UBRRL	0x09
+#define IO_UCSRB	0x0A
+#define IO_UCSRA	0x0B
+#define IO_UDR		0x0C
+#define IO_SPCR		0x0D
+#define IO_SPSR		0x0E
+#define IO_SPDR		0x0F
+#define IO_PIND		0x10
+#define IO_PINA		0x19
+#define IO_UBRRH	0x20	/* UCSRC when written with URSEL set */
+#define IO_EECR		0x1C
+#define IO_OCR2		0x23
+#define IO_TCNT2	0x24
+#define IO_TCCR2	0x25
+#define IO_OCR1A	0x2A
+#define IO_TCNT1	0x2C
+#define IO_TCCR1B	0x2E
+#define IO_TCCR1A	0x2F
+#define IO_TCNT0	0x32
+#define IO_TCCR0	0x33
+#define IO_MCUCSR	0x34
+#define IO_MCUCR	0x35
+#define IO_TIFR		0x38
+#define IO_TIMSK	0x39
+#define IO_GIFR		0x3A
+#define IO_GICR		0x3B
+#define IO_OCR0		0x3C
+#define IO_SREG		0x3F
+
+/* port 0 = A ... 3 = D */
+#define IO_PIN(p)	(IO_PINA - 3 * (p))
+#define IO_DDR(p)	(IO_PIN(p) + 1)
+#define IO_PORT(p)	(IO_PIN(p) + 2)
+#define BIT(n)		(1ULL << (n))
+
+#define ISR_RESPONSE_CYCLES	4	/* interrupt response, and again for reti */
+/* supply of the ATmega32L at 1 MHz and 3 V, datasheet typical values */
+#define SUPPLY_ACTIVE_MA	1.1
+#define SUPPLY_IDLE_MA		0.35
+
+static union
+{
+	uint8_t b[SIM_IO_SIZE];
+	uint16_t w[SIM_IO_SIZE / 2];
+} io;
+
+static uint64_t touched;		/* registers accessed since the last sync() */
+static uint64_t now;
+static int iflag;
+static uint8_t tifr, gifr;		/* interrupt flags owned by the hardware */
+static uint8_t port_seen[4];	/* PORTx as of the last sync() */
+static uint8_t pin_seen[4];		/* PINx as of the last sync() */
+static uint8_t ext_drive[4], ext_level[4];
+
+int sim_trace;
+uint64_t sim_run_limit = SIM_MS(240000);
+const char *sim_eeprom_path;
+
+static struct
+{
+	uint64_t io_accesses;
+	uint64_t delay_cycles;
+	uint64_t sleep_cycles;
+	uint64_t isr_calls;
+	uint64_t spi_bytes;
+	uint64_t spi_frames;
+	uint64_t spi_cycles;
+} stats;
+
+static void sync(void);
+static void dispatch(void);
+static void timer0_external_edge(int rising);
+static uint64_t eeprom_busy_until;
+
+/***************************************************
+Logging
+***************************************************/
+void sim_log(const char *fmt, ...)
+{
+	va_list ap;
+
+	printf("[%10.3f] ", (double)now / F_CPU);
+	va_start(ap, fmt);
+	vprintf(fmt, ap);
+	va_end(ap);
+	putchar('\n');
+}
+
+/***************************************************
+Scenario events
+***************************************************/
+struct sim_event
+{
+	uint64_t when;
+	void (*fn)(void *arg);
+	void *arg;
+};
+
+static struct sim_event *events;
+static size_t n_events, cap_events;
+
+void sim_at(uint64_t when, void (*fn)(void *arg), void *arg)
+{
+	size_t i;
+
+	if (n_events == cap_events)
+	{
+		cap_events = cap_events ? 2 * cap_events : 16;
+		events = realloc(events, cap_events * sizeof(*events));
+		if (!events)
+		{
+			perror("sim_at");
+			exit(1);
+		}
+	}
+	/* keep the list sorted, events at the same time run in insertion order */
+	for (i = n_events; i > 0 && events[i - 1].when > when; i--)
+	{
+		events[i] = events[i - 1];
+	}
+	events[i].when = when;
+	events[i].fn = fn;
+	events[i].arg = arg;
+	n_events++;
+}
+
+static void run_events(void)
+{
+	while (n_events && events[0].when <= now)
+	{
+		struct sim_event ev = events[0];
+		memmove(events, events + 1, --n_events * sizeof(*events));
+		ev.fn(ev.arg);
+	}
+}
+
+/***************************************************
+Reports
+***************************************************/
+struct sim_report
+{
+	void (*fn)(FILE *out, void *ctx);
+	void *ctx;
+};
+
+static struct sim_report reports[8];
+static int n_reports;
+
+void sim_add_report(void (*fn)(FILE *out, void *ctx), void *ctx)
+{
+	if (n_reports < (int)(sizeof(reports) / sizeof(reports[0])))
+	{
+		reports[n_reports].fn = fn;
+		reports[n_reports].ctx = ctx;
+		n_reports++;
+	}
+}
+
+/***************************************************
+Pins
+***************************************************/
+static uint8_t lcd_drive(uint8_t *mask);
+
+static uint8_t pin_value(int p)
+{
+	uint8_t ddr = io.b[IO_DDR(p)];
+	uint8_t port = io.b[IO_PORT(p)];
+	/* undriven inputs read their pull-up (PORT bit) */
+	uint8_t in = (ext_level[p] & ext_drive[p]) | (port & ~ext_drive[p]);
+
+	if (p == 3)
+	{
+		uint8_t mask;
+		uint8_t level = lcd_drive(&mask);
+		in = (in & ~mask) | (level & mask);
+	}
+	return (ddr & port) | (~ddr & in);
+}
+
+static void pin_edges(int p)
+{
+	uint8_t v = pin_value(p);
+	uint8_t changed = v ^ pin_seen[p];
+
+	pin_seen[p] = v;
+	/* INT2 on PB2, edge selected by ISC2 */
+	if (p == 1 && (changed & BIT(2)))
+	{
+		int rising = (v & BIT(2)) != 0;
+		int want_rising = (io.b[IO_MCUCSR] & BIT(6)) != 0;
+		if (rising == want_rising)
+		{
+			gifr |= BIT(5);
+		}
+	}
+	/* T0 on PB0 clocks Timer0 when CS0 selects the external clock */
+	if (p == 1 && (changed & BIT(0)))
+	{
+		timer0_external_edge((v & BIT(0)) != 0);
+	}
+}
+
+void sim_pin_drive(uint8_t port, uint8_t bit, int level)
+{
+	sync();
+	ext_drive[port] |= BIT(bit);
+	if (level)
+	{
+		ext_level[port] |= BIT(bit);
+	}
+	else
+	{
+		ext_level[port] &= ~BIT(bit);
+	}
+	pin_edges(port);
+}
+
+void sim_pin_release(uint8_t port, uint8_t bit)
+{
+	sync();
+	ext_drive[port] &= ~BIT(bit);
+	pin_edges(port);
+}
+
+/***************************************************
+SPI master and slaves
+***************************************************/
+struct spi_binding
+{
+	uint8_t port, bit;
+	int selected;
+	struct sim_spi_slave slave;
+};
+
+static struct spi_binding spi_slaves[4];
+static int n_spi_slaves;
+
+static enum { SPI_IDLE, SPI_STARTED, SPI_DONE } spi_state;
+
+void sim_spi_attach(uint8_t port, uint8_t bit, const struct sim_spi_slave *slave)
+{
+	struct spi_binding *b = &spi_slaves[n_spi_slaves++];
+
+	b->port = port;
+	b->bit = bit;
+	b->selected = 0;
+	b->slave = *slave;
+}
+
+static void spi_port_changed(int p, uint8_t v)
+{
+	for (int i = 0; i < n_spi_slaves; i++)
+	{
+		struct spi_binding *b = &spi_slaves[i];
+		int sel = b->port == p && !(v & BIT(b->bit));
+		if (b->port != p || sel == b->selected)
+		{
+			continue;
+		}
+		b->selected = sel;
+		if (sel)
+		{
+			stats.spi_frames++;
+			if (b->slave.select)
+			{
+				b->slave.select(b->slave.ctx);
+			}
+		}
+		else if (b->slave.deselect)
+		{
+			b->slave.deselect(b->slave.ctx);
+		}
+	}
+}
+
+static uint32_t spi_divider(void)
+{
+	static const uint8_t div[4] = { 4, 16, 64, 128 };
+	uint32_t d = div[io.b[IO_SPCR] & 0x03];
+
+	return (io.b[IO_SPSR] & BIT(0)) ? d / 2 : d;
+}
+
+/* SPDR access: reading it after SPIF clears SPIF, anything else starts a transfer */
+static void spi_data_access(void)
+{
+	if (spi_state == SPI_DONE)
+	{
+		io.b[IO_SPSR] &= ~BIT(7);
+		spi_state = SPI_IDLE;
+	}
+	else
+	{
+		spi_state = SPI_STARTED;
+	}
+}
+
+/* SPSR access: completes a transfer that SPDR started */
+static void spi_status_access(void)
+{
+	uint8_t miso = 0xFF;
+	uint64_t cycles;
+
+	if (spi_state != SPI_STARTED || !(io.b[IO_SPCR] & BIT(6)))
+	{
+		return;
+	}
+	cycles = 8 * (uint64_t)spi_divider();
+	spi_state = SPI_DONE;
+	sim_advance(cycles);
+	for (int i = 0; i < n_spi_slaves; i++)
+	{
+		if (spi_slaves[i].selected)
+		{
+			miso = spi_slaves[i].slave.transfer(spi_slaves[i].slave.ctx, io.b[IO_SPDR]);
+		}
+	}
+	io.b[IO_SPDR] = miso;
+	io.b[IO_SPSR] |= BIT(7);
+	stats.spi_bytes++;
+	stats.spi_cycles += cycles;
+}
+
+/***************************************************
+HD44780 LCD (RS PC6, RW PC7, E PD2, D4-D7 on PD3-PD6)
+***************************************************/
+static struct
+{
+	uint8_t ddram[128];
+	uint8_t addr;
+	int four_bit;
+	int have_high;
+	uint8_t high;
+	uint64_t busy_until;
+	uint64_t changed_at;
+	char shown[2][17];
+	uint64_t commands, clears, data, busy_cycles, overruns;
+} lcd;
+
+static void lcd_reset(void)
+{
+	memset(lcd.ddram, ' ', sizeof(lcd.ddram));
+	memset(lcd.shown, ' ', sizeof(lcd.shown));
+	lcd.shown[0][16] = lcd.shown[1][16] = '\0';
+}
+
+static uint8_t lcd_drive(uint8_t *mask)
+{
+	/* in a read cycle (RW high, E high) the LCD drives its busy flag on D7 = PD6 */
+	if ((io.b[IO_PORT(2)] & BIT(7)) && (io.b[IO_PORT(3)] & BIT(2)))
+	{
+		*mask = 0x78;
+		return now < lcd.busy_until ? 0x40 : 0x00;
+	}
+	*mask = 0;
+	return 0;
+}
+
+static void lcd_exec(uint8_t c, int rs)
+{
+	uint64_t t = SIM_US(37);
+
+	if (now < lcd.busy_until)
+	{
+		lcd.overruns++;
+	}
+	if (rs)
+	{
+		lcd.ddram[lcd.addr & 0x7F] = c;
+		lcd.addr = (lcd.addr == 0x27) ? 0x40 : (lcd.addr == 0x67) ? 0x00 : lcd.addr + 1;
+		lcd.data++;
+		t = SIM_US(41);
+	}
+	else
+	{
+		lcd.commands++;
+		if (c & 0x80)
+		{
+			lcd.addr = c & 0x7F;
+		}
+		else if (c & 0x20)
+		{
+			lcd.four_bit = !(c & 0x10);
+		}
+		else if (c & 0x02 && !(c & 0xFC))
+		{
+			lcd.addr = 0;
+			t = SIM_US(1520);
+		}
+		else if (c == 0x01)
+		{
+			memset(lcd.ddram, ' ', sizeof(lcd.ddram));
+			lcd.addr = 0;
+			lcd.clears++;
+			t = SIM_US(1520);
+		}
+	}
+	lcd.busy_until = now + t;
+	lcd.busy_cycles += t;
+	lcd.changed_at = now;
+}
+
+static void lcd_port_changed(uint8_t old, uint8_t v)
+{
+	uint8_t nibble = (v >> 3) & 0x0F;
+	uint8_t ctl = io.b[IO_PORT(2)];
+
+	/* data is latched on the falling edge of E in write cycles */
+	if (!(old & BIT(2)) || (v & BIT(2)) || (ctl & BIT(7)))
+	{
+		return;
+	}
+	if (!lcd.four_bit)
+	{
+		lcd_exec(nibble << 4, ctl & BIT(6));
+	}
+	else if (!lcd.have_high)
+	{
+		lcd.high = nibble;
+		lcd.have_high = 1;
+	}
+	else
+	{
+		lcd.have_high = 0;
+		lcd_exec((lcd.high << 4) | nibble, ctl & BIT(6));
+	}
+}
+
+/* print the screen once it has been stable for a while and differs from the last print */
+static void lcd_trace(int force)
+{
+	char rows[2][17];
+
+	if (!sim_trace || !lcd.changed_at || (!force && now - lcd.changed_at < SIM_MS(20)))
+	{
+		return;
+	}
+	for (int r = 0; r < 2; r++)
+	{
+		for (int x = 0; x < 16; x++)
+		{
+			uint8_t c = lcd.ddram[r * 0x40 + x];
+			rows[r][x] = (c >= 0x20 && c < 0x7F) ? c : '?';
+		}
+		rows[r][16] = '\0';
+	}
+	lcd.changed_at = 0;
+	if (memcmp(rows, lcd.shown, sizeof(rows)) != 0)
+	{
+		memcpy(lcd.shown, rows, sizeof(rows));
+		sim_log("lcd |%s|%s|", rows[0], rows[1]);
+	}
+}
+
+/***************************************************
+Timers
+***************************************************/
+struct sim_timer
+{
+	const char *name;
+	uint32_t max;
+	uint8_t tccr, tcnt, ocr;
+	uint8_t tov, ocf;		/* TIFR bits */
+	uint32_t count, shadow;
+	uint32_t pre;			/* cycles accumulated toward the next tick */
+};
+
+static struct sim_timer timers[3] = {
+	{ "timer0", 0xFF, IO_TCCR0, IO_TCNT0, IO_OCR0, 0, 1, 0, 0, 0 },
+	{ "timer1", 0xFFFF, IO_TCCR1B, IO_TCNT1, IO_OCR1A, 2, 4, 0, 0, 0 },
+	{ "timer2", 0xFF, IO_TCCR2, IO_TCNT2, IO_OCR2, 6, 7, 0, 0, 0 },
+};
+
+static uint32_t timer_prescaler(const struct sim_timer *t)
+{
+	static const uint16_t div01[8] = { 0, 1, 8, 64, 256, 1024, 0, 0 };
+	static const uint16_t div2[8] = { 0, 1, 8, 32, 64, 128, 256, 1024 };
+	uint8_t cs = io.b[t->tccr] & 0x07;
+
+	return t == &timers[2] ? div2[cs] : div01[cs];
+}
+
+static int timer_ctc(const struct sim_timer *t)
+{
+	if (t == &timers[1])
+	{
+		return (io.b[IO_TCCR1B] & 0x18) == 0x08 && !(io.b[IO_TCCR1A] & 0x03);
+	}
+	return (io.b[t->tccr] & 0x48) == 0x08;
+}
+
+static uint32_t timer_ocr(const struct sim_timer *t)
+{
+	return t->max == 0xFF ? io.b[t->ocr] : io.w[t->ocr / 2];
+}
+
+static uint32_t timer_top(const struct sim_timer *t)
+{
+	uint32_t ocr = timer_ocr(t);
+
+	return (timer_ctc(t) && t->count <= ocr) ? ocr : t->max;
+}
+
+/* ticks until the next compare match or wrap */
+static uint32_t timer_ticks_to_event(const struct sim_timer *t)
+{
+	uint32_t top = timer_top(t);
+	uint32_t ocr = timer_ocr(t);
+	uint32_t ticks = top - t->count + 1;
+
+	if (ocr > t->count && ocr <= top && ocr - t->count < ticks)
+	{
+		ticks = ocr - t->count;
+	}
+	return ticks;
+}
+
+static uint64_t timer_cycles_to_event(const struct sim_timer *t)
+{
+	uint32_t presc = timer_prescaler(t);
+
+	if (!presc)
+	{
+		return UINT64_MAX;
+	}
+	return (uint64_t)timer_ticks_to_event(t) * presc - t->pre;
+}
+
+static void timer_tick(struct sim_timer *t, uint64_t ticks)
+{
+	while (ticks)
+	{
+		uint32_t top = timer_top(t);
+		uint32_t ocr = timer_ocr(t);
+		uint64_t n = timer_ticks_to_event(t);
+
+		if (n > ticks)
+		{
+			n = ticks;
+		}
+		ticks -= n;
+		if (t->count + n > top)
+		{
+			t->count = 0;
+			if (top == t->max)
+			{
+				tifr |= BIT(t->tov);
+			}
+		}
+		else
+		{
+			t->count += n;
+		}
+		if (t->count == ocr)
+		{
+			tifr |= BIT(t->ocf);
+		}
+	}
+}
+
+static void timer_step(struct sim_timer *t, uint64_t cycles)
+{
+	uint32_t presc = timer_prescaler(t);
+	uint64_t total;
+
+	if (!presc)
+	{
+		return;
+	}
+	total = t->pre + cycles;
+	t->pre = total % presc;
+	timer_tick(t, total / presc);
+}
+
+static void timer_sync(struct sim_timer *t);
+
+static void timer0_external_edge(int rising)
+{
+	uint8_t cs = io.b[IO_TCCR0] & 0x07;
+
+	if ((cs == 6 && !rising) || (cs == 7 && rising))
+	{
+		timer_sync(&timers[0]);
+		timer_tick(&timers[0], 1);
+	}
+}
+
+static void timer_publish(struct sim_timer *t)
+{
+	if (t->max == 0xFF)
+	{
+		io.b[t->tcnt] = t->count;
+	}
+	else
+	{
+		io.w[t->tcnt / 2] = t->count;
+	}
+	t->shadow = t->count;
+}
+
+static void timer_sync(struct sim_timer *t)
+{
+	uint32_t v = t->max == 0xFF ? io.b[t->tcnt] : io.w[t->tcnt / 2];
+
+	/* the firmware wrote TCNTx */
+	if (v != t->shadow)
+	{
+		t->count = t->shadow = v;
+		t->pre = 0;
+	}
+}
+
+/***************************************************
+USART, its line is attached by sim_main.c
+***************************************************/
+static struct
+{
+	int attached;
+	struct sim_uart_line line;
+	uint8_t ucsrc, ubrrh;
+	uint8_t rx_data;
+	int rxc;					/* a received byte waits in UDR */
+	int udr_rx;					/* RXC was set when UDR was last accessed */
+	uint64_t rx_next;			/* when the line is looked at again */
+	uint8_t tx_data;
+	int tx_full;				/* the transmit buffer holds a byte, UDRE is clear */
+	uint8_t shift_data;
+	int shifting;
+	uint64_t shift_done;
+	int txc;
+	uint64_t tx_bytes, rx_bytes, tx_overruns, tx_first, tx_last;
+} uart = { .ucsrc = 0x86 };
+
+void sim_uart_attach(const struct sim_uart_line *line)
+{
+	uart.line = *line;
+	uart.attached = 1;
+}
+
+/* one bit at the UBRR and U2X rate */
+static uint64_t uart_bit_cycles(void)
+{
+	uint32_t ubrr = ((uint32_t)(uart.ubrrh & 0x0F) << 8) | io.b[IO_UBRRL];
+
+	return ((io.b[IO_UCSRA] & BIT(1)) ? 8 : 16) * (ubrr + 1);
+}
+
+/* start bit, data bits, parity and stop bits */
+static uint64_t uart_frame_cycles(void)
+{
+	uint32_t bits = 1 + 5 + ((uart.ucsrc >> 1) & 3) + (((uart.ucsrc >> 4) & 3) ? 1 : 0) + ((uart.ucsrc & BIT(3)) ? 2 : 1);
+
+	return bits * uart_bit_cycles();
+}
+
+/* the transmit buffer moves to the shift register as soon as it is free */
+static void uart_tx_load(void)
+{
+	if (uart.shifting || !uart.tx_full)
+	{
+		return;
+	}
+	if (!uart.tx_bytes)
+	{
+		uart.tx_first = now;
+	}
+	uart.shift_data = uart.tx_data;
+	uart.tx_full = 0;
+	uart.shifting = 1;
+	uart.shift_done = now + uart_frame_cycles();
+	uart.txc = 0;
+}
+
+static void uart_write(uint8_t v)
+{
+	if (!(io.b[IO_UCSRB] & BIT(3)))
+	{
+		return;
+	}
+	if (uart.tx_full)
+	{
+		uart.tx_overruns++;
+		return;
+	}
+	uart.tx_data = v;
+	uart.tx_full = 1;
+	uart_tx_load();
+}
+
+static void uart_step(void)
+{
+	if (uart.shifting && now >= uart.shift_done)
+	{
+		if (uart.attached)
+		{
+			uart.line.transmit(uart.line.ctx, uart.shift_data);
+		}
+		uart.tx_bytes++;
+		uart.tx_last = now;
+		uart.shifting = 0;
+		uart_tx_load();
+		if (!uart.shifting)
+		{
+			uart.txc = 1;
+		}
+	}
+	/* a byte from the host arrives once the last one was taken, the host side buffers the rest */
+	if (uart.attached && (io.b[IO_UCSRB] & BIT(4)) && now >= uart.rx_next)
+	{
+		int c = uart.rxc ? -1 : uart.line.receive(uart.line.ctx);
+
+		uart.rx_next = now + SIM_MS(1);
+		if (c >= 0)
+		{
+			uart.rx_data = c;
+			uart.rxc = 1;
+			uart.rx_bytes++;
+			uart.rx_next = now + uart_frame_cycles();
+		}
+	}
+}
+
+static uint64_t uart_next_event(void)
+{
+	uint64_t next = UINT64_MAX;
+
+	if (uart.shifting)
+	{
+		next = uart.shift_done;
+	}
+	if (uart.attached && (io.b[IO_UCSRB] & BIT(4)) && uart.rx_next < next)
+	{
+		next = uart.rx_next;
+	}
+	return next;
+}
+
+/* UDR is one address for the received and the transmitted byte: an access that finds a byte
+received and leaves it unchanged was a read, anything else a write */
+static void uart_sync(uint64_t t)
+{
+	if (t & BIT(IO_UDR))
+	{
+		if (uart.udr_rx && io.b[IO_UDR] == uart.rx_data)
+		{
+			uart.rxc = 0;
+		}
+		else
+		{
+			uart_write(io.b[IO_UDR]);
+		}
+	}
+	if (t & BIT(IO_UCSRA))
+	{
+		/* TXC is cleared by writing one */
+		if (io.b[IO_UCSRA] & BIT(6))
+		{
+			uart.txc = 0;
+		}
+		io.b[IO_UCSRA] &= 0x03;
+	}
+	if (t & BIT(IO_UBRRH))
+	{
+		if (io.b[IO_UBRRH] & BIT(7))
+		{
+			uart.ucsrc = io.b[IO_UBRRH];
+		}
+		else
+		{
+			uart.ubrrh = io.b[IO_UBRRH];
+		}
+	}
+}
+
+static void uart_access(uint8_t addr)
+{
+	if (addr == IO_UDR)
+	{
+		uart.udr_rx = uart.rxc;
+		io.b[IO_UDR] = uart.rx_data;
+	}
+	else if (addr == IO_UCSRA)
+	{
+		io.b[IO_UCSRA] = (io.b[IO_UCSRA] & 0x03) | (uart.rxc ? BIT(7) : 0) | (uart.txc ? BIT(6) : 0) |
+			(uart.tx_full ? 0 : BIT(5));
+	}
+}
+
+/***************************************************
+Interrupts
+***************************************************/
+#define VECTOR_DECL(n) extern void __vector_##n(void) __attribute__((weak));
+VECTOR_DECL(1) VECTOR_DECL(2) VECTOR_DECL(3) VECTOR_DECL(4) VECTOR_DECL(5)
+VECTOR_DECL(6) VECTOR_DECL(7) VECTOR_DECL(8) VECTOR_DECL(9) VECTOR_DECL(10)
+VECTOR_DECL(11) VECTOR_DECL(12) VECTOR_DECL(13) VECTOR_DECL(14) VECTOR_DECL(15)
+VECTOR_DECL(16) VECTOR_DECL(17) VECTOR_DECL(18) VECTOR_DECL(19) VECTOR_DECL(20)
+
+#define N_VECTORS 21
+
+static void (*const vectors[N_VECTORS])(void) = {
+	NULL, __vector_1, __vector_2, __vector_3, __vector_4, __vector_5,
+	__vector_6, __vector_7, __vector_8, __vector_9, __vector_10,
+	__vector_11, __vector_12, __vector_13, __vector_14, __vector_15,
+	__vector_16, __vector_17, __vector_18, __vector_19, __vector_20,
+};
+
+static const char *const vector_names[N_VECTORS] = {
+	"RESET", "INT0", "INT1", "INT2", "TIMER2_COMP", "TIMER2_OVF",
+	"TIMER1_CAPT", "TIMER1_COMPA", "TIMER1_COMPB", "TIMER1_OVF", "TIMER0_COMP",
+	"TIMER0_OVF", "SPI_STC", "USART_RXC", "USART_UDRE", "USART_TXC",
+	"ADC", "EE_RDY", "ANA_COMP", "TWI", "SPM_RDY",
+};
+
+/* flag-based sources in priority order: vector, enable register and bit, flag register and bit */
+static const struct
+{
+	uint8_t vector;
+	uint8_t en_reg, en_bit;
+	uint8_t *flags;
+	uint8_t flag_bit;
+} sources[] = {
+	{ 1, IO_GICR, 6, &gifr, 6 },
+	{ 2, IO_GICR, 7, &gifr, 7 },
+	{ 3, IO_GICR, 5, &gifr, 5 },
+	{ 4, IO_TIMSK, 7, &tifr, 7 },
+	{ 5, IO_TIMSK, 6, &tifr, 6 },
+	{ 6, IO_TIMSK, 5, &tifr, 5 },
+	{ 7, IO_TIMSK, 4, &tifr, 4 },
+	{ 8, IO_TIMSK, 3, &tifr, 3 },
+	{ 9, IO_TIMSK, 2, &tifr, 2 },
+	{ 10, IO_TIMSK, 1, &tifr, 1 },
+	{ 11, IO_TIMSK, 0, &tifr, 0 },
+};
+
+static struct
+{
+	uint64_t count;
+	uint64_t cycles;
+	uint64_t max_cycles;
+	uint64_t ns;
+	uint64_t max_ns;
+} isr_stats[N_VECTORS];
+
+static void set_iflag(int on)
+{
+	iflag = on;
+	io.b[IO_SREG] = (io.b[IO_SREG] & 0x7F) | (on ? 0x80 : 0);
+}
+
+void sim_sei(void)
+{
+	sync();
+	set_iflag(1);
+}
+
+void sim_cli(void)
+{
+	sync();
+	set_iflag(0);
+}
+
+static int pending_vector(void)
+{
+	for (size_t i = 0; i < sizeof(sources) / sizeof(sources[0]); i++)
+	{
+		if ((io.b[sources[i].en_reg] & BIT(sources[i].en_bit)) && (*sources[i].flags & BIT(sources[i].flag_bit)))
+		{
+			*sources[i].flags &= ~BIT(sources[i].flag_bit);
+			return sources[i].vector;
+		}
+	}
+	/* the USART requests for as long as its flags are set, only TXC is cleared by the interrupt */
+	if ((io.b[IO_UCSRB] & BIT(7)) && uart.rxc)
+	{
+		return 13;
+	}
+	if ((io.b[IO_UCSRB] & BIT(5)) && !uart.tx_full)
+	{
+		return 14;
+	}
+	if ((io.b[IO_UCSRB] & BIT(6)) && uart.txc)
+	{
+		uart.txc = 0;
+		return 15;
+	}
+	/* EE_RDY has no flag, it is requested for as long as EERIE is set and no write is in progress */
+	if ((io.b[IO_EECR] & BIT(3)) && now >= eeprom_busy_until)
+	{
+		return 17;
+	}
+	return 0;
+}
+
+static uint64_t host_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static void dispatch(void)
+{
+	int v;
+
+	while (iflag && (v = pending_vector()) != 0)
+	{
+		uint64_t start = now, ns = host_ns(), cycles;
+
+		if (!vectors[v])
+		{
+			sim_log("interrupt %s has no handler", vector_names[v]);
+			sim_finish("bad interrupt");
+		}
+		set_iflag(0);
+		sim_advance(ISR_RESPONSE_CYCLES);
+		vectors[v]();
+		sim_advance(ISR_RESPONSE_CYCLES);
+		sync();
+		set_iflag(1);
+
+		cycles = now - start;
+		ns = host_ns() - ns;
+		stats.isr_calls++;
+		isr_stats[v].count++;
+		isr_stats[v].cycles += cycles;
+		isr_stats[v].ns += ns;
+		if (cycles > isr_stats[v].max_cycles)
+		{
+			isr_stats[v].max_cycles = cycles;
+		}
+		if (ns > isr_stats[v].max_ns)
+		{
+			isr_stats[v].max_ns = ns;
+		}
+	}
+}
+
+/***************************************************
+Register access and clock
+***************************************************/
+/* apply side effects of register writes made since the last call */
+static void sync(void)
+{
+	uint64_t t = touched;
+
+	touched = 0;
+	if (!t)
+	{
+		return;
+	}
+	for (int p = 0; p < 4; p++)
+	{
+		if (t & (BIT(IO_PORT(p)) | BIT(IO_DDR(p))))
+		{
+			uint8_t old = port_seen[p];
+			port_seen[p] = io.b[IO_PORT(p)];
+			if (old != port_seen[p])
+			{
+				spi_port_changed(p, port_seen[p]);
+				if (p == 3)
+				{
+					lcd_port_changed(old, port_seen[p]);
+				}
+			}
+			pin_edges(p);
+		}
+	}
+	/* interrupt flags are cleared by writing one; every access is treated as a write */
+	if (t & BIT(IO_GIFR))
+	{
+		gifr &= ~io.b[IO_GIFR];
+		io.b[IO_GIFR] = gifr;
+	}
+	if (t & BIT(IO_TIFR))
+	{
+		tifr &= ~io.b[IO_TIFR];
+		io.b[IO_TIFR] = tifr;
+	}
+	uart_sync(t);
+	if (t & BIT(IO_SREG))
+	{
+		iflag = io.b[IO_SREG] >> 7;
+	}
+	for (int i = 0; i < 3; i++)
+	{
+		if (t & BIT(timers[i].tcnt))
+		{
+			timer_sync(&timers[i]);
+		}
+	}
+}
+
+volatile uint8_t *sim_io8(uint8_t addr)
+{
+	sim_advance(1);
+	stats.io_accesses++;
+	touched |= BIT(addr);
+	switch (addr)
+	{
+		case IO_PINA:
+		case IO_PINA - 3:
+		case IO_PINA - 6:
+		case IO_PIND:
+			io.b[addr] = pin_value((IO_PINA - addr) / 3);
+			break;
+		case IO_SPDR:
+			spi_data_access();
+			break;
+		case IO_SPSR:
+			spi_status_access();
+			break;
+		case IO_GIFR:
+			io.b[addr] = gifr;
+			break;
+		case IO_TIFR:
+			io.b[addr] = tifr;
+			break;
+		case IO_TCNT0:
+			timer_publish(&timers[0]);
+			break;
+		case IO_EECR:
+			/* EEWE reads as 1 while a write is in progress */
+			io.b[addr] = (io.b[addr] & ~BIT(1)) | (now < eeprom_busy_until ? BIT(1) : 0);
+			break;
+		case IO_TCNT2:
+			timer_publish(&timers[2]);
+			break;
+		case IO_UDR:
+		case IO_UCSRA:
+			uart_access(addr);
+			break;
+		default:
+			break;
+	}
+	return &io.b[addr];
+}
+
+volatile uint16_t *sim_io16(uint8_t addr)
+{
+	sim_advance(2);
+	stats.io_accesses += 2;
+	touched |= BIT(addr);
+	if (addr == IO_TCNT1)
+	{
+		timer_publish(&timers[1]);
+	}
+	return &io.w[addr / 2];
+}
+
+uint64_t sim_now(void)
+{
+	return now;
+}
+
+/* the earliest of `limit`, the next timer event, EE_RDY, the USART, the next scenario event and the run limit */
+static uint64_t next_event(uint64_t limit)
+{
+	uint64_t next = limit;
+	uint64_t u = uart_next_event();
+
+	for (int i = 0; i < 3; i++)
+	{
+		uint64_t c = timer_cycles_to_event(&timers[i]);
+		if (c != UINT64_MAX && now + c < next)
+		{
+			next = now + c;
+		}
+	}
+	if ((io.b[IO_EECR] & BIT(3)) && eeprom_busy_until > now && eeprom_busy_until < next)
+	{
+		next = eeprom_busy_until;
+	}
+	if (u < next)
+	{
+		next = u > now ? u : now;
+	}
+	if (n_events && events[0].when < next)
+	{
+		next = events[0].when > now ? events[0].when : now;
+	}
+	if (sim_run_limit < next)
+	{
+		next = sim_run_limit;
+	}
+	return next;
+}
+
+void sim_advance(uint64_t cycles)
+{
+	uint64_t target = now + cycles;
+
+	sync();
+	for (;;)
+	{
+		uint64_t next = next_event(target);
+
+		for (int i = 0; i < 3; i++)
+		{
+			timer_step(&timers[i], next - now);
+		}
+		now = next;
+		if (now >= sim_run_limit)
+		{
+			sim_finish("run limit reached");
+		}
+		run_events();
+		uart_step();
+		lcd_trace(0);
+		dispatch();
+		if (now >= target)
+		{
+			break;
+		}
+	}
+}
+
+void sim_sleep(void)
+{
+	uint64_t start = now, calls = stats.isr_calls;
+
+	sync();
+	/* SLEEP without SE is a nop */
+	if (!(io.b[IO_MCUCR] & BIT(7)))
+	{
+		return;
+	}
+	if (!iflag)
+	{
+		sim_finish("sleep with interrupts disabled");
+	}
+	/* idle until an interrupt has been served */
+	while (stats.isr_calls == calls)
+	{
+		uint64_t next = next_event(UINT64_MAX);
+		sim_advance(next > now ? next - now : 1);
+	}
+	stats.sleep_cycles += now - start;
+}
+
+void sim_delay_us(double us)
+{
+	/* avr-libc rounds delays up to whole cycles */
+	uint64_t cycles = (uint64_t)ceil(us * (F_CPU / 1e6));
+
+	stats.delay_cycles += cycles;
+	sim_advance(cycles);
+}
+
+/***************************************************
+EEPROM
+***************************************************/
+extern uint8_t __start_sim_eeprom[] __attribute__((weak));
+extern uint8_t __stop_sim_eeprom[] __attribute__((weak));
+
+static uint8_t eeprom[SIM_EEPROM_SIZE];
+static uint32_t eeprom_wear[SIM_EEPROM_SIZE];
+
+static struct
+{
+	uint64_t reads, writes, skipped, wait_cycles;
+} ee_stats;
+
+uint16_t sim_eeprom_addr(const void *p)
+{
+	uintptr_t a = (uintptr_t)p;
+
+	/* EEMEM variables, or plain EEPROM addresses cast to pointers */
+	if (a >= SIM_EEPROM_SIZE)
+	{
+		a = (const uint8_t *)p - __start_sim_eeprom;
+	}
+	if (a >= SIM_EEPROM_SIZE)
+	{
+		sim_log("EEPROM address %p out of range", p);
+		sim_finish("bad EEPROM access");
+	}
+	return (uint16_t)a;
+}
+
+static void eeprom_wait(void)
+{
+	if (now < eeprom_busy_until)
+	{
+		ee_stats.wait_cycles += eeprom_busy_until - now;
+		sim_advance(eeprom_busy_until - now);
+	}
+}
+
+int sim_eeprom_ready(void)
+{
+	sim_advance(1);
+	return now >= eeprom_busy_until;
+}
+
+uint8_t sim_eeprom_read(uint16_t addr)
+{
+	eeprom_wait();
+	/* EEAR, EERE strobe and the 4 cycles the CPU is halted */
+	sim_advance(8);
+	ee_stats.reads++;
+	return eeprom[addr % SIM_EEPROM_SIZE];
+}
+
+void sim_eeprom_write(uint16_t addr, uint8_t data, int update)
+{
+	addr %= SIM_EEPROM_SIZE;
+	if (update && sim_eeprom_read(addr) == data)
+	{
+		ee_stats.skipped++;
+		return;
+	}
+	eeprom_wait();
+	sim_advance(8);
+	eeprom[addr] = data;
+	eeprom_wear[addr]++;
+	ee_stats.writes++;
+	eeprom_busy_until = now + SIM_US(SIM_EEPROM_WRITE_US);
+}
+
+int sim_eeprom_load(const char *path)
+{
+	FILE *f = fopen(path, "rb");
+	size_t n;
+
+	if (!f)
+	{
+		return -1;
+	}
+	n = fread(eeprom, 1, sizeof(eeprom), f);
+	fclose(f);
+	return n == sizeof(eeprom) ? 0 : -1;
+}
+
+int sim_eeprom_save(const char *path)
+{
+	FILE *f = fopen(path, "wb");
+	int ok;
+
+	if (!f)
+	{
+		return -1;
+	}
+	ok = fwrite(eeprom, 1, sizeof(eeprom), f) == sizeof(eeprom);
+	return (fclose(f) == 0 && ok) ? 0 : -1;
+}
+
+/* the .eep image: erased cells plus the EEMEM initializers */
+static void eeprom_flash(void)
+{
+	size_t n = __stop_sim_eeprom - __start_sim_eeprom;
+
+	if (n > SIM_EEPROM_SIZE)
+	{
+		fprintf(stderr, "EEMEM data (%zu bytes) does not fit into %d bytes of EEPROM\n", n, SIM_EEPROM_SIZE);
+		exit(1);
+	}
+	memset(eeprom, 0xFF, sizeof(eeprom));
+	if (n)
+	{
+		memcpy(eeprom, __start_sim_eeprom, n);
+	}
+}
+
+/***************************************************
+Start, stall detection and final report
+***************************************************/
+static uint64_t stall_seen;
+static int stall_ticks;
+
+/* the firmware spins without touching any modelled hardware: time can never advance again */
+static void stall_check(int sig)
+{
+	(void)sig;
+	if (now != stall_seen)
+	{
+		stall_seen = now;
+		stall_ticks = 0;
+	}
+	else if (++stall_ticks >= 4)
+	{
+		sim_finish("firmware idles in a loop without I/O");
+	}
+}
+
+void sim_start(void)
+{
+	struct itimerval it = { { 0, 250000 }, { 0, 250000 } };
+
+	lcd_reset();
+	if (!sim_eeprom_path || sim_eeprom_load(sim_eeprom_path) != 0)
+	{
+		eeprom_flash();
+	}
+	signal(SIGALRM, stall_check);
+	setitimer(ITIMER_REAL, &it, NULL);
+}
+
+static void pct_line(FILE *out, const char *what, uint64_t cycles)
+{
+	fprintf(out, "  %-22s %12llu cycles (%5.1f%%)\n", what, (unsigned long long)cycles,
+		now ? 100.0 * cycles / now : 0.0);
+}
+
+void sim_finish(const char *why)
+{
+	struct itimerval off = { { 0, 0 }, { 0, 0 } };
+	FILE *out = stdout;
+	uint32_t max_wear = 0;
+	int max_wear_addr = 0;
+
+	setitimer(ITIMER_REAL, &off, NULL);
+	lcd_trace(1);
+	sim_log("simulation end: %s", why);
+
+	fprintf(out, "cpu\n");
+	fprintf(out, "  %-22s %12llu cycles (%.3f s at %lu Hz)\n", "virtual time", (unsigned long long)now,
+		(double)now / F_CPU, (unsigned long)F_CPU);
+	fprintf(out, "  %-22s %12llu\n", "i/o accesses", (unsigned long long)stats.io_accesses);
+	pct_line(out, "_delay_ms/_delay_us", stats.delay_cycles);
+	pct_line(out, "sleep", stats.sleep_cycles);
+	fprintf(out, "  %-22s %12.3f mA avg (%.2f active, %.2f idle)\n", "supply",
+		now ? (SUPPLY_ACTIVE_MA * (now - stats.sleep_cycles) + SUPPLY_IDLE_MA * stats.sleep_cycles) / now : 0.0,
+		SUPPLY_ACTIVE_MA, SUPPLY_IDLE_MA);
+
+	fprintf(out, "spi\n");
+	fprintf(out, "  %-22s %12llu in %llu frames\n", "bytes", (unsigned long long)stats.spi_bytes,
+		(unsigned long long)stats.spi_frames);
+	pct_line(out, "bus time", stats.spi_cycles);
+
+	for (int i = 0; i < SIM_EEPROM_SIZE; i++)
+	{
+		if (eeprom_wear[i] > max_wear)
+		{
+			max_wear = eeprom_wear[i];
+			max_wear_addr = i;
+		}
+	}
+	fprintf(out, "eeprom\n");
+	fprintf(out, "  %-22s %12llu\n", "reads", (unsigned long long)ee_stats.reads);
+	fprintf(out, "  %-22s %12llu (%llu updates skipped)\n", "writes", (unsigned long long)ee_stats.writes,
+		(unsigned long long)ee_stats.skipped);
+	pct_line(out, "busy wait", ee_stats.wait_cycles);
+	fprintf(out, "  %-22s %12u writes (address 0x%03X)\n", "most worn cell", max_wear, max_wear_addr);
+
+	fprintf(out, "lcd\n");
+	fprintf(out, "  %-22s %12llu (%llu clears)\n", "commands", (unsigned long long)lcd.commands,
+		(unsigned long long)lcd.clears);
+	fprintf(out, "  %-22s %12llu\n", "characters", (unsigned long long)lcd.data);
+	pct_line(out, "controller busy", lcd.busy_cycles);
+	fprintf(out, "  %-22s %12llu\n", "writes while busy", (unsigned long long)lcd.overruns);
+
+	if (uart.tx_bytes || uart.rx_bytes)
+	{
+		fprintf(out, "usart\n");
+		fprintf(out, "  %-22s %12.0f baud\n", "rate", (double)F_CPU / uart_bit_cycles());
+		fprintf(out, "  %-22s %12llu (%llu lost to a full buffer)\n", "bytes sent", (unsigned long long)uart.tx_bytes,
+			(unsigned long long)uart.tx_overruns);
+		fprintf(out, "  %-22s %12llu\n", "bytes received", (unsigned long long)uart.rx_bytes);
+		fprintf(out, "  %-22s %12.3f s (line busy %.1f%%)\n", "first to last byte sent",
+			(double)(uart.tx_last - uart.tx_first) / F_CPU,
+			uart.tx_last > uart.tx_first ? 100.0 * uart.tx_bytes * uart_frame_cycles() / (uart.tx_last - uart.tx_first) : 0.0);
+	}
+
+	fprintf(out, "isr\n");
+	for (int v = 1; v < N_VECTORS; v++)
+	{
+		if (!isr_stats[v].count)
+		{
+			continue;
+		}
+		fprintf(out, "  %-22s %12llu calls, %llu cycles total, worst %llu cycles, host %llu ns avg / %llu ns worst\n",
+			vector_names[v], (unsigned long long)isr_stats[v].count, (unsigned long long)isr_stats[v].cycles,
+			(unsigned long long)isr_stats[v].max_cycles, (unsigned long long)(isr_stats[v].ns / isr_stats[v].count),
+			(unsigned long long)isr_stats[v].max_ns);
+	}
+
+	for (int i = 0; i < n_reports; i++)
+	{
+		reports[i].fn(out, reports[i].ctx);
+	}
+
+	if (sim_eeprom_path && sim_eeprom_save(sim_eeprom_path) != 0)
+	{
+		perror(sim_eeprom_path);
+	}
+	fflush(out);
+	exit(0);
+}
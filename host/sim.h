@@ -0,0 +1,123 @@
+/*
+ * sim.h
+ * Host-side ATmega32 peripheral simulator.
+ */
+
+/***********************************************
+Description of the simulator
+************************************************/
+/*
+The firmware (main.c + my_header.h) is compiled unmodified for Linux against the
+headers in host/include. Those headers map every I/O register access, the eeprom_*
+calls, _delay_ms/_delay_us and ISR() onto this simulator, which keeps a virtual
+cycle counter and accounts for:
+- every I/O register access (1 cycle)
+- _delay_ms/_delay_us (rounded up to whole cycles, like avr-libc)
+- sleep_cpu(), which idles until the next interrupt has been served
+- pgm_read_* from PROGMEM (LPM, 3 cycles per byte)
+- SPI transfers (8 SCK periods at the SPCR/SPSR prescaler)
+- EEPROM programming time and the busy-wait in front of every EEPROM access
+- the HD44780 LCD execution time seen through its busy flag
+- Timer0/1/2 (Timer0 also from its T0 pin), INT0/1/2, EE_RDY and interrupt dispatch with per-vector statistics
+- the USART at its baud rate, its line connected to a pty by sim_main.c
+
+Pure computation is not cycle accounted. Numbers reported by the simulator are
+therefore a lower bound dominated by what the firmware waits on, which is where
+the time of this firmware goes.
+*/
+
+#ifndef SIM_H
+#define SIM_H
+
+#include <stdint.h>
+#include <stdio.h>
+
+#ifndef F_CPU
+#define F_CPU 1000000UL
+#endif
+
+/* cycle conversions */
+#define SIM_US(us)	((uint64_t)(us) * (F_CPU / 1000000UL))
+#define SIM_MS(ms)	(SIM_US(ms) * 1000ULL)
+
+/* ATmega32 I/O space (I/O addresses, not data memory addresses) */
+#define SIM_IO_SIZE	0x40
+
+#define SIM_EEPROM_SIZE		1024
+#define SIM_EEPROM_WRITE_US	8500	/* ATmega32 datasheet, Table 1: 8448 cycles of the 1 MHz RC oscillator */
+
+/***************************************************
+I/O register access
+***************************************************/
+volatile uint8_t *sim_io8(uint8_t addr);
+volatile uint16_t *sim_io16(uint8_t addr);
+
+/***************************************************
+Virtual time
+***************************************************/
+uint64_t sim_now(void);
+void sim_advance(uint64_t cycles);
+void sim_delay_us(double us);
+void sim_sleep(void);
+void sim_sei(void);
+void sim_cli(void);
+
+/***************************************************
+EEPROM
+***************************************************/
+uint16_t sim_eeprom_addr(const void *p);
+int sim_eeprom_ready(void);
+uint8_t sim_eeprom_read(uint16_t addr);
+void sim_eeprom_write(uint16_t addr, uint8_t data, int update);
+int sim_eeprom_load(const char *path);
+int sim_eeprom_save(const char *path);
+
+/***************************************************
+External pins
+***************************************************/
+/* port: 0 = A ... 3 = D */
+void sim_pin_drive(uint8_t port, uint8_t bit, int level);
+void sim_pin_release(uint8_t port, uint8_t bit);
+
+/***************************************************
+SPI slaves
+***************************************************/
+struct sim_spi_slave
+{
+	const char *name;
+	void (*select)(void *ctx);
+	uint8_t (*transfer)(void *ctx, uint8_t mosi);
+	void (*deselect)(void *ctx);
+	void *ctx;
+};
+
+/* the slave is selected while bit `bit` of PORT<port> is low */
+void sim_spi_attach(uint8_t port, uint8_t bit, const struct sim_spi_slave *slave);
+
+/***************************************************
+USART
+***************************************************/
+struct sim_uart_line
+{
+	void (*transmit)(void *ctx, uint8_t byte);	/* a byte has left the shift register */
+	int (*receive)(void *ctx);					/* the next byte from the other end, -1 if there is none yet */
+	void *ctx;
+};
+
+void sim_uart_attach(const struct sim_uart_line *line);
+
+/***************************************************
+Scenario events and reports
+***************************************************/
+void sim_at(uint64_t when, void (*fn)(void *arg), void *arg);
+void sim_add_report(void (*fn)(FILE *out, void *ctx), void *ctx);
+
+extern int sim_trace;
+extern uint64_t sim_run_limit;
+extern const char *sim_eeprom_path;
+
+void sim_log(const char *fmt, ...) __attribute__((format(printf, 1, 2)));
+void sim_start(void);
+void sim_finish(const char *why) __attribute__((noreturn));
+
+#endif /* SIM_H */
@@ -0,0 +1,336 @@
+/*
+ * sim_main.c
+ * Command line and scenario handling for the host build of the firmware.
+ */
+
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <stdlib.h>
+#include <string.h>
+#include <termios.h>
+#include <unistd.h>
+#include "sim.h"
+#include "mfrc522_model.h"
+
+/* main() of main.c, renamed by the host build */
+int firmware_main(void);
+
+#define PORT_B 1
+#define PORT_C 2
+
+/* the readers of ../door.h: SS on PB4, PB3 and PB1, their IRQ outputs together on T0/PB0 */
+#define MAX_READERS 3
+static const uint8_t reader_ss[MAX_READERS] = { 4, 3, 1 };
+static struct mfrc522_model *readers[MAX_READERS];
+static int n_readers;
+
+static void usage(const char *argv0)
+{
+	fprintf(stderr,
+		"usage: %s [options]\n"
+		"  --run-ms MS          stop after MS milliseconds of virtual time (default 240000)\n"
+		"  --eeprom FILE        load the EEPROM image from FILE and save it back at the end\n"
+		"  --button MS          press and release the INT2 push button (PB2) at MS\n"
+		"  --switch MS:LEVEL    set the database DPDT switch (PC0) at MS\n"
+		"  --readers N          N RC522 on the bus (default 1, up to 3), as DOOR_READERS of the firmware\n"
+		"  --tag MS:DUR:UID[:SAK][@READER]\n"
+		"                       hold a tag with the hex UID (4, 7 or 10 bytes) to the reader (default 0) at MS for DUR ms\n"
+		"  --queue MS:COUNT:EVERY:DUR[@READER]\n"
+		"                       COUNT tags of unknown 4 byte UIDs held to the reader one after the other,\n"
+		"                       every EVERY ms from MS on, each for DUR ms\n"
+		"  --reader-reset MS[@READER]\n"
+		"                       brown-out of the RC522 at MS, it restarts with its reset values\n"
+		"  --uart-pty LINK      connect the USART to a new pty, LINK links to it; the firmware starts\n"
+		"                       once the other end has opened it (export_decode LINK, gateway LINK)\n"
+		"  --scenario FILE      read further options from FILE, one per line, without the dashes\n"
+		"  --trace              log LCD screens and scenario events\n",
+		argv0);
+	exit(2);
+}
+
+static void button_release(void *arg)
+{
+	(void)arg;
+	sim_pin_release(PORT_B, 2);
+}
+
+static void button_press(void *arg)
+{
+	(void)arg;
+	if (sim_trace)
+	{
+		sim_log("button pressed");
+	}
+	/* the button pulls PB2 low against its pull-up, INT2 fires on the rising edge */
+	sim_pin_drive(PORT_B, 2, 0);
+	sim_at(sim_now() + SIM_MS(150), button_release, NULL);
+}
+
+static void switch_set(void *arg)
+{
+	int level = (int)(intptr_t)arg;
+
+	if (sim_trace)
+	{
+		sim_log("database switch %s", level ? "on" : "off");
+	}
+	sim_pin_drive(PORT_C, 0, level);
+}
+
+/* the USART on a pty, the other end is a program such as host/export_decode */
+static int uart_fd = -1;
+static const char *uart_link;
+
+static void uart_transmit(void *ctx, uint8_t byte)
+{
+	struct pollfd p = { uart_fd, POLLOUT, 0 };
+
+	(void)ctx;
+	/* the pty holds a few KB, past that the other end is given time to read */
+	while (write(uart_fd, &byte, 1) != 1)
+	{
+		if (errno != EAGAIN || poll(&p, 1, 1000) <= 0)
+		{
+			sim_log("usart: the other end does not read, byte lost");
+			return;
+		}
+	}
+}
+
+static int uart_receive(void *ctx)
+{
+	uint8_t byte;
+
+	(void)ctx;
+	return read(uart_fd, &byte, 1) == 1 ? byte : -1;
+}
+
+static void uart_pty(const char *link)
+{
+	struct sim_uart_line line = { uart_transmit, uart_receive, NULL };
+	struct termios tio;
+
+	uart_fd = posix_openpt(O_RDWR | O_NOCTTY | O_NONBLOCK);
+	if (uart_fd < 0 || grantpt(uart_fd) != 0 || unlockpt(uart_fd) != 0 || tcgetattr(uart_fd, &tio) != 0)
+	{
+		perror("pty");
+		exit(1);
+	}
+	cfmakeraw(&tio);
+	tcsetattr(uart_fd, TCSANOW, &tio);
+	/* the master reports a hang-up from the first close of the other end until it is opened again */
+	close(open(ptsname(uart_fd), O_RDWR | O_NOCTTY));
+	unlink(link);
+	if (symlink(ptsname(uart_fd), link) != 0)
+	{
+		perror(link);
+		exit(1);
+	}
+	uart_link = link;
+	sim_uart_attach(&line);
+}
+
+/* virtual time runs far ahead of the other end: it is given up to 10 s to open the pty */
+static void uart_wait_connect(void)
+{
+	struct pollfd p = { uart_fd, POLLIN, 0 };
+
+	for (int i = 0; i < 1000; i++)
+	{
+		if (poll(&p, 1, 0) == 0 || !(p.revents & POLLHUP))
+		{
+			return;
+		}
+		usleep(10000);
+	}
+	fprintf(stderr, "%s: nobody opened it, starting anyway\n", uart_link);
+}
+
+/* what was sent is read before the pty goes away */
+static void uart_close(void)
+{
+	struct pollfd p = { uart_fd, POLLIN, 0 };
+
+	for (int i = 0; i < 500; i++)
+	{
+		if (poll(&p, 1, 0) > 0 && (p.revents & POLLHUP))
+		{
+			break;
+		}
+		usleep(10000);
+	}
+	unlink(uart_link);
+}
+
+static void scenario(const char *path, const char *argv0);
+
+static void readers_attach(int n)
+{
+	while (n_readers < n)
+	{
+		readers[n_readers] = mfrc522_model_attach(PORT_B, reader_ss[n_readers]);
+		mfrc522_model_irq(readers[n_readers], PORT_B, 0);
+		n_readers++;
+	}
+}
+
+/* the reader named by "@N" at the end of `value`, reader 0 without */
+static int reader_of(const char *value, const char *argv0)
+{
+	const char *at = strchr(value, '@');
+	int i = at ? atoi(at + 1) : 0;
+
+	if (i < 0 || i >= n_readers)
+	{
+		fprintf(stderr, "%s: no reader %d, see --readers\n", value, i);
+		usage(argv0);
+	}
+	return i;
+}
+
+/* a queue at the door: the UIDs D0 qq nn nn, qq the queue and nnnn the place in it, are not in any roster */
+static void queue(const char *value, const char *argv0)
+{
+	static uint8_t queues;
+	int reader = reader_of(value, argv0);
+	unsigned long long start, every, duration;
+	unsigned count;
+	uint8_t uid[4] = { 0xD0, queues++, 0x00, 0x00 };
+
+	if (sscanf(value, "%llu:%u:%llu:%llu", &start, &count, &every, &duration) != 4 || count > 0xFFFF)
+	{
+		usage(argv0);
+	}
+	for (unsigned i = 0; i < count; i++)
+	{
+		uid[2] = i >> 8;
+		uid[3] = i & 0xFF;
+		mfrc522_model_add_tag(readers[reader], uid, 4, 0x08, SIM_MS(start + i * every), SIM_MS(start + i * every + duration));
+	}
+}
+
+static void option(const char *name, const char *value, const char *argv0)
+{
+	unsigned long long ms;
+	int level;
+
+	if (!strcmp(name, "trace"))
+	{
+		sim_trace = 1;
+		return;
+	}
+	if (!value)
+	{
+		usage(argv0);
+	}
+	if (!strcmp(name, "run-ms"))
+	{
+		sim_run_limit = SIM_MS(strtoull(value, NULL, 0));
+	}
+	else if (!strcmp(name, "eeprom"))
+	{
+		sim_eeprom_path = strdup(value);
+	}
+	else if (!strcmp(name, "button"))
+	{
+		sim_at(SIM_MS(strtoull(value, NULL, 0)), button_press, NULL);
+	}
+	else if (!strcmp(name, "switch") && sscanf(value, "%llu:%d", &ms, &level) == 2)
+	{
+		sim_at(SIM_MS(ms), switch_set, (void *)(intptr_t)(level != 0));
+	}
+	else if (!strcmp(name, "readers"))
+	{
+		int n = atoi(value);
+
+		if (n < n_readers || n > MAX_READERS)
+		{
+			usage(argv0);
+		}
+		readers_attach(n);
+	}
+	else if (!strcmp(name, "tag"))
+	{
+		if (mfrc522_model_tag_option(readers[reader_of(value, argv0)], value) < 0)
+		{
+			usage(argv0);
+		}
+	}
+	else if (!strcmp(name, "queue"))
+	{
+		queue(value, argv0);
+	}
+	else if (!strcmp(name, "reader-reset"))
+	{
+		mfrc522_model_brownout(readers[reader_of(value, argv0)], SIM_MS(strtoull(value, NULL, 0)));
+	}
+	else if (!strcmp(name, "uart-pty"))
+	{
+		uart_pty(strdup(value));
+	}
+	else if (!strcmp(name, "scenario"))
+	{
+		scenario(value, argv0);
+	}
+	else
+	{
+		usage(argv0);
+	}
+}
+
+static void scenario(const char *path, const char *argv0)
+{
+	char line[256];
+	FILE *f = fopen(path, "r");
+
+	if (!f)
+	{
+		perror(path);
+		exit(2);
+	}
+	while (fgets(line, sizeof(line), f))
+	{
+		char *name = strtok(line, " \t\r\n");
+		char *value = strtok(NULL, " \t\r\n");
+
+		if (name && name[0] != '#')
+		{
+			option(name, value, argv0);
+		}
+	}
+	fclose(f);
+}
+
+int main(int argc, char **argv)
+{
+	/* the first RC522, --readers adds the others */
+	readers_attach(1);
+	for (int i = 1; i < argc; i++)
+	{
+		if (strncmp(argv[i], "--", 2) != 0)
+		{
+			usage(argv[0]);
+		}
+		if (!strcmp(argv[i], "--trace"))
+		{
+			option(argv[i] + 2, NULL, argv[0]);
+		}
+		else
+		{
+			option(argv[i] + 2, i + 1 < argc ? argv[i + 1] : NULL, argv[0]);
+			i++;
+		}
+	}
+
+	setvbuf(stdout, NULL, _IOLBF, 0);
+	if (uart_fd >= 0)
+	{
+		atexit(uart_close);
+		uart_wait_connect();
+	}
+	sim_start();
+	firmware_main();
+	sim_finish("main() returned");
+}
@@ -0,0 +1,288 @@
+/*
+ * journal.h
+ * Attendance journal: every tap is appended to a ring of records in the
+ * EEPROM. It holds the taps of the current day, history.h folds them into
+ * the history when the next day starts.
+ *
+ * A record is 6 bytes:
+ *   0		sequence number, one more than the record before (mod 256)
+ *   1-2	type (bits 15-14) and student or day number (bits 13-0)
+ *   3-4	seconds since the device was switched on
+ *   5		CRC-8 (CCITT) of bytes 0-4
+ * A new day is a JOURNAL_DAY record, the taps after it belong to that day:
+ * the day record is the generation of the taps that follow it. Starting a
+ * day appends that one record, nothing of the day before is cleared or
+ * rewritten, however many students there are.
+ * Records are written behind through eeprom_queue.h.
+ *
+ * The records of the current day are never overwritten: when a tap would
+ * leave no room for a copy of the day, the last entry of every student
+ * inside is copied ahead of the head, then a JOURNAL_DAY record of the same
+ * day whose time is the number of those copies. The day continues from the
+ * copies, the slots behind them can be reused. A copy cut short by a power
+ * loss only repeats taps after the old day record, they replay the same.
+ *
+ * The ring is written round and round, so every cell gets the same wear,
+ * and the oldest records are overwritten once it is full. There are fewer
+ * slots than sequence numbers, so the newest record is the one whose
+ * successor in the ring does not continue its sequence. A record torn by a
+ * power loss fails its CRC and ends the sequence one record earlier.
+ */
+#ifndef JOURNAL_H
+#define JOURNAL_H
+
+#include <stdint.h>
+#include <avr/eeprom.h>
+#include <util/crc16.h>
+#include "eeprom_queue.h"
+#include "presence.h"
+
+#define JOURNAL_RECORD		6
+//a day of taps and room to copy it forward: a copy of a full class and its
+//day record must fit beside it, the rest of the EEPROM keeps the compressed
+//history of the days before (history.h)
+#ifndef JOURNAL_SLOTS
+#define JOURNAL_SLOTS		(2 * ROSTER_SIZE + 8)
+#endif
+
+//the history leaves room for far fewer, 52 students (history.h)
+#if JOURNAL_SLOTS > 255
+#error "the journal counts its slots in a byte"
+#endif
+
+//record types, 0 is an empty slot
+#define JOURNAL_IN			1
+#define JOURNAL_OUT			2
+#define JOURNAL_DAY			3
+
+#define JOURNAL_VALUE_MAX	0x3FFF
+
+struct journal_record
+{
+	uint8_t seq;
+	uint8_t type;
+	uint16_t value;		//student for JOURNAL_IN/OUT, day for JOURNAL_DAY
+	uint16_t time;		//seconds
+};
+
+uint8_t EEMEM journal_ring[JOURNAL_SLOTS][JOURNAL_RECORD];
+
+//slot of the next record and its sequence number
+uint8_t journal_head;
+uint8_t journal_seq;
+//records in the ring, the oldest is journal_count slots behind the head
+uint8_t journal_count;
+//number of the day of the newest JOURNAL_DAY record, 0 before the first
+uint16_t journal_day;
+//records of the current day, copies and day record included, and who is inside
+uint8_t journal_span;
+uint8_t journal_inside[PRESENCE_BYTES(ROSTER_SIZE)];
+
+uint8_t journal_crc(const uint8_t *bytes)
+{
+	uint8_t crc = 0;
+	
+	for(uint8_t i = 0; i < JOURNAL_RECORD - 1; i++)
+	{
+		crc = _crc8_ccitt_update(crc, bytes[i]);
+	}
+	return crc;
+}
+
+//reads the record in `slot`, returns 0 for an empty or damaged slot
+uint8_t journal_read(uint8_t slot, struct journal_record *r)
+{
+	uint8_t bytes[JOURNAL_RECORD];
+	
+	//records still in the write queue first
+	eeprom_queue_flush();
+	eeprom_read_block(bytes, journal_ring[slot], JOURNAL_RECORD);
+	r->seq = bytes[0];
+	r->type = bytes[2] >> 6;
+	r->value = ((uint16_t)(bytes[2] & 0x3F) << 8) | bytes[1];
+	r->time = ((uint16_t)bytes[4] << 8) | bytes[3];
+	return r->type != 0 && journal_crc(bytes) == bytes[5];
+}
+
+//slot of the n-th record, 0 is the oldest
+uint8_t journal_slot(uint8_t n)
+{
+	uint16_t slot = (uint16_t)journal_head + JOURNAL_SLOTS - journal_count + n;
+	
+	return slot % JOURNAL_SLOTS;
+}
+
+//finds the newest record after power-up, the longest unbroken sequence wins
+//one pass over the ring, whatever the size of the class
+void journal_open(void)
+{
+	struct journal_record r;
+	uint8_t prev = 0, first = 0, run = 0, lead = 0, best = 0, newest = JOURNAL_SLOTS - 1;
+	
+	for(uint8_t slot = 0; slot < JOURNAL_SLOTS; slot++)
+	{
+		if(!journal_read(slot, &r))
+		{
+			run = 0;
+			continue;
+		}
+		if(run != 0 && r.seq == (uint8_t)(prev + 1))
+		{
+			run++;
+		}
+		else
+		{
+			run = 1;
+		}
+		if(slot == 0)
+		{
+			first = r.seq;
+		}
+		//the sequence that starts in slot 0
+		if(run == slot + 1)
+		{
+			lead = run;
+		}
+		prev = r.seq;
+		if(run > best)
+		{
+			best = run;
+			newest = slot;
+		}
+	}
+	//a sequence that runs over the end of the ring continues in slot 0
+	if(run != 0 && lead != 0 && lead < JOURNAL_SLOTS && first == (uint8_t)(prev + 1)
+		&& run + lead > best)
+	{
+		best = run + lead;
+		newest = lead - 1;
+	}
+	
+	journal_count = best;
+	journal_head = (newest + 1) % JOURNAL_SLOTS;
+	journal_seq = 0;
+	journal_day = 0;
+	if(best != 0)
+	{
+		journal_read(newest, &r);
+		journal_seq = r.seq + 1;
+	}
+	//the current day is the newest day record still in the ring
+	journal_span = journal_count;
+	presence_fill(journal_inside, ROSTER_SIZE, 0);
+	for(uint8_t n = journal_count; n-- > 0; )
+	{
+		journal_read(journal_slot(n), &r);
+		if(r.type == JOURNAL_DAY)
+		{
+			journal_day = r.value;
+			journal_span = journal_count - n + (r.time < n ? r.time : n);
+			break;
+		}
+	}
+	for(uint8_t n = journal_count - journal_span; n < journal_count; n++)
+	{
+		journal_read(journal_slot(n), &r);
+		if(r.value < ROSTER_SIZE && r.type == JOURNAL_IN)
+		{
+			presence_set(journal_inside, r.value);
+		}
+		else if(r.value < ROSTER_SIZE && r.type == JOURNAL_OUT)
+		{
+			presence_clear(journal_inside, r.value);
+		}
+	}
+}
+
+//first record of the current day, the oldest copy of a continued day
+uint8_t journal_first(void)
+{
+	return journal_count - journal_span;
+}
+
+//writes a record at the head, its 6 bytes are programmed by the EE_RDY interrupt
+void journal_write(uint8_t type, uint16_t value, uint16_t time)
+{
+	uint8_t bytes[JOURNAL_RECORD];
+	
+	bytes[0] = journal_seq;
+	bytes[1] = value & 0xFF;
+	bytes[2] = (type << 6) | ((value >> 8) & 0x3F);
+	bytes[3] = time & 0xFF;
+	bytes[4] = time >> 8;
+	bytes[5] = journal_crc(bytes);
+	eeprom_queue_write_block(bytes, journal_ring[journal_head], JOURNAL_RECORD);
+	
+	journal_head = (journal_head + 1) % JOURNAL_SLOTS;
+	journal_seq++;
+	if(journal_count < JOURNAL_SLOTS)
+	{
+		journal_count++;
+	}
+	if(journal_span < JOURNAL_SLOTS)
+	{
+		journal_span++;
+	}
+	if(type == JOURNAL_DAY)
+	{
+		journal_day = value;
+		journal_span = time + 1;
+	}
+}
+
+//copies the last entry of everyone inside ahead of the head and continues the
+//day from the copies; the tap waits for the EEPROM, once every few taps
+void journal_compact(void)
+{
+	struct journal_record r;
+	uint8_t copied[PRESENCE_BYTES(ROSTER_SIZE)];
+	uint8_t n = 0, slot = journal_head;
+	
+	presence_fill(copied, ROSTER_SIZE, 0);
+	//newest first: the newest record of a student inside is the last entry
+	for(uint8_t left = journal_span; left > 0; left--)
+	{
+		slot = (slot + JOURNAL_SLOTS - 1) % JOURNAL_SLOTS;
+		if(!journal_read(slot, &r) || r.type != JOURNAL_IN || r.value >= ROSTER_SIZE
+			|| !presence_test(journal_inside, r.value) || presence_test(copied, r.value))
+		{
+			continue;
+		}
+		presence_set(copied, r.value);
+		journal_write(JOURNAL_IN, r.value, r.time);
+		n++;
+	}
+	journal_write(JOURNAL_DAY, journal_day, n);
+}
+
+//appends a record, the records of the current day stay in the ring
+void journal_append(uint8_t type, uint16_t value, uint16_t time)
+{
+	if(type == JOURNAL_DAY)
+	{
+		presence_fill(journal_inside, ROSTER_SIZE, 0);
+	}
+	//room for this record, then for a copy of everyone inside and a day record
+	else if(journal_day != 0
+		&& JOURNAL_SLOTS - journal_span < presence_count(journal_inside, ROSTER_SIZE) + 3)
+	{
+		journal_compact();
+	}
+	journal_write(type, value, time);
+	if(value < ROSTER_SIZE && type == JOURNAL_IN)
+	{
+		presence_set(journal_inside, value);
+	}
+	else if(value < ROSTER_SIZE && type == JOURNAL_OUT)
+	{
+		presence_clear(journal_inside, value);
+	}
+}
+
+//starts the next day
+void journal_new_day(void)
+{
+	journal_append(JOURNAL_DAY, journal_day < JOURNAL_VALUE_MAX ? journal_day + 1 : 1, 0);
+}
+
+#endif /* JOURNAL_H */
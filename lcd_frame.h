@@ -0,0 +1,187 @@
+/*
+ * lcd_frame.h
+ * Shadow of the 16x2 LCD in RAM, sent to the LCD from the Timer2 interrupt.
+ *
+ * Screens are composed in lcd_frame with LCDFrameClear(), LCDFrameStringXY()
+ * and LCDFrameIntXY(), which only touch RAM, and handed over with LCDFlush(),
+ * which returns at once. The differences between lcd_frame and lcd_shown,
+ * what the LCD displays, are the queue: on every compare match of Timer2 the
+ * next cell that differs is sent, a byte per tick, and lcd_shown follows. The
+ * cursor is moved only where a changed cell does not follow the one written
+ * before, the LCD advances it by itself. A cell changed twice before it went
+ * out is sent once, a screen that did not change costs nothing.
+ *
+ * The ticks are as long as the LCD takes for a character or a cursor move, so
+ * the busy flag is never read. The count starts again after every byte: a
+ * match served late by other interrupts delays the next byte instead of
+ * shortening its gap. With interrupts off (at start-up, in an ISR)
+ * LCDFlush() sends the cells itself with the same pacing.
+ *
+ * Needs the LCD functions of my_header.h.
+ */
+#ifndef LCD_FRAME_H
+#define LCD_FRAME_H
+
+#include <stdint.h>
+#include <string.h>
+#include <avr/io.h>
+#include <avr/interrupt.h>
+#include <util/delay.h>
+
+#define LCD_COLS			16
+#define LCD_ROWS			2
+#define LCD_CELLS			(LCD_COLS * LCD_ROWS)
+
+//where the LCD writes the next character is not known
+#define LCD_CURSOR_UNKNOWN	0xFF
+
+//HD44780 execution time of a character or a cursor move is 37 us (41 us with the write), Timer2
+//ticks every 32 us; the count starts from 0 after a send, but its prescaler runs on and the
+//first tick can come at once, one tick more keeps the gap LCD_STEP_US or longer
+#define LCD_STEP_US			64
+#define LCD_TIMER_PRESCALE	((1<<CS21)|(1<<CS20))
+#define LCD_STEP_TICKS		(LCD_STEP_US / 32 + 1)
+
+char lcd_frame[LCD_ROWS][LCD_COLS];
+char lcd_shown[LCD_ROWS][LCD_COLS];
+//cell the LCD writes the next character to, row * LCD_COLS + column
+volatile uint8_t lcd_cursor = LCD_CURSOR_UNKNOWN;
+//set while a screen is composed, the half-done frame is not sent
+volatile uint8_t lcd_frame_hold;
+
+//a new screen starts empty and is held until LCDFlush()
+#define LCDFrameClear() do { lcd_frame_hold = 1; memset(lcd_frame, ' ', sizeof(lcd_frame)); } while(0)
+
+//clears the LCD once, then frame and shadow agree
+void LCDFrameInit(void)
+{
+	LCDClear();
+	memset(lcd_frame, ' ', sizeof(lcd_frame));
+	memset(lcd_shown, ' ', sizeof(lcd_shown));
+	lcd_cursor = 0;
+	lcd_frame_hold = 0;
+}
+
+//like LCDWriteStringXY(), cut at the end of the row
+void LCDFrameStringXY(uint8_t x, uint8_t y, const char *msg)
+{
+	while(*msg != '\0' && x < LCD_COLS)
+	{
+		lcd_frame[y][x++] = *msg++;
+	}
+}
+
+//like LCDWriteIntXY(): field_length digits with leading zeros, or all digits if it is -1
+void LCDFrameIntXY(uint8_t x, uint8_t y, unsigned int val, int8_t field_length)
+{
+	char digits[5];
+	int8_t n = 0;
+
+	do
+	{
+		digits[n++] = '0' + val % 10;
+		val /= 10;
+	}
+	while(val && n < 5);
+	if(field_length == -1)
+	{
+		field_length = n;
+	}
+	while(field_length > 0 && x < LCD_COLS)
+	{
+		field_length--;
+		lcd_frame[y][x++] = field_length < n ? digits[field_length] : '0';
+	}
+}
+
+//sends one byte toward the frame: the next changed cell, or the cursor move to it; 0 when the LCD shows the frame
+uint8_t LCDFrameStep(void)
+{
+	uint8_t cell, n;
+	char c;
+
+	if(lcd_frame_hold)
+	{
+		return 0;
+	}
+	//from the cursor on, a run of changed cells goes out without cursor moves
+	cell = lcd_cursor < LCD_CELLS ? lcd_cursor : 0;
+	for(n = 0; n < LCD_CELLS; n++)
+	{
+		c = lcd_frame[0][cell];
+		if(lcd_shown[0][cell] != c)
+		{
+			if(lcd_cursor != cell)
+			{
+				LCDSend(0b10000000 | ((cell / LCD_COLS) << 6) | (cell % LCD_COLS), 0);
+				lcd_cursor = cell;
+			}
+			else
+			{
+				LCDSend(c, 1);
+				lcd_shown[0][cell] = c;
+				//after the last column the LCD goes on into memory off the screen
+				lcd_cursor = (cell % LCD_COLS) + 1 < LCD_COLS ? cell + 1 : LCD_CURSOR_UNKNOWN;
+			}
+			return 1;
+		}
+		if(++cell == LCD_CELLS)
+		{
+			cell = 0;
+		}
+	}
+	return 0;
+}
+
+//one byte per tick until the LCD shows the frame, then Timer2 stops
+ISR(TIMER2_COMP_vect)
+{
+	if(!LCDFrameStep())
+	{
+		TIMSK &= ~(1<<OCIE2);
+		TCCR2 = 0;
+	}
+	else
+	{
+		//the next byte a whole step after this one, however late this match was served
+		TCNT2 = 0;
+		TIFR = (1<<OCF2);
+	}
+}
+
+//hands the frame over, returns at once with interrupts on
+void LCDFlush(void)
+{
+	lcd_frame_hold = 0;
+	if(SREG & (1<<SREG_I))
+	{
+		if(!(TIMSK & (1<<OCIE2)) && memcmp(lcd_frame, lcd_shown, LCD_CELLS) != 0)
+		{
+			//CTC, the first compare match LCD_STEP_US or more from now
+			TCNT2 = 0;
+			OCR2 = LCD_STEP_TICKS;
+			TIFR = (1<<OCF2);
+			TCCR2 = (1<<WGM21) | LCD_TIMER_PRESCALE;
+			TIMSK |= (1<<OCIE2);
+		}
+	}
+	else
+	{
+		//nobody else would send it
+		while(LCDFrameStep())
+		{
+			_delay_us(LCD_STEP_US);
+		}
+	}
+}
+
+//waits until the LCD shows the frame
+void LCDFlushWait(void)
+{
+	while(TIMSK & (1<<OCIE2))
+	{
+		;
+	}
+}
+
+#endif /* LCD_FRAME_H */
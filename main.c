@@ -13,6 +13,31 @@
 //16x2 LCD Alphanumeric Display and RFID-RC522 Reader Module with Atmega32
 #include "my_header.h"
 
+//students and the UIDs of their tags
+#include "roster.h"
+
+//who is inside, a bit per student
+#include "presence.h"
+
+//taps and days in the EEPROM
+#include "journal.h"
+
+//the days before today, compressed
+#include "history.h"
+
+//the database over the USART, for a PC
+#include "export.h"
+
+//the screens are composed in RAM, only what changed is sent to the LCD, from the Timer2 interrupt
+#include "lcd_frame.h"
+
+//timed tasks of the main loop instead of _delay_ms()
+#define SCHED_TASKS 3
+#include "sched.h"
+
+//the readers of the door, polled together: one, or a reader on either side
+#include "door.h"
+
 /***  We are simulating a classroom environment.  
 For this, we need to define the time periods.
 By default we allow students to enter for the first 1 minute (ENTRANCE_PERIOD_MINUTE).
@@ -26,16 +51,40 @@ If some could not get out, the buzzer will buzz of alarming everyone around.
 #define SESSION_PERIOD_MINUTE 1
 #define AWAIT_PERIOD_MINUTE 1
 
-/**Maximum number of students in a classroom**/
-#define  MAX_PEOPLE 3
+/*** The timetable of the day, the sessions in minutes since the device was switched on:
+SCHEDULE_SESSION(start, entrance, session, await). Between two sessions the reader is idle.
+A day of lectures would be for example
+	SCHEDULE_SESSION(0, 10, 50, 10), SCHEDULE_SESSION(70, 10, 50, 10), SCHEDULE_SESSION(140, 10, 80, 10)
+***/
+#define SCHEDULE SCHEDULE_SESSION(0, ENTRANCE_PERIOD_MINUTE, SESSION_PERIOD_MINUTE, AWAIT_PERIOD_MINUTE)
+#include "schedule.h"
+
+/**Maximum number of students in a classroom, the number of students in roster.csv**/
+#define  MAX_PEOPLE ROSTER_SIZE
+
+/**Maximum number of cards handled in one poll of a reader. With several readers one: the empty
+REQIDL after the last card would be waited out by the others, the next pass asks them all again at once**/
+#if DOOR_READERS == 1
+#define  MAX_TAGS 4
+#else
+#define  MAX_TAGS 1
+#endif
+
+/**Longest pause between two polls when no card came for a while, in ms. Cards are expected in the
+entrance and leaving periods; in the session a card is only warned about, it may wait a second**/
+#define  POLL_GAP_DOOR 200
+#define  POLL_GAP_SESSION 1000
 
-int program_status;
+volatile int program_status;
 
 // used for timer interrupts
-volatile double miliseconds;
-volatile int min;
-volatile int sec;
-volatile int hour;
+// Timer1 overflows every 65536 us, counted exactly in units of 64 us: 1024 per overflow, 15625 per second
+#define CLOCK_OVERFLOW_UNITS 1024
+#define CLOCK_SECOND_UNITS 15625
+volatile uint16_t clock_units;
+volatile uint8_t min;
+volatile uint8_t sec;
+volatile uint8_t hour;
 
 // used for LED animations
 volatile int sec_counter;
@@ -43,103 +92,20 @@ volatile uint8_t temp_PORTA;
 volatile int LED_animation_status;
 volatile int LED_animation_on;
 
-volatile int program_status_2_first_time;
-volatile int program_status_3_first_time;
-volatile int program_status_4_first_time;
 
 //used for EEPROM initialization
 int write_enable_eeprom = 1;
 int write_enable_update_name_eeprom = 1;
 int write_enable_update_date_count_eeprom = 1;
 int write_enable_update_date_first_time_eeprom = 1;
-uint8_t   EEMEM  NonVolatileDayCount = 0;
-uint8_t   EEMEM  NonVolatileHour[6][MAX_PEOPLE];
-uint8_t   EEMEM  NonVolatileMinute[6][MAX_PEOPLE];
-uint8_t   EEMEM  NonVolatileSecond[6][MAX_PEOPLE];
-uint8_t   EEMEM  NonVolatileIsPresent[6][MAX_PEOPLE];
-uint8_t   EEMEM  NonVolatileName[MAX_PEOPLE][10] ={"Sibat", "Ripon", "Nimi"};
-volatile uint8_t		curr_day;
-
-//To begin database display mode
+//the attendance itself is in the journal (journal.h) and the history (history.h)
+
+//To begin database display mode: the button only asks, the main loop shows the pages (view_poll())
+volatile uint8_t view_button;
+
 ISR(INT2_vect)
 {
-	GIFR |= (1<<INTF2);
-	_delay_ms(500); // Software debouncing control
-		
-	//database showing is enabled only if DPDT push switch is pressed	
-	if((PINC & 0x01) == 0x01) {
-		LCDClear();
-		LCDWriteStringXY(0,0,"Loading database");
-		LCDWriteStringXY(0,1,"Please wait...");
-		_delay_ms(1000);
-	
-		for(int day_i=1; day_i<= curr_day; day_i++){
-			//show read day count
-			LCDClear();
-			LCDWriteStringXY(0, 0, "Showing Data of");
-			LCDWriteStringXY(0, 1, "Day: ");
-			LCDWriteIntXY(6, 1, day_i, 1);
-			_delay_ms(1600);
-			
-			uint8_t eeprom_read_string [MAX_PEOPLE][10];
-			int stdCounter = 0;
-			for(int i=0 ; i<MAX_PEOPLE; i++){
-				uint8_t  NonVolatileIsPresentRead  = eeprom_read_byte (& NonVolatileIsPresent[day_i][i]);
-				if (NonVolatileIsPresentRead == 1){
-					stdCounter++;
-					eeprom_read_block ((void*) eeprom_read_string[i] , (const	void *) NonVolatileName[i] , 10);
-					uint8_t  read_hour = eeprom_read_byte (&NonVolatileHour[day_i][i] );
-					uint8_t  read_min = eeprom_read_byte (&NonVolatileMinute[day_i][i] );
-					uint8_t  read_sec = eeprom_read_byte (&NonVolatileSecond[day_i][i] );
-					
-					//show "at time"
-					LCDClear();
-					LCDWriteStringXY(0, 0,"At ");
-					LCDWriteIntXY(3, 0, read_hour, 2);
-					LCDWriteStringXY(5, 0,":");
-					LCDWriteIntXY(6, 0,  read_min, 2);
-					LCDWriteStringXY(8, 0,":");
-					LCDWriteIntXY(9,0,  read_sec, 2);
-					//show who
-					LCDWriteIntXY(0, 1, stdCounter, 2);
-					LCDWriteStringXY(2, 1, ".");
-					LCDWriteStringXY(3, 1, eeprom_read_string[i]);
-					LCDWriteStringXY(10, 1, " in");
-					_delay_ms(3000);
-				}
-			}
-			//show total present
-			LCDClear();
-			LCDWriteStringXY(0, 0, "Total Present:");
-			LCDWriteIntXY(0, 1, stdCounter, 2);
-			_delay_ms(2000);	
-		}
-		
-		LCDClear();
-		LCDWriteStringXY(0,0,"Exiting database");
-		LCDWriteStringXY(0,1,"Please wait...");
-		_delay_ms(2000);
-		LCDClear();
-	}else{
-		//when dpdt is off
-		LCDClear();
-		LCDWriteStringXY(0,0,"Current Time:");
-		LCDWriteIntXY(0,1, hour, 2);
-		LCDWriteStringXY(2, 1,":");
-		LCDWriteIntXY(3, 1, min, 2);
-		LCDWriteStringXY(5,1,":");
-		LCDWriteIntXY(6,1, sec, 2);
-		LCDWriteStringXY(9, 1, ", Day ");
-		LCDWriteIntXY(14, 1, curr_day, 1);
-		_delay_ms(2000);
-		LCDClear();
-	}
-	
-	DDRC |= (1<<PC0);//Makes first pin of PORTC as Output
-	PORTC &= ~(1<<PC0);
-	DDRC &= ~(1<<PC0);//Makes first pin of PORTC as Input
-	
-	GIFR |= (1<<INTF2); // clear interrupt flag -> before adding this, this ISR was being executed twice in a row
+	view_button = 1;
 }
 
 
@@ -170,83 +136,506 @@ void animate_LED()
 }
 
 
-/**For time calculation**/
-void add_milisecond(float ms)
+/**For time calculation, once a second**/
+void add_second()
 {
-	miliseconds += ms;
-	if(miliseconds >= 1000)
-	{
-		sec++;
-		animate_LED();
-		miliseconds -= 1000;
-	}
+	sec++;
+	animate_LED();
 	if(sec == 60)
 	{
 		min++;
 		sec = 0;
+		if(min == 60)
+		{
+			min = 0;
+			hour++;
+		}
+		//the phases are whole minutes, only the next one is compared
+		schedule_minute();
 	}
-	if(min == 60)
+}
+
+//integer only, the seconds and the phases are handled once a second
+ISR(TIMER1_OVF_vect)
+{
+	sched_overflows++;
+	clock_units += CLOCK_OVERFLOW_UNITS;
+	if(clock_units >= CLOCK_SECOND_UNITS)
 	{
-		min = 0;
-		hour++;
+		clock_units -= CLOCK_SECOND_UNITS;
+		add_second();
 	}
 }
 
-/**To determine which state or phase the classroom is in**/
-void calculate_program_state()
+/**Time of a tap: seconds since the device was switched on**/
+uint16_t tap_time()
 {
-	int current_time = hour * 60 + min;
-	if(current_time >= ENTRANCE_PERIOD_MINUTE)
+	uint8_t sreg, h, m, s;
+	
+	//a snapshot, the second may not roll over between the three reads
+	sreg = SREG;
+	cli();
+	h = hour;
+	m = min;
+	s = sec;
+	SREG = sreg;
+	return h * 3600U + m * 60U + s;
+}
+
+/** The messages, LEDs and buzzer of the taps. They play one after the other from the scheduler
+while the reader keeps polling, the taps read in the meantime wait in the queue. **/
+#define TASK_FEEDBACK 0
+
+//taps waiting for their messages, a power of 2
+#define FEEDBACK_QUEUE 8
+
+//what a tap shows
+#define FEEDBACK_DENIED		0	//unknown card at the entrance
+#define FEEDBACK_ENTERED	1
+#define FEEDBACK_LEFT		2
+#define FEEDBACK_WARNING	3	//card during the session
+#define FEEDBACK_UNKNOWN	4	//unknown card after the session
+#define FEEDBACK_GOODBYE	5	//left after the session
+#define FEEDBACK_ERROR		6	//a card answered but could not be read
+
+struct feedback
+{
+	uint8_t kind;
+	int16_t person;
+};
+
+struct feedback feedback_queue[FEEDBACK_QUEUE];
+uint8_t feedback_head;
+uint8_t feedback_count;
+uint8_t feedback_step;		//of the feedback at the head
+char feedback_msg[32];
+
+//a message on the first row
+void feedback_show(const char *msg)
+{
+	LCDFrameClear();
+	LCDFrameStringXY(0, 0, msg);
+	LCDFlush();
+}
+
+//the name of the student and a message behind it
+void feedback_show_name(int16_t person, const char *msg)
+{
+	strcpy_P(feedback_msg, roster_name(person));
+	strcat(feedback_msg, msg);
+	feedback_show(feedback_msg);
+}
+
+//step `step` of a feedback, returns how many ms it lasts, 0 after the last step
+uint16_t feedback_play(struct feedback *f, uint8_t step)
+{
+	switch(f->kind)
 	{
-		program_status = 2;
-		if(program_status_2_first_time == 1)
-		{
-			PORTA = 0xFB;
-			temp_PORTA = PORTA;
-			program_status_2_first_time = 0;
-		}
+		case FEEDBACK_DENIED:
+			switch(step)
+			{
+				case 0: PORTA = 0x7E; feedback_show("Access denied!"); return 2000;
+				case 1: PORTA = 0xFE; feedback_show("Unrecognized!"); return 3000;
+			}
+			break;
+		case FEEDBACK_ENTERED:
+			//buzzer twice when a student is entering
+			switch(step)
+			{
+				case 0: PORTA = 0xFD; feedback_show("Access granted!"); return 2000;
+				case 1: PORTA = 0x7D; return 200;
+				case 2: PORTA = 0xFD; return 100;
+				case 3: PORTA = 0x7D; return 200;
+				case 4: PORTA = 0xFD; feedback_show_name(f->person, " entered"); return 3000;
+			}
+			break;
+		case FEEDBACK_LEFT:
+			//buzzer once when a student is leaving
+			switch(step)
+			{
+				case 0: PORTA = 0xFD; feedback_show("Access granted!"); return 2000;
+				case 1: PORTA = 0x7D; return 200;
+				case 2: PORTA = 0xFD; feedback_show_name(f->person, " left"); return 3000;
+			}
+			break;
+		case FEEDBACK_WARNING:
+			switch(step)
+			{
+				case 0: PORTA = 0x7E; feedback_show("Warning!!"); return 2000;
+				case 1: feedback_show("Session running."); return 2000;
+				case 2: PORTA = 0xFE; feedback_show("Can't go out/in."); return 2000;
+			}
+			break;
+		case FEEDBACK_UNKNOWN:
+			switch(step)
+			{
+				case 0: PORTA = 0x7E; feedback_show("Unrecognized!"); return 2000;
+				case 1: PORTA = 0xFE; return 3000;
+			}
+			break;
+		case FEEDBACK_GOODBYE:
+			switch(step)
+			{
+				case 0:
+					PORTA = 0xFB;
+					strcpy(feedback_msg, "Take care ");
+					strcat_P(feedback_msg, roster_name(f->person));
+					feedback_show(feedback_msg);
+					return 1000;
+				case 1: feedback_show_name(f->person, " left"); return 3000;
+			}
+			break;
+		case FEEDBACK_ERROR:
+			switch(step)
+			{
+				case 0:
+					PORTA = 0x7E;
+					LCDFrameClear();
+					LCDFrameStringXY(0, 1, "Error");
+					LCDFlush();
+					return 2000;
+			}
+			break;
 	}
-	if(current_time >= ENTRANCE_PERIOD_MINUTE + SESSION_PERIOD_MINUTE)
+	return 0;
+}
+
+//plays the queue, a step at a time, and asks the scheduler to be called back for the next one
+void feedback_run()
+{
+	uint16_t ms;
+	
+	while(feedback_count != 0)
 	{
-		program_status = 3;
-		if(program_status_3_first_time == 1)
+		LED_animation_on = 0;
+		ms = feedback_play(&feedback_queue[feedback_head], feedback_step++);
+		if(ms != 0)
 		{
-			PORTA = 0xFD;
-			temp_PORTA = PORTA;
-			program_status_3_first_time = 0;
+			sched_after(TASK_FEEDBACK, ms, feedback_run);
+			return;
 		}
+		feedback_head = (feedback_head + 1) & (FEEDBACK_QUEUE - 1);
+		feedback_count--;
+		feedback_step = 0;
+	}
+	//back to the colour of the phase, the main loop draws its screen again
+	PORTA = program_status == 1 ? 0xFE : program_status == 2 ? 0xFB : 0xFD;
+	LED_animation_on = 1;
+}
+
+void feedback_push(uint8_t kind, int16_t person)
+{
+	//the attendance is taken anyway, only the message is lost
+	if(feedback_count == FEEDBACK_QUEUE)
+	{
+		return;
+	}
+	feedback_queue[(feedback_head + feedback_count) & (FEEDBACK_QUEUE - 1)].kind = kind;
+	feedback_queue[(feedback_head + feedback_count) & (FEEDBACK_QUEUE - 1)].person = person;
+	feedback_count++;
+	if(!sched_waiting(TASK_FEEDBACK))
+	{
+		feedback_run();
+	}
+}
+
+//drops the queue and the message on the way, the LEDs go back to the animation
+void feedback_clear()
+{
+	sched_cancel(TASK_FEEDBACK);
+	feedback_head = 0;
+	feedback_count = 0;
+	feedback_step = 0;
+	LED_animation_on = 1;
+}
+
+/** The check after the leaving period: students still inside raise the alarm, their count, their
+names one after the other and a caution, over and over until the next phase. A page at a time, the
+main loop goes on between them. **/
+#define TASK_CHECK 2
+
+#define CHECK_COUNT		0
+#define CHECK_NAMES		1
+#define CHECK_CAUTION	2
+#define CHECK_PAUSE		3
+
+const uint8_t *check_inside;
+uint8_t check_step;
+uint16_t check_person;		//shown next
+
+//one page of the alarm, then it asks to be called back for the next one
+void check_run()
+{
+	uint16_t ms = 1500;
+	
+	switch(check_step)
+	{
+		case CHECK_COUNT:
+			LED_animation_on = 0;
+			PORTA = 0x7E;
+			LCDFrameClear();
+			LCDFrameIntXY(0,0, presence_count(check_inside, MAX_PEOPLE) ,2 );
+			LCDFrameStringXY(3, 0, "student could");
+			LCDFrameStringXY(0, 1, "not get out");
+			LCDFlush();
+			check_person = presence_next(check_inside, MAX_PEOPLE, 0);
+			check_step = check_person != PRESENCE_END ? CHECK_NAMES : CHECK_CAUTION;
+			break;
+		case CHECK_NAMES:
+			//who is still inside
+			LCDFrameClear();
+			strcpy_P(feedback_msg, roster_name(check_person));
+			LCDFrameStringXY(0, 0, feedback_msg);
+			LCDFrameStringXY(0, 1, "is still inside");
+			LCDFlush();
+			check_person = presence_next(check_inside, MAX_PEOPLE, check_person + 1);
+			if(check_person == PRESENCE_END)
+			{
+				check_step = CHECK_CAUTION;
+			}
+			break;
+		case CHECK_CAUTION:
+			feedback_show("Take caution!");
+			check_step = CHECK_PAUSE;
+			break;
+		default:
+			PORTA = 0xFE;
+			ms = 400;
+			check_step = CHECK_COUNT;
+			break;
 	}
-	if(current_time >= ENTRANCE_PERIOD_MINUTE + SESSION_PERIOD_MINUTE + AWAIT_PERIOD_MINUTE)
+	sched_after(TASK_CHECK, ms, check_run);
+}
+
+//starts the alarm for the students of `inside`, the messages of the last taps give way
+void check_start(const uint8_t *inside)
+{
+	feedback_clear();
+	check_inside = inside;
+	check_step = CHECK_COUNT;
+	check_run();
+}
+
+//a new phase ends the alarm
+void check_stop()
+{
+	if(sched_waiting(TASK_CHECK))
+	{
+		sched_cancel(TASK_CHECK);
+		LED_animation_on = 1;
+	}
+}
+
+/** The push button: the time, or with the DPDT switch on the attendance of every day in the
+EEPROM. A page at a time is composed in the main loop while the reader and the clock go on; a page
+turns by itself after a while or at the next press. A day is unpacked only when its students are
+shown, the totals come from the summaries of the history. **/
+#define TASK_VIEW 1
+
+//presses closer than this are the bounce of one press
+#define VIEW_DEBOUNCE_MS 300
+
+#define VIEW_OFF		0
+#define VIEW_CLOCK		1	//current time, DPDT switch off
+#define VIEW_LOADING	2	//the database starts
+#define VIEW_DAY		3
+#define VIEW_STUDENT	4	//who came in and when
+#define VIEW_TOTAL		5
+#define VIEW_EXIT		6
+
+//how long a page stays, by page
+const uint16_t view_page_ms[] = { 0, 2000, 1000, 1600, 3000, 2000, 2000 };
+
+uint8_t view_page;
+uint16_t view_day;
+uint8_t view_total;
+uint16_t view_student;		//roster index
+uint8_t view_number;		//of the student on the day's list, from 1
+uint8_t view_present[PRESENCE_BYTES(MAX_PEOPLE)];
+uint8_t view_arrival[MAX_PEOPLE];
+uint32_t view_pressed;		//tick of the last press
+char view_name[ROSTER_NAME_LEN];
+
+//the first day from `day` on that has data, its total in view_total; 0 if there is none
+uint16_t view_find_day(uint16_t day)
+{
+	for(; day <= journal_day && day != 0; day++)
 	{
-		program_status = 4;
-		if(program_status_3_first_time == 1)
+		if(day < journal_day)
 		{
-			PORTA = 0xFB;
-			temp_PORTA = PORTA;
-			program_status_3_first_time = 0;
+			view_total = history_total(day);
+			if(view_total != HISTORY_TOTAL_UNKNOWN)
+			{
+				return day;
+			}
+		}
+		else if(history_replay_journal(view_present, view_arrival))
+		{
+			//today is still in the journal
+			view_total = presence_count(view_present, MAX_PEOPLE);
+			return day;
 		}
 	}
+	return 0;
 }
 
+//the page after the one shown, from the scheduler or a press
+void view_next()
+{
+	switch(view_page)
+	{
+		case VIEW_LOADING:
+			view_day = view_find_day(history.count ? history.first_day : journal_day);
+			view_page = view_day != 0 ? VIEW_DAY : VIEW_EXIT;
+			break;
+		case VIEW_DAY:
+			view_page = VIEW_TOTAL;
+			if(view_total != 0)
+			{
+				//the records of the day, only now
+				if(view_day < journal_day)
+				{
+					history_day(view_day, view_present, view_arrival);
+				}
+				else
+				{
+					history_replay_journal(view_present, view_arrival);
+				}
+				view_student = presence_next(view_present, MAX_PEOPLE, 0);
+				view_number = 1;
+				if(view_student != PRESENCE_END)
+				{
+					view_page = VIEW_STUDENT;
+				}
+			}
+			break;
+		case VIEW_STUDENT:
+			view_student = presence_next(view_present, MAX_PEOPLE, view_student + 1);
+			view_number++;
+			if(view_student == PRESENCE_END)
+			{
+				view_page = VIEW_TOTAL;
+			}
+			break;
+		case VIEW_TOTAL:
+			view_day = view_find_day(view_day + 1);
+			view_page = view_day != 0 ? VIEW_DAY : VIEW_EXIT;
+			break;
+		default:
+			view_page = VIEW_OFF;
+			break;
+	}
+	
+	if(view_page == VIEW_OFF)
+	{
+		sched_cancel(TASK_VIEW);
+		DDRC |= (1<<PC0);//Makes first pin of PORTC as Output
+		PORTC &= ~(1<<PC0);
+		DDRC &= ~(1<<PC0);//Makes first pin of PORTC as Input
+		return;
+	}
+	sched_after(TASK_VIEW, view_page_ms[view_page], view_next);
+}
 
-ISR(TIMER1_OVF_vect)
+//the page shown, composed again on every pass so the time goes on
+void view_show()
 {
-	add_milisecond(65.536);
-	calculate_program_state();
+	uint16_t read_time;
+	
+	LCDFrameClear();
+	switch(view_page)
+	{
+		case VIEW_CLOCK:
+			LCDFrameStringXY(0,0,"Current Time:");
+			LCDFrameIntXY(0,1, hour, 2);
+			LCDFrameStringXY(2, 1,":");
+			LCDFrameIntXY(3, 1, min, 2);
+			LCDFrameStringXY(5,1,":");
+			LCDFrameIntXY(6,1, sec, 2);
+			LCDFrameStringXY(9, 1, ", Day ");
+			LCDFrameIntXY(14, 1, journal_day, -1);
+			break;
+		case VIEW_LOADING:
+			LCDFrameStringXY(0,0,"Loading database");
+			LCDFrameStringXY(0,1,"Please wait...");
+			break;
+		case VIEW_DAY:
+			LCDFrameStringXY(0, 0, "Showing Data of");
+			LCDFrameStringXY(0, 1, "Day: ");
+			LCDFrameIntXY(6, 1, view_day, -1);
+			break;
+		case VIEW_STUDENT:
+			//"at time"
+			read_time = view_arrival[view_student] * HISTORY_ARRIVAL_UNIT;
+			LCDFrameStringXY(0, 0,"At ");
+			LCDFrameIntXY(3, 0, read_time / 3600, 2);
+			LCDFrameStringXY(5, 0,":");
+			LCDFrameIntXY(6, 0, (read_time / 60) % 60, 2);
+			LCDFrameStringXY(8, 0,":");
+			LCDFrameIntXY(9,0, read_time % 60, 2);
+			//the latest arrival a byte holds, the student came then or later
+			if(view_arrival[view_student] == HISTORY_ARRIVAL_MAX)
+			{
+				LCDFrameStringXY(11, 0, "+");
+			}
+			//who
+			strcpy_P(view_name, roster_name(view_student));
+			LCDFrameIntXY(0, 1, view_number, 2);
+			LCDFrameStringXY(2, 1, ".");
+			LCDFrameStringXY(3, 1, view_name);
+			LCDFrameStringXY(10, 1, " in");
+			break;
+		case VIEW_TOTAL:
+			LCDFrameStringXY(0, 0, "Total Present:");
+			LCDFrameIntXY(0, 1, view_total, 2);
+			break;
+		default:
+			LCDFrameStringXY(0,0,"Exiting database");
+			LCDFrameStringXY(0,1,"Please wait...");
+			break;
+	}
+	LCDFlush();
+}
+
+//a press starts the view or turns the page; the messages of the taps go first on the screen
+void view_poll()
+{
+	uint32_t now;
+	
+	if(view_button)
+	{
+		view_button = 0;
+		now = sched_now();
+		if(now - view_pressed >= SCHED_MS(VIEW_DEBOUNCE_MS))
+		{
+			view_pressed = now;
+			if(view_page == VIEW_OFF)
+			{
+				//database showing is enabled only if DPDT push switch is pressed
+				view_page = (PINC & 0x01) == 0x01 ? VIEW_LOADING : VIEW_CLOCK;
+				sched_after(TASK_VIEW, view_page_ms[view_page], view_next);
+			}
+			else
+			{
+				view_next();
+			}
+		}
+	}
+	if(view_page != VIEW_OFF && feedback_count == 0)
+	{
+		view_show();
+	}
 }
 
 //some more initialization of EEPROM
 void increase_day_count_eeprom(){
-	curr_day = eeprom_read_byte (& NonVolatileDayCount);
-	curr_day++;
-	if(curr_day>5){
-		curr_day = 1;
-	}
+	//find the end of the journal, then every power-up is a new day
+	//the taps of the day before are folded into the history first
+	journal_open();
+	history_open();
 	if(write_enable_update_date_count_eeprom){
-		eeprom_update_byte ((uint8_t*) (&NonVolatileDayCount), curr_day);
-	}
-	for(int i=0;i<MAX_PEOPLE;i++){
-		eeprom_update_byte ((uint8_t*) (&NonVolatileIsPresent[curr_day][i]), 0);
+		history_close_day();
+		journal_new_day();
 	}
 }
 
@@ -256,72 +645,71 @@ int main()
 	increase_day_count_eeprom();	//some more initialization of EEPROM
 	
 	/*** Students list ***/
-	/** These are the bytes that are read from the RFID tags of the students**/
-	uint8_t person_byte[MAX_PEOPLE][5] = {
-		{0x23, 0x6D, 0xD6, 0x00, 0x98} , 
-		{0xF9, 0x46, 0x1D, 0x00, 0xA2}, 
-		{0xA3, 0x7E, 0x30, 0x02, 0xEF}
-		
-	};
-	
-	//Some tags that we used to experiment
-	//{0xF9, 0x46, 0x1D, 0x00, 0xA2}
-	//{0x23, 0x6D, 0xD6, 0x00, 0x98} - recognized1
-	//{0xF9, 0x46, 0x1D, 0x00, 0xA2} - recognized2 (change any bit in any of these 2 to see effect of unrecognized person entering)
-	//{0xA3, 0x7E, 0x30, 0x02, 0xEF} - Nimi - white
-	//{0x5B, 0xA8, 0x2C, 0x00, 0xDF} - Adnan - blue
+	/** The UIDs and names of the students are in the roster in flash, compiled from roster.csv **/
 		
 	// person name list .. these used to control people names etc
 	int detected_person;
-	int person_entry_list[MAX_PEOPLE] = {0, 0, 0};
-	char *person_name[MAX_LEN] = { (char *)"Sibat", (char *)"Ripon" , (char *)"Nimi" };
-	char *entered_msg = (char *)" entered";
-	char *left_msg = (char *)" left";
-	char msg_to_show[100];
-	int person_count = 0;
+	uint8_t inside[PRESENCE_BYTES(MAX_PEOPLE)];
+	int flushed_status = 1;
+	uint8_t everyone_left = 0;
 	
-	// iterator and byte array to use later
-	uint8_t byte, i;
-	uint8_t str[MAX_LEN];
+	// the reader of the door that saw the cards of a poll
+	struct door_reader *reader;
+	
+	// nobody is inside before the class
+	presence_fill(inside, MAX_PEOPLE, 0);
+	
+	// cards found in one poll
+	struct mfrc522_uid tags[MAX_TAGS];
+	uint8_t tag_i, tag_count;
+	//time of the tap, the journal and the export get the same second
+	uint16_t tapped;
 	_delay_ms(50);
 	
-	// initialize the LCD
+	// initialize the LCD, the screens are composed in its shadow (lcd_frame.h)
 	LCDInit(LS_BLINK);
-	LCDWriteStringXY(2,0,"RFID Reader");
+	LCDFrameInit();
+	LCDFrameStringXY(2,0,"RFID Reader");
+	LCDFlush();
+	
+	// the USART waits for the export command of a PC
+	export_init();
 	
 	// spi initialization
 	spi_init();
 	_delay_ms(1000);
-	LCDClear();
+	LCDFrameClear();
 	
-	//init reader
-	mfrc522_init();
+	//init readers
+	door_init();
 	
-	// poll until reader is found
+	// poll until every reader is found
 	while(1)
 	{
-		byte = mfrc522_read(VersionReg);
-		if(byte == 0x92)
+		if(door_detect())
 		{
-			LCDClear();
-			LCDWriteStringXY(2,0,"Detected");
+			LCDFrameClear();
+			LCDFrameStringXY(2,0,"Detected");
+			LCDFlush();
 			_delay_ms(1000);
 			break;
 		}
 		else
 		{
-			LCDClear();
-			LCDWriteStringXY(0,0,"No reader found");
+			LCDFrameClear();
+			LCDFrameStringXY(0,0,"No reader found");
+			LCDFlush();
 			_delay_ms(800);
-			LCDClear();
-			LCDWriteStringXY(0, 0, "Connect reader");
+			LCDFrameClear();
+			LCDFrameStringXY(0, 0, "Connect reader");
+			LCDFlush();
 			_delay_ms(1000);
 		}
 	}
 	
 	// ready to run
 	_delay_ms(1500);
-	LCDClear();
+	LCDFrameClear();
 	
 	// initializing the RGB LEDs
 	DDRA = 0xFF;
@@ -329,7 +717,7 @@ int main()
 	
 	
 	//Interrupt INT2
-	DDRB |= (1<<PB2);		// Set PB2 as input (Using for interrupt INT2)
+	DDRB &= ~(1<<PB2);		// Set PB2 as input (Using for interrupt INT2)
 	PORTB |= (1<<PB2);		// Enable PB2 pull-up resistor
 	
 	// setting up the timer codes
@@ -337,24 +725,26 @@ int main()
 	// TODO timer code ... START HERE ...
 	TCCR1A = 0x00;
 	TCCR1B = 0x01;
-	TIMSK = 0x04;
+	TIMSK |= (1<<TOIE1);	// keep the RC522 IRQ interrupts enabled by mfrc522_init
 	min = 0;
 	sec = 0;
 	hour = 0;
+	clock_units = 0;
 	sec_counter = 0;
 	LED_animation_status = 0;
 	LED_animation_on = 1;
-	program_status_2_first_time = 1;
-	program_status_3_first_time = 1;
-	program_status_4_first_time = 1;
 	
 	// TODO timer code ... ENDS  HERE ...
 	
 	// The loop starts here
-	// program status : 1 means entrance period
+	// program status : 0 means no session
+	//				  : 1 means entrance period
 	//				  : 2 means session period
 	//				  : 3 means session ended
-	program_status = 1;
+	//				  : 4 means the check that everyone left
+	// the timetable sets it, the first session at minute 0 starts at once
+	program_status = 0;
+	schedule_start();
 	
 	//Using interrupt 2 for reading history mode
 	GICR &= ~(1<<INT2);		// Disable INT2
@@ -365,254 +755,206 @@ int main()
 	sei();
 	while(1)
 	{
-		spi_init();
-		mfrc522_init();
-		byte = mfrc522_read(ComIEnReg);
-		mfrc522_write(ComIEnReg,byte|0x20);
-		byte = mfrc522_read(DivIEnReg);
-		mfrc522_write(DivIEnReg,byte|0x80);
+		// the readers keep running between polls, one is only re-initialized after a fault
+		door_session();
+		
+		// the messages of the taps and the pages of the push button go on
+		sched_run();
+		view_poll();
+		export_poll();
+		
+		// the next phase of the timetable
+		if(schedule_due)
+		{
+			program_status = schedule_take();
+			check_stop();
+			if(program_status == 1)
+			{
+				//a new session, nobody inside
+				presence_fill(inside, MAX_PEOPLE, 0);
+				everyone_left = 0;
+				PORTA = 0xFE;
+			}
+			else if(program_status == 3)
+			{
+				PORTA = 0xFD;
+			}
+			else
+			{
+				PORTA = 0xFB;
+			}
+			temp_PORTA = PORTA;
+		}
+		
+		// the taps of a phase are in the EEPROM before the next phase starts
+		if(program_status != flushed_status)
+		{
+			eeprom_queue_flush();
+			flushed_status = program_status;
+		}
 		
 		if(program_status == 1)
 		{
-			LCDClear();
-			LCDWriteStringXY(0, 0, "Show your card.");
-			LCDWriteStringXY(0, 1, "#students:");
-			LCDWriteIntXY(12,1, person_count ,2 );
+			//the cards answer while the screen is composed, only the cells that changed reach the LCD
+			door_poll_start(POLL_GAP_DOOR);
+			if(feedback_count == 0 && view_page == VIEW_OFF)
+			{
+				LCDFrameClear();
+				LCDFrameStringXY(0, 0, "Show your card.");
+				LCDFrameStringXY(0, 1, "#students:");
+				LCDFrameIntXY(12,1, presence_count(inside, MAX_PEOPLE) ,2 );
+				LCDFlush();
+			}
 			
-			byte = mfrc522_request(PICC_REQALL,str);
-			if(byte == CARD_FOUND)
+			while((reader = door_poll_next()) != NULL)
 			{
-				byte = mfrc522_get_card_serial(str);
-				if(byte == CARD_FOUND)
+				//every card in the field, a queue at the door gets through in one pass
+				//the attendance is taken at once, the messages follow one after the other
+				tag_count = mfrc522_inventory(&reader->rc, tags, MAX_TAGS);
+				for(tag_i = 0; tag_i < tag_count; tag_i++)
 				{
-					LED_animation_on = 0;
+					// look the card up in the roster
+					detected_person = roster_lookup(&tags[tag_i]);
+					tapped = tap_time();
 					
-					// check for person 1
-					detected_person = -1;
-					for(i = 0; i < MAX_PEOPLE; i++)
+					if(detected_person == ROSTER_NONE)
 					{
-						for(byte = 0; byte < 5; byte++)
-						{
-							/***The following piece of code was written to test and read the bytes off the tags and print them***/
-							//LCDClear();
-							//LCDWriteIntXY(0,0,byte,2);
-							//LCDWriteIntXY(0,1,str[byte],14);
-							//_delay_ms(3000);
-							
-							if(str[byte] != person_byte[i][byte])
-							{
-								break;
-							}
-						}
-						if(byte == 5)
-						{
-							detected_person = i;
-							break;
-						}
+						export_tap(EXPORT_TAP_DENIED, ROSTER_NONE, presence_count(inside, MAX_PEOPLE), tapped);
+						feedback_push(FEEDBACK_DENIED, ROSTER_NONE);
 					}
-					
-					if(i == MAX_PEOPLE)
+					else if(door_leaving(reader, presence_test(inside, detected_person)))
 					{
-						detected_person = -1;
-					}
-					
-					// showing message on LCD upon decision of the person
-					LCDClear();
-					if(detected_person == -1)
-					{
-						PORTA = 0x7E;
-						LCDClear();
-						LCDWriteStringXY(0, 0, "Access denied!");
-						_delay_ms(2000);
-						PORTA = 0xFE;
-						LCDClear();
-						LCDWriteStringXY(0, 0, "Unrecognized!");
-					}
-					else
-					{
-						PORTA = 0xFD;
-						LCDClear();
-						LCDWriteStringXY(0, 0, "Access granted!");
-						_delay_ms(2000);
-						if(person_entry_list[i] == 0)
-						{
-							person_entry_list[i] = 1;
-						}
-						else
-						{
-							person_entry_list[i] = 0;
-						}
-						strcpy(msg_to_show, person_name[detected_person]);
-						if(person_entry_list[i] == 0)
+						//the reader tells the way, a second tap on the same side is only answered
+						if(presence_test(inside, detected_person))
 						{
-							/** Code to sound buzzer when a student is leaving **/
-							PORTA = 0x7D;
-							_delay_ms(200);
-							PORTA = 0xFD;
-							// end of buzzer code
-							
+							presence_clear(inside, detected_person);
 							//EEPROM WRITE
 							if(write_enable_eeprom == 1){
-								eeprom_update_byte ((uint8_t*) (&NonVolatileIsPresent[curr_day][i]), 0);
+								journal_append(JOURNAL_OUT, detected_person, tapped);
 							}
-							person_count--;
-							strcat(msg_to_show, left_msg);
+							export_tap(EXPORT_TAP_OUT, detected_person, presence_count(inside, MAX_PEOPLE), tapped);
 						}
-						else
+						feedback_push(FEEDBACK_LEFT, detected_person);
+					}
+					else
+					{
+						if(!presence_test(inside, detected_person))
 						{
-							/** Code to sound buzzer when a student is entering **/
-							PORTA = 0x7D;
-							_delay_ms(200);
-							PORTA = 0xFD;
-							_delay_ms(100);
-							PORTA = 0x7D;
-							_delay_ms(200);
-							PORTA = 0xFD;
-							// end of buzzer code
-							
+							presence_set(inside, detected_person);
 							//EEPROM WRITE
 							if(write_enable_eeprom == 1) {
-								eeprom_write_byte ((uint8_t*) (&NonVolatileIsPresent[curr_day][i]), 1);
-								eeprom_update_byte ((uint8_t*) (&NonVolatileHour[curr_day][i]), hour);
-								eeprom_update_byte ((uint8_t*) (&NonVolatileMinute[curr_day][i]), min);
-								eeprom_update_byte ((uint8_t*) (&NonVolatileSecond[curr_day][i]), sec);
+								journal_append(JOURNAL_IN, detected_person, tapped);
 							}
-							person_count++;
-							strcat(msg_to_show, entered_msg);
+							export_tap(EXPORT_TAP_IN, detected_person, presence_count(inside, MAX_PEOPLE), tapped);
 						}
-						LCDClear();
-						LCDWriteStringXY(0, 0, msg_to_show);
+						feedback_push(FEEDBACK_ENTERED, detected_person);
 					}
-					
-					_delay_ms(3000);
-					
-					PORTA = 0xFE;
-					LCDClear();
-					LED_animation_on = 1;
 				}
-				else
+				if(tag_count == 0)
 				{
-					LCDClear();
-					LCDWriteStringXY(0,1,"Error");
+					feedback_push(FEEDBACK_ERROR, ROSTER_NONE);
 				}
 			}
-			
-			_delay_ms(200);
 		}
 		else if(program_status == 2)
 		{
-			LCDClear();
-			LCDWriteStringXY(0, 0, "In session now!");
-			LCDWriteStringXY(0, 1, "#students:");
-			LCDWriteIntXY(12,1, person_count ,2 );
+			door_poll_start(POLL_GAP_SESSION);
+			if(feedback_count == 0 && view_page == VIEW_OFF)
+			{
+				LCDFrameClear();
+				LCDFrameStringXY(0, 0, "In session now!");
+				LCDFrameStringXY(0, 1, "#students:");
+				LCDFrameIntXY(12,1, presence_count(inside, MAX_PEOPLE) ,2 );
+				LCDFlush();
+			}
 			
-			byte = mfrc522_request(PICC_REQALL,str);
-			if(byte == CARD_FOUND)
+			while((reader = door_poll_next()) != NULL)
 			{
-				LED_animation_on = 0;
-				PORTA = 0x7E;
-				LCDClear();
-				LCDWriteStringXY(0, 0, "Warning!!");
-				_delay_ms(2000);
-				LCDClear();
-				LCDWriteStringXY(0, 0, "Session running.");
-				_delay_ms(2000);
-				PORTA = 0xFE;
-				LCDClear();
-				LCDWriteStringXY(0, 0, "Can't go out/in.");
-				_delay_ms(2000);
-				LCDClear();
-				PORTA = 0xFB;
-				LED_animation_on = 1;
+				//halted, a card left at a reader is warned about once, cards during a warning share it
+				mfrc522_inventory(&reader->rc, tags, MAX_TAGS);
+				if(feedback_count == 0)
+				{
+					feedback_push(FEEDBACK_WARNING, ROSTER_NONE);
+				}
 			}
-			_delay_ms(200);
 		}
 		else if(program_status == 3)
 		{
-			LCDClear();
-			LCDWriteStringXY(0, 0, "Session ended!");
-			LCDWriteStringXY(0, 1, "#students:");
-			LCDWriteIntXY(12,1, person_count ,2 );
+			//the last student left and the goodbye was shown, the reader waits for the next session
+			if(everyone_left && feedback_count == 0)
+			{
+				if(schedule_done())
+				{
+					break;
+				}
+				schedule_skip();
+				program_status = 0;
+				continue;
+			}
 			
-			byte = mfrc522_request(PICC_REQALL,str);
-			if(byte == CARD_FOUND)
+			door_poll_start(POLL_GAP_DOOR);
+			if(feedback_count == 0 && view_page == VIEW_OFF)
 			{
-				byte = mfrc522_get_card_serial(str);
-				if(byte == CARD_FOUND)
+				LCDFrameClear();
+				LCDFrameStringXY(0, 0, "Session ended!");
+				LCDFrameStringXY(0, 1, "#students:");
+				LCDFrameIntXY(12,1, presence_count(inside, MAX_PEOPLE) ,2 );
+				LCDFlush();
+			}
+			
+			while((reader = door_poll_next()) != NULL)
+			{
+				//every card in the field, a queue at the door gets through in one pass
+				tag_count = mfrc522_inventory(&reader->rc, tags, MAX_TAGS);
+				for(tag_i = 0; tag_i < tag_count; tag_i++)
 				{
-					LED_animation_on = 0;
+					// look the card up in the roster
+					detected_person = roster_lookup(&tags[tag_i]);
+					tapped = tap_time();
 					
-					// check for person 1
-					detected_person = -1;
-					for(i = 0; i < MAX_PEOPLE; i++)
+					if(detected_person == ROSTER_NONE)
 					{
-						for(byte = 0; byte < 5; byte++)
-						{
-							if(str[byte] != person_byte[i][byte])
-							{
-								break;
-							}
-						}
-						if(byte == 5)
-						{
-							detected_person = i;
-							break;
-						}
+						export_tap(EXPORT_TAP_DENIED, ROSTER_NONE, presence_count(inside, MAX_PEOPLE), tapped);
+						feedback_push(FEEDBACK_UNKNOWN, ROSTER_NONE);
 					}
-					
-					// showing message on LCD upon decision of the person
-					if(detected_person == -1)
+					else if(presence_test(inside, detected_person) && (reader->direction & DOOR_OUT))
 					{
-						PORTA = 0x7E;
-						LCDClear();
-						LCDWriteStringXY(0, 0, "Unrecognized!");
-						_delay_ms(2000);
-						PORTA = 0xFE;
-					}
-					else
-					{
-						
-						PORTA = 0xFB;
-						if(person_entry_list[detected_person] != 0){
-							LCDClear();
-							strcpy(msg_to_show, "Take care ");
-							strcat(msg_to_show, person_name[detected_person]);
-							LCDWriteStringXY(0, 0, msg_to_show);
-							_delay_ms(1000);
-							LCDClear();
-							strcpy(msg_to_show, person_name[detected_person]);
-							strcat(msg_to_show, left_msg);
-							LCDWriteStringXY(0, 0, msg_to_show);
-							person_entry_list[detected_person] = 0;
-							person_count--;
-							//unnecessary sanity check
-							if(person_count == 0)
-							{
-								break;
-							}
+						presence_clear(inside, detected_person);
+						export_tap(EXPORT_TAP_OUT, detected_person, presence_count(inside, MAX_PEOPLE), tapped);
+						feedback_push(FEEDBACK_GOODBYE, detected_person);
+						if(presence_count(inside, MAX_PEOPLE) == 0)
+						{
+							everyone_left = 1;
 						}
-						
 					}
-					
-					_delay_ms(3000);
-					
-					PORTA = 0xFD;
-					LCDClear();
-					LED_animation_on = 1;
 				}
-				else
+				if(tag_count == 0)
 				{
-					PORTA = 0x7E;
-					LCDClear();
-					LCDWriteStringXY(0,1,"Error");
-					_delay_ms(2000);
-					PORTA = 0xFE;
-					LCDClear();
-					PORTA = 0xFD;
+					feedback_push(FEEDBACK_ERROR, ROSTER_NONE);
 				}
 			}
-			
-			_delay_ms(200);
+		}
+		else if(program_status == 0)
+		{
+			//between sessions, nothing to read until the next one starts
+			if(schedule_done())
+			{
+				break;
+			}
+			if(view_page == VIEW_OFF)
+			{
+				LCDFrameClear();
+				LCDFrameStringXY(0, 0, "No class now.");
+				LCDFrameStringXY(0, 1, "Next at");
+				LCDFrameIntXY(8,1, schedule_deadline / 60 ,2 );
+				LCDFrameStringXY(10, 1, ":");
+				LCDFrameIntXY(11,1, schedule_deadline % 60 ,2 );
+				LCDFlush();
+			}
+			//the clock or the button wakes it up, the readers wait in soft power-down
+			door_rest();
+			set_sleep_mode(SLEEP_MODE_IDLE);
+			sleep_mode();
 		}
 		else
 		{
@@ -620,39 +962,52 @@ int main()
 			When leaving period has ended, but some students were still stuck in the classroom,
 			the buzzer buzzes off continuously suspecting that some students might be sick or in trouble.
 			***/
-			if(person_count != 0)
+			if(presence_count(inside, MAX_PEOPLE) != 0)
 			{
-				LED_animation_on = 0;
-				PORTA = 0x7E;
-				
-				LCDClear();
-				LCDWriteIntXY(0,0, person_count ,2 );
-				LCDWriteStringXY(3, 0, "student could");
-				LCDWriteStringXY(0, 1, "not get out");
-				_delay_ms(1500);
-				LCDClear();
-				LCDWriteStringXY(0, 0, "Take caution!");
-				_delay_ms(1500);
-				PORTA = 0xFE;
-				_delay_ms(400);
+				//the alarm goes round as a task, the button and the USART are still served
+				if(!sched_waiting(TASK_CHECK))
+				{
+					check_start(inside);
+				}
+				//the clock wakes it up for the next page
+				door_rest();
+				set_sleep_mode(SLEEP_MODE_IDLE);
+				sleep_mode();
 			}
 			else
 			{
-				/**When all students have left, nothing to do. **/
-				LCDClear();
-				break;
+				//messages of the last taps give way
+				feedback_clear();
+				/**When all students have left, nothing to do until the next session. **/
+				if(schedule_done())
+				{
+					LCDFrameClear();
+					break;
+				}
+				program_status = 0;
 			}
 		}
 	}
 	
+	eeprom_queue_flush();
 	LED_animation_on = 1;
 	PORTA = 0xFB;
 	temp_PORTA = PORTA;
-	LCDClear();
-	LCDWriteStringXY(0, 0, "Everyone left.");
+	//the day is over, the push button and the USART still give the database
+	door_rest();
+	set_sleep_mode(SLEEP_MODE_IDLE);
 	while(1)
 	{
-		;
+		sched_run();
+		view_poll();
+		export_poll();
+		if(view_page == VIEW_OFF)
+		{
+			LCDFrameClear();
+			LCDFrameStringXY(0, 0, "Everyone left.");
+			LCDFlush();
+		}
+		sleep_mode();
 	}
 	
 	cli();
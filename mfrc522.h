@@ -11,9 +11,19 @@
 #define CARD_FOUND		1
 #define CARD_NOT_FOUND	2
 #define ERROR			3
+#define COLLISION		4		//answers of several cards overlapped, see CollReg
 
 #define MAX_LEN			16
 
+//state of the card exchange in flight
+#define MFRC522_IDLE		0
+#define MFRC522_BUSY		1
+#define MFRC522_DONE		2
+#define MFRC522_TIMEOUT		3
+
+//CommandReg
+#define MFRC522_POWER_DOWN	0x10	//soft power-down, reads 1 until the oscillator runs again
+
 //Card types
 #define Mifare_UltraLight 	0x4400
 #define Mifare_One_S50		0x0400
@@ -35,13 +45,66 @@
 # define PICC_RESTORE         0xC2               // transfer block data to the buffer
 # define PICC_TRANSFER        0xB0               // save the data in the buffer
 # define PICC_HALT            0x50               // Sleep
+# define PICC_ANTICOLL_CL2    0x95               // anti-collision / select, cascade level 2
+# define PICC_ANTICOLL_CL3    0x97               // anti-collision / select, cascade level 3
+# define PICC_CASCADE_TAG     0x88               // first byte of an incomplete UID part
+
+/*
+ * A reader on the SPI bus. Every reader has its own SS pin; they share MOSI,
+ * MISO, SCK and the IRQ line, so one SPI frame is on the bus at a time but
+ * the card exchanges of several readers can be in flight together.
+ */
+struct mfrc522
+{
+	uint8_t ss;				//its SS bit on SPI_PORT
+	struct mfrc522 *next;	//the readers attached, see mfrc522_attach
+	
+	//the exchange in flight
+	uint8_t state;
+	uint8_t irq;			//ComIrqReg at the end of the exchange
+	uint8_t irq_en;
+	uint8_t wait_irq;
+	uint16_t spin;			//ComIrqReg polls left, without the IRQ line
+	
+	//session
+	uint8_t fault;			//the last exchange got no answer from the chip
+	uint8_t health_polls;
+	uint16_t fault_count;	//exchanges that timed out
+	uint16_t reinit_count;	//health checks that failed and re-initialized the reader
+};
+
+//UID of a selected card
+struct mfrc522_uid
+{
+	uint8_t size;		//4, 7 or 10 bytes
+	uint8_t bytes[10];
+	uint8_t sak;		//select acknowledge of the last cascade level
+};
 
-void mfrc522_init();
-void mfrc522_reset();
-void mfrc522_write(uint8_t reg, uint8_t data);
-uint8_t mfrc522_read(uint8_t reg);
-uint8_t	mfrc522_request(uint8_t req_mode, uint8_t * tag_type);
-uint8_t mfrc522_to_card(uint8_t cmd, uint8_t *send_data, uint8_t send_data_len, uint8_t *back_data, uint32_t *back_data_len);
-uint8_t mfrc522_get_card_serial(uint8_t * serial_out);
+void mfrc522_attach(struct mfrc522 *r, uint8_t ss_pin);
+void mfrc522_init(struct mfrc522 *r);
+void mfrc522_reset(struct mfrc522 *r);
+void mfrc522_power_down(struct mfrc522 *r);
+void mfrc522_power_up(struct mfrc522 *r);
+uint8_t mfrc522_version_ok(uint8_t version);
+void mfrc522_session(struct mfrc522 *r);
+void mfrc522_write(struct mfrc522 *r, uint8_t reg, uint8_t data);
+uint8_t mfrc522_read(struct mfrc522 *r, uint8_t reg);
+void mfrc522_write_burst(struct mfrc522 *r, uint8_t reg, const uint8_t *data, uint8_t len);
+void mfrc522_read_burst(struct mfrc522 *r, uint8_t reg, uint8_t *data, uint8_t len);
+void mfrc522_read_regs(struct mfrc522 *r, const uint8_t *regs, uint8_t *data, uint8_t len);
+uint8_t	mfrc522_request(struct mfrc522 *r, uint8_t req_mode, uint8_t * tag_type);
+void mfrc522_request_start(struct mfrc522 *r, uint8_t req_mode, uint8_t * tag_type);
+uint8_t	mfrc522_request_finish(struct mfrc522 *r, uint8_t * tag_type);
+uint8_t mfrc522_to_card(struct mfrc522 *r, uint8_t cmd, uint8_t *send_data, uint8_t send_data_len, uint8_t *back_data, uint32_t *back_data_len);
+void mfrc522_to_card_start(struct mfrc522 *r, uint8_t cmd, uint8_t *send_data, uint8_t send_data_len);
+uint8_t mfrc522_to_card_busy(struct mfrc522 *r);
+void mfrc522_wait();
+void mfrc522_alarm(uint16_t count);
+uint8_t mfrc522_to_card_finish(struct mfrc522 *r, uint8_t cmd, uint8_t *back_data, uint32_t *back_data_len);
+uint8_t mfrc522_get_card_serial(struct mfrc522 *r, uint8_t * serial_out);
+uint8_t mfrc522_select(struct mfrc522 *r, struct mfrc522_uid * uid);
+uint8_t mfrc522_halt(struct mfrc522 *r);
+uint8_t mfrc522_inventory(struct mfrc522 *r, struct mfrc522_uid * tags, uint8_t max_tags);
 
 #endif
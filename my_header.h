@@ -31,16 +31,17 @@ It requires some additional header files to be included.
 #define PORT(x) _CONCAT(PORT,x)
 #define PIN(x) _CONCAT(PIN,x)
 #define DDR(x) _CONCAT(DDR,x)
-#define LCD_RS D			//RS SIGNAL
-#define LCD_RS_POS PD0
+//PD0 and PD1 are RXD and TXD of the USART (export.h)
+#define LCD_RS C			//RS SIGNAL
+#define LCD_RS_POS PC6
 
-#define LCD_RW D			//RW SIGNAL
-#define LCD_RW_POS PD1
+#define LCD_RW C			//RW SIGNAL
+#define LCD_RW_POS PC7
 
 #define LCD_E D 			//Enable/strobe signal
 #define LCD_E_POS	PD2		//Position of enable in above port
 
-#define LCD_DATA D			//Port PD0-PD3 are connected to D4-D7
+#define LCD_DATA D			//Port PD3-PD6 are connected to D4-D7
 #define LCD_DATA_POS 3
 
 
@@ -65,6 +66,7 @@ void LCDGotoXY(uint8_t x,uint8_t y);
 void LCDHexDumpXY(uint8_t x, uint8_t y,uint8_t d);
 //Low level
 void LCDByte(uint8_t,uint8_t);
+void LCDSend(uint8_t,uint8_t);
 #define LCDCmd(c) (LCDByte(c,0))
 #define LCDData(d) (LCDByte(d,1))
 //
@@ -130,6 +132,15 @@ void LCDByte(uint8_t c,uint8_t isdata)
 
 	//NOTE: THIS FUNCTION RETURS ONLY WHEN LCD HAS PROCESSED THE COMMAND
 
+	LCDSend(c,isdata);
+	LCDBusyLoop();
+}
+
+void LCDSend(uint8_t c,uint8_t isdata)
+{
+	//Sends a byte to the LCD in 4bit mode and returns at once,
+	//the caller waits out the execution time of the LCD before the next one
+
 	uint8_t hn,ln;			//Nibbles
 	uint8_t temp;
 
@@ -172,8 +183,6 @@ void LCDByte(uint8_t c,uint8_t isdata)
 	CLEAR_E();
 
 	_delay_us(1);			//tEL
-
-	LCDBusyLoop();
 }
 
 void LCDBusyLoop()
@@ -432,16 +441,20 @@ spi.c
 //END spi_config
 void spi_init();
 uint8_t spi_transmit(uint8_t data);
-#define ENABLE_CHIP() (SPI_PORT &= (~(1<<SPI_SS)))
-#define DISABLE_CHIP() (SPI_PORT |= (1<<SPI_SS))
+//a slave is selected while its SS pin (ss a mask on SPI_PORT) is low, SPI_SS is the one of the first reader
+#define SPI_SELECT(ss) (SPI_PORT &= ~(ss))
+#define SPI_DESELECT(ss) (SPI_PORT |= (ss))
 /*END spi header*/
 
 
 #if SPI_CONFIG_AS_MASTER
 void spi_init()
 {
-	SPI_DDR = (1<<SPI_MOSI)|(1<<SPI_SCK)|(1<<SPI_SS);
-	SPCR = (1<<SPE)|(1<<MSTR)|(1<<SPR0);//prescaler 16
+	//the SS pins of the other slaves on SPI_DDR stay outputs
+	SPI_PORT |= (1<<SPI_SS);
+	SPI_DDR |= (1<<SPI_MOSI)|(1<<SPI_SCK)|(1<<SPI_SS);
+	SPCR = (1<<SPE)|(1<<MSTR);
+	SPSR = (1<<SPI2X);//prescaler 2, the RC522 takes up to 10 MHz and the readers share the bus
 }
 
 uint8_t spi_transmit(uint8_t data)
@@ -476,59 +489,234 @@ mfrc522.c
 ***************************************************/
 //start mfrc522.c
 #include "mfrc522.h"
-void mfrc522_init()
+//START mfrc522_config
+/*
+ * Set to 1, a card exchange ends on the IRQ output of the RC522 instead of
+ * polling ComIrqReg over SPI. INT0/INT1 carry the LCD and INT2 the button, so
+ * IRQ (active low) goes to T0/PB0: Timer0 counts falling edges on T0 and is
+ * preset to 0xFF, the first edge overflows it. Timer1 compare A (Timer1 runs
+ * at F_CPU, see main) ends the exchange if the edge never comes.
+ * The IRQ outputs of all readers are open drain on the same line, pulled up
+ * by PB0: it is low while any reader has an interrupt pending.
+ */
+#define MFRC522_CONFIG_IRQ	1
+#define MFRC522_IRQ_DDR		DDRB
+#define MFRC522_IRQ_PORT	PORTB
+#define MFRC522_IRQ_IN		PINB
+#define MFRC522_IRQ_PIN		PB0
+#define MFRC522_TIMEOUT_MS	25		//F_CPU/1000*MFRC522_TIMEOUT_MS has to fit 16 bits
+//the timer of the RC522 ends an exchange without an answer after MFRC522_RX_TICKS+1 ticks of 0.5 ms. A card
+//answers 86 us after the end of the frame (ISO/IEC 14443-3 FDT) and the timer stops when the answer starts:
+//2 ms instead of 15 ms, every empty poll is over that much sooner
+#define MFRC522_RX_TICKS	3
+//END mfrc522_config
+
+#if MFRC522_CONFIG_IRQ
+#include <avr/sleep.h>
+#endif
+
+struct mfrc522 *mfrc522_readers;		//every reader attached
+#if MFRC522_CONFIG_IRQ
+volatile uint8_t mfrc522_expired;		//MFRC522_TIMEOUT_MS went by since the last exchange started
+uint8_t mfrc522_in_flight;				//exchanges started and not finished
+#endif
+
+//reader session
+#define MFRC522_HEALTH_POLLS	32		//passes of the main loop between two health checks
+
+/*
+ * Before any frame on the bus: the SS pin of a reader left floating would
+ * let it take every frame meant for the others.
+ */
+void mfrc522_attach(struct mfrc522 *r, uint8_t ss_pin)
+{
+	r->ss = 1<<ss_pin;
+	r->state = MFRC522_IDLE;
+	SPI_DESELECT(r->ss);
+	SPI_DDR |= r->ss;
+	r->next = mfrc522_readers;
+	mfrc522_readers = r;
+}
+
+void mfrc522_init(struct mfrc522 *r)
 {
 	uint8_t byte;
-	mfrc522_reset();
+	mfrc522_reset(r);
 	
-	mfrc522_write(TModeReg, 0x8D);
-	mfrc522_write(TPrescalerReg, 0x3E);
-	mfrc522_write(TReloadReg_1, 30);
-	mfrc522_write(TReloadReg_2, 0);
-	mfrc522_write(TxASKReg, 0x40);
-	mfrc522_write(ModeReg, 0x3D);
+	mfrc522_write(r, TModeReg, 0x8D);
+	mfrc522_write(r, TPrescalerReg, 0x3E);
+	mfrc522_write(r, TReloadReg_1, 0);		//TReloadReg_1 is the high byte
+	mfrc522_write(r, TReloadReg_2, MFRC522_RX_TICKS);
+	mfrc522_write(r, TxASKReg, 0x40);
+	mfrc522_write(r, ModeReg, 0x3D);
+	mfrc522_write(r, CollReg, 0x00);	//ValuesAfterColl = 0: bits after a collision read 0
 	
-	byte = mfrc522_read(TxControlReg);
+	byte = mfrc522_read(r, TxControlReg);
 	if(!(byte&0x03))
 	{
-		mfrc522_write(TxControlReg,byte|0x03);
+		mfrc522_write(r, TxControlReg,byte|0x03);
 	}
+	
+#if MFRC522_CONFIG_IRQ
+	mfrc522_write(r, ComIEnReg, 0x80|0x31);	//IRqInv, IRQ on RxIRq IdleIRq TimerIRq
+	mfrc522_write(r, DivIEnReg, 0x00);			//open drain, the line is shared
+	mfrc522_write(r, ComIrqReg, 0x7F);			//the IdleIRq left by the reset would hold the line low
+	MFRC522_IRQ_DDR &= ~(1<<MFRC522_IRQ_PIN);
+	MFRC522_IRQ_PORT |= (1<<MFRC522_IRQ_PIN);	//pull-up
+	TCCR0 = (1<<CS02)|(1<<CS01);			//Timer0 clocked by falling edges on T0
+	TIMSK |= (1<<TOIE0);
+	set_sleep_mode(SLEEP_MODE_IDLE);
+#endif
 }
 
-void mfrc522_write(uint8_t reg, uint8_t data)
+void mfrc522_write(struct mfrc522 *r, uint8_t reg, uint8_t data)
 {
-	ENABLE_CHIP();
+	SPI_SELECT(r->ss);
 	spi_transmit((reg<<1)&0x7E);
 	spi_transmit(data);
-	DISABLE_CHIP();
+	SPI_DESELECT(r->ss);
 }
 
-uint8_t mfrc522_read(uint8_t reg)
+uint8_t mfrc522_read(struct mfrc522 *r, uint8_t reg)
 {
 	uint8_t data;
-	ENABLE_CHIP();
+	SPI_SELECT(r->ss);
 	spi_transmit(((reg<<1)&0x7E)|0x80);
 	data = spi_transmit(0x00);
-	DISABLE_CHIP();
+	SPI_DESELECT(r->ss);
 	return data;
 }
 
-void mfrc522_reset()
+/*
+ * Burst access, datasheet 8.1.2: within one chip select every byte after the
+ * address byte of a write goes to the same register, and every byte after the
+ * first of a read is the address of the next register to read. FIFODataReg can
+ * so be filled or drained with one address byte instead of one frame per byte.
+ */
+void mfrc522_write_burst(struct mfrc522 *r, uint8_t reg, const uint8_t *data, uint8_t len)
 {
-	mfrc522_write(CommandReg,SoftReset_CMD);
+	uint8_t i;
+	SPI_SELECT(r->ss);
+	spi_transmit((reg<<1)&0x7E);
+	for(i = 0; i < len; i++)
+	{
+		spi_transmit(data[i]);
+	}
+	SPI_DESELECT(r->ss);
 }
 
-uint8_t	mfrc522_request(uint8_t req_mode, uint8_t * tag_type)
+void mfrc522_read_burst(struct mfrc522 *r, uint8_t reg, uint8_t *data, uint8_t len)
 {
-	uint8_t  status;
-	uint32_t backBits;//The received data bits
+	uint8_t i;
+	uint8_t addr = ((reg<<1)&0x7E)|0x80;
+	if(len == 0)
+	{
+		return;
+	}
+	SPI_SELECT(r->ss);
+	spi_transmit(addr);
+	for(i = 0; i < len - 1; i++)
+	{
+		data[i] = spi_transmit(addr);
+	}
+	data[i] = spi_transmit(0x00);
+	SPI_DESELECT(r->ss);
+}
+
+//reads a block of (not necessarily adjacent) registers in one frame
+void mfrc522_read_regs(struct mfrc522 *r, const uint8_t *regs, uint8_t *data, uint8_t len)
+{
+	uint8_t i;
+	if(len == 0)
+	{
+		return;
+	}
+	SPI_SELECT(r->ss);
+	spi_transmit(((regs[0]<<1)&0x7E)|0x80);
+	for(i = 1; i < len; i++)
+	{
+		data[i-1] = spi_transmit(((regs[i]<<1)&0x7E)|0x80);
+	}
+	data[i-1] = spi_transmit(0x00);
+	SPI_DESELECT(r->ss);
+}
+
+//VersionReg of a chip that answers: MFRC522 version 1.0 or 2.0
+uint8_t mfrc522_version_ok(uint8_t version)
+{
+	return version == 0x91 || version == 0x92;
+}
+
+/*
+ * The reader is initialized once and kept running with its field on.
+ * Called once per pass of the main loop: after a fault, and every
+ * MFRC522_HEALTH_POLLS passes, VersionReg and TModeReg are read in one frame.
+ * A wrong version means the chip does not answer, a TModeReg other than the
+ * one mfrc522_init wrote means it was reset (brown-out). Only then is it
+ * initialized again.
+ */
+void mfrc522_session(struct mfrc522 *r)
+{
+	static const uint8_t health_regs[2] = {VersionReg, TModeReg};
+	uint8_t health[2];
+	
+	if(!r->fault && ++r->health_polls < MFRC522_HEALTH_POLLS)
+	{
+		return;
+	}
+	r->fault = 0;
+	r->health_polls = 0;
+	mfrc522_read_regs(r, health_regs, health, 2);
+	if(!mfrc522_version_ok(health[0]) || health[1] != 0x8D)
+	{
+		r->reinit_count++;
+		spi_init();
+		mfrc522_init(r);
+	}
+}
+
+void mfrc522_reset(struct mfrc522 *r)
+{
+	mfrc522_write(r, CommandReg,SoftReset_CMD);
+}
+
+/*
+ * Soft power-down (datasheet 8.6.2): the field and the oscillator stop and
+ * the chip draws some uA, the registers keep their values. After
+ * mfrc522_power_up the field is back once the oscillator runs, about a ms;
+ * the cards in the field start from IDLE again.
+ */
+void mfrc522_power_down(struct mfrc522 *r)
+{
+	mfrc522_write(r, CommandReg, MFRC522_POWER_DOWN|Idle_CMD);
+}
+
+void mfrc522_power_up(struct mfrc522 *r)
+{
+	mfrc522_write(r, CommandReg, Idle_CMD);
+}
 
-	mfrc522_write(BitFramingReg, 0x07);//TxLastBists = BitFramingReg[2..0]	???
+void mfrc522_request_start(struct mfrc522 *r, uint8_t req_mode, uint8_t * tag_type)
+{
+	mfrc522_write(r, BitFramingReg, 0x07);//TxLastBists = BitFramingReg[2..0]	???
 	
 	tag_type[0] = req_mode;
-	status = mfrc522_to_card(Transceive_CMD, tag_type, 1, tag_type, &backBits);
+	mfrc522_to_card_start(r, Transceive_CMD, tag_type, 1);
+}
 
-	if ((status != CARD_FOUND) || (backBits != 0x10))
+uint8_t	mfrc522_request_finish(struct mfrc522 *r, uint8_t * tag_type)
+{
+	uint8_t  status;
+	uint32_t backBits;//The received data bits
+
+	status = mfrc522_to_card_finish(r, Transceive_CMD, tag_type, &backBits);
+
+	//cards of different types answer together, the ATQA is garbled but they are there for the anticollision
+	if (status == COLLISION)
+	{
+		status = CARD_FOUND;
+	}
+	else if ((status != CARD_FOUND) || (backBits != 0x10))
 	{
 		status = ERROR;
 	}
@@ -536,84 +724,222 @@ uint8_t	mfrc522_request(uint8_t req_mode, uint8_t * tag_type)
 	return status;
 }
 
-uint8_t mfrc522_to_card(uint8_t cmd, uint8_t *send_data, uint8_t send_data_len, uint8_t *back_data, uint32_t *back_data_len)
+uint8_t	mfrc522_request(struct mfrc522 *r, uint8_t req_mode, uint8_t * tag_type)
+{
+	mfrc522_request_start(r, req_mode, tag_type);
+	return mfrc522_request_finish(r, tag_type);
+}
+
+#if MFRC522_CONFIG_IRQ
+//the IRQ line fell, a reader finished its exchange: the CPU wakes up and mfrc522_to_card_busy finds out which
+ISR(TIMER0_OVF_vect)
+{
+}
+
+//no IRQ within MFRC522_TIMEOUT_MS, the line is not connected or a reader hangs
+ISR(TIMER1_COMPA_vect)
+{
+	TIMSK &= ~(1<<OCIE1A);
+	mfrc522_expired = 1;
+}
+
+//Timer1 compare A is free between exchanges: it wakes the CPU when TCNT1 reaches `count`
+void mfrc522_alarm(uint16_t count)
+{
+	if (mfrc522_in_flight == 0)
+	{
+		OCR1A = count;
+		TIFR = (1<<OCF1A);
+		TIMSK |= (1<<OCIE1A);
+	}
+}
+
+/*
+ * The IRQ line is low: ComIrqReg of every reader with an exchange in flight
+ * is read, the ones that finished are cleared and let go of the line.
+ */
+void mfrc522_collect()
+{
+	struct mfrc522 *r;
+	for(r = mfrc522_readers; r; r = r->next)
+	{
+		if(r->state == MFRC522_BUSY)
+		{
+			//CommIrqReg[7..0]
+			//Set1 TxIRq RxIRq IdleIRq HiAlerIRq LoAlertIRq ErrIRq TimerIRq
+			r->irq = mfrc522_read(r, ComIrqReg);
+			if ((r->irq&0x01) || (r->irq&r->wait_irq))
+			{
+				r->state = MFRC522_DONE;
+				mfrc522_write(r, ComIrqReg, 0x7F);
+			}
+		}
+	}
+}
+#endif
+
+void mfrc522_to_card_start(struct mfrc522 *r, uint8_t cmd, uint8_t *send_data, uint8_t send_data_len)
 {
-	uint8_t status = ERROR;
-	uint8_t irqEn = 0x00;
-	uint8_t waitIRq = 0x00;
-	uint8_t lastBits;
 	uint8_t n;
-	uint8_t	tmp;
-	uint32_t i;
 
 	switch (cmd)
 	{
 		case MFAuthent_CMD:		//Certification cards close
 		{
-			irqEn = 0x12;
-			waitIRq = 0x10;
+			r->irq_en = 0x12;
+			r->wait_irq = 0x10;
 			break;
 		}
 		case Transceive_CMD:	//Transmit FIFO data
 		{
-			irqEn = 0x77;
-			waitIRq = 0x30;
+			r->irq_en = 0x77;
+			r->wait_irq = 0x30;
+			break;
+		}
+		case Transmit_CMD:		//Transmit FIFO data, no answer expected
+		{
+			r->irq_en = 0x11;
+			r->wait_irq = 0x10;
 			break;
 		}
 		default:
 		break;
 	}
 	
-	//mfrc522_write(ComIEnReg, irqEn|0x80);	//Interrupt request
-	n=mfrc522_read(ComIrqReg);
-	mfrc522_write(ComIrqReg,n&(~0x80));//clear all interrupt bits
-	n=mfrc522_read(FIFOLevelReg);
-	mfrc522_write(FIFOLevelReg,n|0x80);//flush FIFO data
+	//mfrc522_write(r, ComIEnReg, irqEn|0x80);	//Interrupt request
+	mfrc522_write(r, ComIrqReg,0x7F);//clear all interrupt bits (Set1 = 0 clears the marked bits), releases the IRQ line
+	mfrc522_write(r, FIFOLevelReg,0x80);//flush FIFO data, the other bits are read only
 	
-	mfrc522_write(CommandReg, Idle_CMD);	//NO action; Cancel the current cmd???
-
-	//Writing data to the FIFO
-	for (i=0; i<send_data_len; i++)
-	{
-		mfrc522_write(FIFODataReg, send_data[i]);
-	}
+	mfrc522_write(r, CommandReg, Idle_CMD);	//NO action; Cancel the current cmd???
+
+	//Writing data to the FIFO in one burst
+	mfrc522_write_burst(r, FIFODataReg, send_data, send_data_len);
+
+	r->state = MFRC522_BUSY;
+#if MFRC522_CONFIG_IRQ
+	//one deadline for all readers, the exchanges in flight started before this one
+	mfrc522_in_flight++;
+	OCR1A = TCNT1 + (uint16_t)(F_CPU / 1000UL * MFRC522_TIMEOUT_MS);
+	TIFR = (1<<OCF1A);
+	mfrc522_expired = 0;		//after the old deadline can no longer set it
+	TIMSK |= (1<<OCIE1A);
+#else
+	r->spin = 2000;	//i according to the clock frequency adjustment, the operator M1 card maximum waiting time 25ms???
+#endif
 
 	//Execute the cmd
-	mfrc522_write(CommandReg, cmd);
+	mfrc522_write(r, CommandReg, cmd);
 	if (cmd == Transceive_CMD)
 	{
-		n=mfrc522_read(BitFramingReg);
-		mfrc522_write(BitFramingReg,n|0x80);
+		n=mfrc522_read(r, BitFramingReg);
+		mfrc522_write(r, BitFramingReg,n|0x80);
 	}
-	
-	//Waiting to receive data to complete
-	i = 2000;	//i according to the clock frequency adjustment, the operator M1 card maximum waiting time 25ms???
-	do
+}
+
+//returns 1 while the exchange started by mfrc522_to_card_start is in flight
+uint8_t mfrc522_to_card_busy(struct mfrc522 *r)
+{
+	if (r->state == MFRC522_BUSY)
 	{
+#if MFRC522_CONFIG_IRQ
+		if (mfrc522_expired)
+		{
+			r->state = MFRC522_TIMEOUT;
+		}
+		else if (!(MFRC522_IRQ_IN & (1<<MFRC522_IRQ_PIN)))
+		{
+			mfrc522_collect();
+		}
+#else
 		//CommIrqReg[7..0]
 		//Set1 TxIRq RxIRq IdleIRq HiAlerIRq LoAlertIRq ErrIRq TimerIRq
-		n = mfrc522_read(ComIrqReg);
-		i--;
+		r->irq = mfrc522_read(r, ComIrqReg);
+		if ((r->irq&0x01) || (r->irq&r->wait_irq))
+		{
+			r->state = MFRC522_DONE;
+		}
+		else if (--r->spin == 0)
+		{
+			r->state = MFRC522_TIMEOUT;
+		}
+#endif
+	}
+	return r->state == MFRC522_BUSY;
+}
+
+/*
+ * Between two calls of mfrc522_to_card_busy: sleeps until the IRQ line falls
+ * or another interrupt comes. A reader that finished keeps the line low until
+ * it is collected and then no edge comes, so it only sleeps while the line is
+ * high. Without the IRQ line it returns at once.
+ */
+void mfrc522_wait()
+{
+#if MFRC522_CONFIG_IRQ
+	cli();
+	TCNT0 = 0xFF;		//the next falling edge on T0 overflows Timer0
+	if (MFRC522_IRQ_IN & (1<<MFRC522_IRQ_PIN))
+	{
+		//the instruction after sei() is executed before any interrupt, so the wake-up cannot be missed
+		sleep_enable();
+		sei();
+		sleep_cpu();
+		sleep_disable();
+	}
+	sei();
+#endif
+}
+
+uint8_t mfrc522_to_card_finish(struct mfrc522 *r, uint8_t cmd, uint8_t *back_data, uint32_t *back_data_len)
+{
+	uint8_t status = ERROR;
+	uint8_t lastBits;
+	uint8_t n;
+	uint8_t	tmp;
+	static const uint8_t result_regs[3] = {ErrorReg, FIFOLevelReg, ControlReg};
+	uint8_t result[3];
+
+	//Waiting to receive data to complete
+	while (mfrc522_to_card_busy(r))
+	{
+		mfrc522_wait();
+	}
+#if MFRC522_CONFIG_IRQ
+	if (--mfrc522_in_flight == 0)
+	{
+		TIMSK &= ~(1<<OCIE1A);
+	}
+#endif
+	n = r->irq;
+	if (r->state == MFRC522_TIMEOUT)
+	{
+		r->fault = 1;
+		r->fault_count++;
 	}
-	while ((i!=0) && !(n&0x01) && !(n&waitIRq));
 
-	tmp=mfrc522_read(BitFramingReg);
-	mfrc522_write(BitFramingReg,tmp&(~0x80));
+	tmp=mfrc522_read(r, BitFramingReg);
+	mfrc522_write(r, BitFramingReg,tmp&(~0x80));
 	
-	if (i != 0)
+	if (r->state == MFRC522_DONE)
 	{
-		if(!(mfrc522_read(ErrorReg) & 0x1B))	//BufferOvfl Collerr CRCErr ProtecolErr
+		//ErrorReg, FIFOLevelReg and ControlReg in one frame
+		mfrc522_read_regs(r, result_regs, result, 3);
+		if(!(result[0] & 0x13))	//BufferOvfl CRCErr ProtecolErr
 		{
 			status = CARD_FOUND;
-			if (n & irqEn & 0x01)
+			if (n & r->irq_en & 0x01)
 			{
 				status = CARD_NOT_FOUND;			//??
 			}
+			if (result[0] & 0x08)	//CollErr, the received bits up to CollReg are valid
+			{
+				status = COLLISION;
+			}
 
 			if (cmd == Transceive_CMD)
 			{
-				n = mfrc522_read(FIFOLevelReg);
-				lastBits = mfrc522_read(ControlReg) & 0x07;
+				n = result[1];
+				lastBits = result[2] & 0x07;
 				if (lastBits)
 				{
 					*back_data_len = (n-1)*8 + lastBits;
@@ -632,11 +958,8 @@ uint8_t mfrc522_to_card(uint8_t cmd, uint8_t *send_data, uint8_t send_data_len,
 					n = MAX_LEN;
 				}
 				
-				//Reading the received data in FIFO
-				for (i=0; i<n; i++)
-				{
-					back_data[i] = mfrc522_read(FIFODataReg);
-				}
+				//Reading the received data in FIFO in one burst
+				mfrc522_read_burst(r, FIFODataReg, back_data, n);
 			}
 		}
 		else
@@ -645,26 +968,33 @@ uint8_t mfrc522_to_card(uint8_t cmd, uint8_t *send_data, uint8_t send_data_len,
 		}
 		
 	}
+	r->state = MFRC522_IDLE;
 	
 	//SetBitMask(ControlReg,0x80);           //timer stops
-	//mfrc522_write(cmdReg, PCD_IDLE);
+	//mfrc522_write(r, cmdReg, PCD_IDLE);
 
 	return status;
 }
 
+uint8_t mfrc522_to_card(struct mfrc522 *r, uint8_t cmd, uint8_t *send_data, uint8_t send_data_len, uint8_t *back_data, uint32_t *back_data_len)
+{
+	mfrc522_to_card_start(r, cmd, send_data, send_data_len);
+	return mfrc522_to_card_finish(r, cmd, back_data, back_data_len);
+}
 
-uint8_t mfrc522_get_card_serial(uint8_t * serial_out)
+
+uint8_t mfrc522_get_card_serial(struct mfrc522 *r, uint8_t * serial_out)
 {
 	uint8_t status;
 	uint8_t i;
 	uint8_t serNumCheck=0;
 	uint32_t unLen;
 	
-	mfrc522_write(BitFramingReg, 0x00);		//TxLastBists = BitFramingReg[2..0]
+	mfrc522_write(r, BitFramingReg, 0x00);		//TxLastBists = BitFramingReg[2..0]
 	
 	serial_out[0] = PICC_ANTICOLL;
 	serial_out[1] = 0x20;
-	status = mfrc522_to_card(Transceive_CMD, serial_out, 2, serial_out, &unLen);
+	status = mfrc522_to_card(r, Transceive_CMD, serial_out, 2, serial_out, &unLen);
 
 	if (status == CARD_FOUND)
 	{
@@ -680,6 +1010,197 @@ uint8_t mfrc522_get_card_serial(uint8_t * serial_out)
 	}
 	return status;
 }
+
+//CRC_A of ISO/IEC 14443-3 (x^16 + x^12 + x^5 + 1, preset 0x6363, LSB first), computed here instead of with CalcCRC_CMD
+void mfrc522_crc_a(uint8_t *data, uint8_t len, uint8_t *crc_out)
+{
+	uint16_t crc = 0x6363;
+	uint8_t i, b;
+	for(i = 0; i < len; i++)
+	{
+		b = data[i] ^ (uint8_t)crc;
+		b ^= b<<4;
+		crc = (crc>>8) ^ ((uint16_t)b<<8) ^ ((uint16_t)b<<3) ^ (b>>4);
+	}
+	crc_out[0] = crc & 0xFF;
+	crc_out[1] = crc >> 8;
+}
+
+/*
+ * Bit oriented anticollision on one cascade level (ISO/IEC 14443-3 6.5.3).
+ * The known bits of the UID part are sent with NVB, TxLastBits and RxAlign
+ * telling their length, every card that matches answers with the rest. On a
+ * collision CollReg gives the first bit the cards disagree on; that bit is
+ * set to 1, which leaves only the cards with a 1 there, and the loop goes on
+ * with one known bit more. Returns CARD_FOUND with the 4 bytes and the BCC
+ * of one card in cl.
+ */
+uint8_t mfrc522_anticoll(struct mfrc522 *r, uint8_t sel, uint8_t * cl)
+{
+	uint8_t buf[7];
+	uint8_t rx[MAX_LEN];
+	uint8_t known = 0;		//bits of CLn+BCC already known
+	uint8_t bytes, bits, pos, i, status;
+	uint32_t unLen;
+	
+	buf[0] = sel;
+	while(known < 40)
+	{
+		bytes = known / 8;
+		bits = known % 8;
+		buf[1] = ((2 + bytes) << 4) | bits;		//NVB
+		mfrc522_write(r, BitFramingReg, (bits << 4) | bits);	//RxAlign, TxLastBits
+		status = mfrc522_to_card(r, Transceive_CMD, buf, 2 + bytes + (bits ? 1 : 0), rx, &unLen);
+		if(status != CARD_FOUND && status != COLLISION)
+		{
+			return ERROR;
+		}
+		//the first byte received completes the partly known byte
+		if(bits)
+		{
+			buf[2 + bytes] = (buf[2 + bytes] & ((1 << bits) - 1)) | (rx[0] & ~((1 << bits) - 1));
+		}
+		else
+		{
+			buf[2 + bytes] = rx[0];
+		}
+		for(i = 1; 2 + bytes + i < 7; i++)
+		{
+			buf[2 + bytes + i] = rx[i];
+		}
+		if(status == CARD_FOUND)
+		{
+			known = 40;
+			break;
+		}
+		pos = mfrc522_read(r, CollReg);
+		if(pos & 0x20)		//CollPosNotValid
+		{
+			return ERROR;
+		}
+		pos &= 0x1F;
+		if(pos == 0)
+		{
+			pos = 32;
+		}
+		//CollPos counts from bit 1 of the first received byte, RxAlign included
+		known = bytes * 8 + pos;
+		if(known > 40)
+		{
+			return ERROR;
+		}
+		buf[2 + (known - 1) / 8] |= 1 << ((known - 1) % 8);
+	}
+	mfrc522_write(r, BitFramingReg, 0x00);
+	for(i = 0; i < 5; i++)
+	{
+		cl[i] = buf[2 + i];
+	}
+	if((cl[0] ^ cl[1] ^ cl[2] ^ cl[3]) != cl[4])
+	{
+		return ERROR;
+	}
+	return CARD_FOUND;
+}
+
+/*
+ * Anticollision and SELECT through the cascade levels of one card in READY
+ * state. A SAK with bit 2 set means the UID continues on the next level; the
+ * cascade tag 0x88 in front of such a part is not part of the UID.
+ */
+uint8_t mfrc522_select(struct mfrc522 *r, struct mfrc522_uid * uid)
+{
+	static const uint8_t sel_codes[3] = {PICC_ANTICOLL, PICC_ANTICOLL_CL2, PICC_ANTICOLL_CL3};
+	uint8_t buf[9];
+	uint8_t rx[MAX_LEN];
+	uint8_t crc[2];
+	uint8_t level, i, status;
+	uint32_t unLen;
+	
+	uid->size = 0;
+	for(level = 0; level < 3; level++)
+	{
+		buf[0] = sel_codes[level];
+		status = mfrc522_anticoll(r, buf[0], buf + 2);
+		if(status != CARD_FOUND)
+		{
+			return status;
+		}
+		buf[1] = 0x70;		//NVB: all 40 bits
+		mfrc522_crc_a(buf, 7, buf + 7);
+		status = mfrc522_to_card(r, Transceive_CMD, buf, 9, rx, &unLen);
+		if(status != CARD_FOUND || unLen != 24)
+		{
+			return ERROR;
+		}
+		mfrc522_crc_a(rx, 1, crc);
+		if(rx[1] != crc[0] || rx[2] != crc[1])
+		{
+			return ERROR;
+		}
+		uid->sak = rx[0];
+		if(rx[0] & 0x04)	//UID not complete
+		{
+			if(buf[2] != PICC_CASCADE_TAG)
+			{
+				return ERROR;
+			}
+			for(i = 0; i < 3; i++)
+			{
+				uid->bytes[uid->size++] = buf[3 + i];
+			}
+		}
+		else
+		{
+			for(i = 0; i < 4; i++)
+			{
+				uid->bytes[uid->size++] = buf[2 + i];
+			}
+			return CARD_FOUND;
+		}
+	}
+	return ERROR;
+}
+
+//HLTA: the selected card goes to HALT and only answers WUPA from now on
+uint8_t mfrc522_halt(struct mfrc522 *r)
+{
+	uint8_t buf[4];
+	uint32_t unLen;
+	
+	buf[0] = PICC_HALT;
+	buf[1] = 0x00;
+	mfrc522_crc_a(buf, 2, buf + 2);
+	//the card does not answer an HLTA, so only transmit
+	return mfrc522_to_card(r, Transmit_CMD, buf, 4, buf, &unLen);
+}
+
+/*
+ * Call after mfrc522_request returned CARD_FOUND. Selects one card, puts it
+ * to HALT so it keeps quiet, and asks the remaining ones with REQIDL until
+ * none answers. Returns the number of UIDs written to tags.
+ */
+uint8_t mfrc522_inventory(struct mfrc522 *r, struct mfrc522_uid * tags, uint8_t max_tags)
+{
+	uint8_t count = 0;
+	uint8_t tries = 0;
+	uint8_t atqa[MAX_LEN];
+	
+	do
+	{
+		if(mfrc522_select(r, &tags[count]) == CARD_FOUND)
+		{
+			mfrc522_halt(r);
+			count++;
+		}
+		else if(++tries > max_tags)
+		{
+			break;
+		}
+	}
+	while(count < max_tags && mfrc522_request(r, PICC_REQIDL, atqa) == CARD_FOUND);
+	return count;
+}
 //end mfrc22
 /***************************************************
 END   mfrc22.c
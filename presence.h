@@ -0,0 +1,86 @@
+/*
+ * presence.h
+ * Who is inside, one bit per student.
+ *
+ * Bit i of a set is student i of the roster: bit i & 7 of byte i >> 3.
+ * A class of 100 fits in 13 bytes instead of 200 (int per student).
+ */
+#ifndef PRESENCE_H
+#define PRESENCE_H
+
+#include <stdint.h>
+#include <string.h>
+#include <avr/pgmspace.h>
+
+//bytes of a set of n students
+#define PRESENCE_BYTES(n)	(((n) + 7) >> 3)
+
+//returned by presence_next() after the last student inside
+#define PRESENCE_END		0xFFFF
+
+//bits set in every nibble
+const uint8_t presence_nibble_bits[16] PROGMEM = {0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4};
+
+uint8_t presence_test(const uint8_t *set, uint16_t i)
+{
+	return (set[i >> 3] >> (i & 7)) & 1;
+}
+
+void presence_set(uint8_t *set, uint16_t i)
+{
+	set[i >> 3] |= 1 << (i & 7);
+}
+
+void presence_clear(uint8_t *set, uint16_t i)
+{
+	set[i >> 3] &= ~(1 << (i & 7));
+}
+
+//everyone in (value 1) or out (value 0), the bits past student n-1 stay 0
+void presence_fill(uint8_t *set, uint16_t n, uint8_t value)
+{
+	memset(set, value ? 0xFF : 0x00, PRESENCE_BYTES(n));
+	if(value && (n & 7))
+	{
+		set[n >> 3] = (1 << (n & 7)) - 1;
+	}
+}
+
+//number of students inside, a table lookup per nibble
+uint16_t presence_count(const uint8_t *set, uint16_t n)
+{
+	uint16_t count = 0;
+	
+	for(uint16_t b = 0; b < PRESENCE_BYTES(n); b++)
+	{
+		count += pgm_read_byte(&presence_nibble_bits[set[b] & 0x0F]);
+		count += pgm_read_byte(&presence_nibble_bits[set[b] >> 4]);
+	}
+	return count;
+}
+
+//first student inside at or after `from`, PRESENCE_END if there is none
+//for(i = presence_next(set, n, 0); i != PRESENCE_END; i = presence_next(set, n, i + 1))
+uint16_t presence_next(const uint8_t *set, uint16_t n, uint16_t from)
+{
+	while(from < n)
+	{
+		uint8_t bits = set[from >> 3] >> (from & 7);
+		
+		if(bits == 0)
+		{
+			//nobody in the rest of this byte
+			from = (from | 7) + 1;
+			continue;
+		}
+		while((bits & 1) == 0)
+		{
+			bits >>= 1;
+			from++;
+		}
+		return from < n ? from : PRESENCE_END;
+	}
+	return PRESENCE_END;
+}
+
+#endif /* PRESENCE_H */
@@ -0,0 +1,85 @@
+/*
+ * roster.h
+ * The students of the class, looked up by the UID of their tag.
+ *
+ * roster_table.h is compiled from roster.csv by host/roster_gen: a minimal
+ * perfect hash of the UIDs, the student of every slot and the names, all in
+ * flash. A lookup hashes the UID twice and compares one 32 bit key, whatever
+ * the size of the class. Tags with 7 and 10 byte UIDs can be enrolled too:
+ * their key folds the whole UID (roster_key()), and the size and the bytes
+ * after the fourth are compared as well. Entry and exit phases share
+ * roster_lookup().
+ */
+#ifndef ROSTER_H
+#define ROSTER_H
+
+#include <stdint.h>
+#include <avr/pgmspace.h>
+#include "mfrc522.h"
+#include "roster_hash.h"
+
+//the 4 UID bytes of a tag as one key, in the order they come off the air
+#define ROSTER_UID(b0, b1, b2, b3)	((uint32_t)(b0) | ((uint32_t)(b1) << 8) | \
+									((uint32_t)(b2) << 16) | ((uint32_t)(b3) << 24))
+
+//returned for a tag that is not in the roster
+#define ROSTER_NONE		-1
+
+//ROSTER_SIZE, ROSTER_NAME_LEN and the tables in flash
+#include "roster_table.h"
+
+//slot of the key, the one place in roster_uid[] it can be
+uint16_t roster_slot(uint32_t key)
+{
+	uint16_t bucket = ROSTER_RANGE(roster_hash(key, 0), ROSTER_BUCKETS);
+	
+	return ROSTER_RANGE(roster_hash(key, pgm_read_word(&roster_seed[bucket])), ROSTER_SIZE);
+}
+
+//index of the student holding the tag, ROSTER_NONE for an unknown tag
+int16_t roster_lookup(const struct mfrc522_uid *uid)
+{
+	uint32_t key;
+	uint16_t slot;
+	
+#if ROSTER_UID_MAX > 4
+	if(uid->size > ROSTER_UID_MAX)
+#else
+	//the roster only holds single size (4 byte) UIDs
+	if(uid->size != 4)
+#endif
+	{
+		return ROSTER_NONE;
+	}
+	key = roster_key(uid->bytes, uid->size);
+	slot = roster_slot(key);
+	
+	//any other tag hashes to the slot of some student too
+	if(pgm_read_dword(&roster_uid[slot]) != key)
+	{
+		return ROSTER_NONE;
+	}
+#if ROSTER_UID_MAX > 4
+	//with the size and the last bytes the key tells the whole UID
+	if(pgm_read_byte(&roster_uid_size[slot]) != uid->size)
+	{
+		return ROSTER_NONE;
+	}
+	for(uint8_t i = 4; i < uid->size; i++)
+	{
+		if(pgm_read_byte(&roster_uid_rest[slot][i - 4]) != uid->bytes[i])
+		{
+			return ROSTER_NONE;
+		}
+	}
+#endif
+	return pgm_read_word(&roster_person[slot]);
+}
+
+//name of the student in flash, for strcpy_P()/strcat_P()
+const char *roster_name(int16_t person)
+{
+	return roster_names + pgm_read_word(&roster_name_at[person]);
+}
+
+#endif /* ROSTER_H */
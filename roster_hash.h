@@ -0,0 +1,47 @@
+/*
+ * roster_hash.h
+ * Hash of the minimal perfect hash table in roster_table.h, shared by the
+ * firmware and the roster compiler in host/roster_gen.c.
+ *
+ * A key is hashed once with seed 0 to find its bucket, then with the seed
+ * of its bucket to find its slot. The compiler picks the bucket seeds so
+ * that every student gets a slot of their own.
+ */
+#ifndef ROSTER_HASH_H
+#define ROSTER_HASH_H
+
+#include <stdint.h>
+
+//16 bits of a multiply-xorshift mix of the key and the seed, every UID bit
+//reaches the result (the host links compiler and tables together: static)
+static inline uint16_t roster_hash(uint32_t key, uint16_t seed)
+{
+	key ^= seed;
+	key *= 0x9E3779B1UL;
+	key ^= key >> 16;
+	key *= 0x85EBCA77UL;
+	return key >> 16;
+}
+
+//key of a UID of `size` bytes: a single size UID is its 4 bytes in the order they come off
+//the air, a double or triple size one folds its other bytes and its size into them; for the
+//same size and last bytes no two UIDs get the same key
+static inline uint32_t roster_key(const uint8_t *uid, uint8_t size)
+{
+	uint32_t key = (uint32_t)uid[0] | ((uint32_t)uid[1] << 8) | ((uint32_t)uid[2] << 16) | ((uint32_t)uid[3] << 24);
+	
+	if(size > 4)
+	{
+		for(uint8_t i = 4; i < size; i++)
+		{
+			key = (key ^ uid[i]) * 0x01000193UL;
+		}
+		key ^= size;
+	}
+	return key;
+}
+
+//maps a 16 bit hash onto 0 ... n-1 with a multiply instead of a division
+#define ROSTER_RANGE(h, n)	((uint16_t)(((uint32_t)(h) * (n)) >> 16))
+
+#endif /* ROSTER_HASH_H */
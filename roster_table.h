@@ -0,0 +1,45 @@
+/*
+ * roster_table.h
+ * Generated by host/roster_gen from roster.csv, do not edit.
+ * Minimal perfect hash of the UIDs of the students (see roster_hash.h)
+ * and their names.
+ */
+#ifndef ROSTER_TABLE_H
+#define ROSTER_TABLE_H
+
+#define ROSTER_SIZE		3
+#define ROSTER_BUCKETS	2
+//longest name with its terminating 0
+#define ROSTER_NAME_LEN	6
+//longest UID in bytes
+#define ROSTER_UID_MAX	4
+
+//seed of the slot hash of every bucket
+const uint16_t roster_seed[ROSTER_BUCKETS] PROGMEM = {
+	1, 1
+};
+
+//key of the student in every slot
+const uint32_t roster_uid[ROSTER_SIZE] PROGMEM = {
+	ROSTER_UID(0xF9, 0x46, 0x1D, 0x00),		//Ripon
+	ROSTER_UID(0xA3, 0x7E, 0x30, 0x02),		//Nimi
+	ROSTER_UID(0x23, 0x6D, 0xD6, 0x00)		//Sibat
+};
+
+//student of every slot, the row of the student in the roster
+const uint16_t roster_person[ROSTER_SIZE] PROGMEM = {
+	1, 2, 0
+};
+
+//names of the students one after the other, each 0 terminated
+const char roster_names[] PROGMEM =
+	"Sibat\0"
+	"Ripon\0"
+	"Nimi";
+
+//where the name of every student starts in roster_names
+const uint16_t roster_name_at[ROSTER_SIZE] PROGMEM = {
+	0, 6, 12
+};
+
+#endif /* ROSTER_TABLE_H */
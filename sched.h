@@ -0,0 +1,105 @@
+/*
+ * sched.h
+ * Timed tasks for the main loop: instead of waiting in _delay_ms(), a task
+ * asks to be called again after a while and returns. The main loop keeps
+ * polling the reader and calls sched_run(), which runs every task that is
+ * due. A task runs to its end, nothing is preempted.
+ *
+ * The time is read from Timer1 (1 MHz, no prescaler, free running), whose
+ * overflow interrupt counts sched_overflows: a tick is 1024 timer counts,
+ * 1.024 ms.
+ */
+#ifndef SCHED_H
+#define SCHED_H
+
+#include <stdint.h>
+#include <avr/io.h>
+#include <avr/interrupt.h>
+
+//number of tasks, a task is named by its index
+#ifndef SCHED_TASKS
+#define SCHED_TASKS		2
+#endif
+
+//milliseconds in ticks, 1000 / 1024 = 125 / 128
+#define SCHED_MS(ms)	((uint32_t)(ms) * 125 / 128)
+
+struct sched_task
+{
+	uint32_t due;			//tick at which it runs
+	void (*run)(void);		//NULL when it does not wait
+};
+
+struct sched_task sched_tasks[SCHED_TASKS];
+
+//incremented by the TIMER1_OVF interrupt
+volatile uint32_t sched_overflows;
+
+//ticks since Timer1 started
+uint32_t sched_now(void)
+{
+	uint32_t overflows;
+	uint16_t count;
+	uint8_t sreg;
+
+	sreg = SREG;
+	cli();
+	overflows = sched_overflows;
+	count = TCNT1;
+	//the counter wrapped and its interrupt is still waiting
+	if((TIFR & (1<<TOV1)) && count < 0x8000)
+	{
+		overflows++;
+	}
+	SREG = sreg;
+	return (overflows << 6) | (count >> 10);
+}
+
+//`run` is called by sched_run() `ms` milliseconds from now, instead of a call that was waiting
+void sched_after(uint8_t task, uint16_t ms, void (*run)(void))
+{
+	sched_tasks[task].due = sched_now() + SCHED_MS(ms);
+	sched_tasks[task].run = run;
+}
+
+void sched_cancel(uint8_t task)
+{
+	sched_tasks[task].run = NULL;
+}
+
+uint8_t sched_waiting(uint8_t task)
+{
+	return sched_tasks[task].run != NULL;
+}
+
+//the tick at which the first waiting task is due, `until` when none is due before it
+uint32_t sched_next(uint32_t until)
+{
+	for(uint8_t i = 0; i < SCHED_TASKS; i++)
+	{
+		if(sched_tasks[i].run != NULL && (int32_t)(sched_tasks[i].due - until) < 0)
+		{
+			until = sched_tasks[i].due;
+		}
+	}
+	return until;
+}
+
+//runs the tasks that are due, a task may ask for its next call while it runs
+void sched_run(void)
+{
+	uint32_t now = sched_now();
+	void (*run)(void);
+
+	for(uint8_t i = 0; i < SCHED_TASKS; i++)
+	{
+		run = sched_tasks[i].run;
+		if(run != NULL && (int32_t)(now - sched_tasks[i].due) >= 0)
+		{
+			sched_tasks[i].run = NULL;
+			run();
+		}
+	}
+}
+
+#endif /* SCHED_H */
@@ -0,0 +1,98 @@
+/*
+ * schedule.h
+ * The timetable of the day: every session of the day is four transitions in
+ * a table in flash, in minutes since the device was switched on.
+ *
+ * The clock only compares the minute with the deadline of the next
+ * transition (schedule_minute()) and raises schedule_due. The main loop takes
+ * the transition with schedule_take(), which loads the next deadline.
+ *
+ * The table is SCHEDULE, a list of SCHEDULE_SESSION(), defined before this
+ * header is included, in the order of the day.
+ */
+#ifndef SCHEDULE_H
+#define SCHEDULE_H
+
+#include <stdint.h>
+#include <avr/io.h>
+#include <avr/interrupt.h>
+#include <avr/pgmspace.h>
+
+//phases of a session, program_status in main.c, 0 is between sessions
+#define SCHEDULE_PHASE_IDLE		0
+#define SCHEDULE_PHASE_ENTRANCE	1
+#define SCHEDULE_PHASE_SESSION	2
+#define SCHEDULE_PHASE_LEAVING	3
+#define SCHEDULE_PHASE_CHECK		4
+
+//the deadline after the last transition of the day
+#define SCHEDULE_END		0xFFFF
+
+struct schedule_entry
+{
+	uint16_t minute;
+	uint8_t phase;
+};
+
+//a session starting at minute `start`, the lengths of its periods in minutes
+#define SCHEDULE_SESSION(start, entrance, session, await) \
+	{ (start), SCHEDULE_PHASE_ENTRANCE }, \
+	{ (start) + (entrance), SCHEDULE_PHASE_SESSION }, \
+	{ (start) + (entrance) + (session), SCHEDULE_PHASE_LEAVING }, \
+	{ (start) + (entrance) + (session) + (await), SCHEDULE_PHASE_CHECK }
+
+const struct schedule_entry schedule_table[] PROGMEM = { SCHEDULE };
+
+#define SCHEDULE_LENGTH		(sizeof(schedule_table) / sizeof(schedule_table[0]))
+
+volatile uint16_t schedule_minutes;		//since the clock started
+volatile uint16_t schedule_deadline;	//minute of the next transition
+volatile uint8_t schedule_due;			//the next transition is due
+uint8_t schedule_index;					//of the next transition
+
+//from the clock, once a minute
+#define schedule_minute() do { if(++schedule_minutes >= schedule_deadline) schedule_due = 1; } while(0)
+
+//next transition from schedule_index on, due at once if its minute has passed
+void schedule_load(void)
+{
+	uint8_t sreg = SREG;
+
+	cli();
+	schedule_deadline = schedule_index < SCHEDULE_LENGTH ? pgm_read_word(&schedule_table[schedule_index].minute) : SCHEDULE_END;
+	schedule_due = schedule_minutes >= schedule_deadline;
+	SREG = sreg;
+}
+
+//the day starts at minute 0, a session at minute 0 is due at once
+void schedule_start(void)
+{
+	schedule_minutes = 0;
+	schedule_index = 0;
+	schedule_load();
+}
+
+//the phase the due transition starts, the next deadline is loaded
+uint8_t schedule_take(void)
+{
+	uint8_t phase = pgm_read_byte(&schedule_table[schedule_index].phase);
+
+	schedule_index++;
+	schedule_load();
+	return phase;
+}
+
+//the rest of the session is left out, the next transition starts the next session
+void schedule_skip(void)
+{
+	while(schedule_index < SCHEDULE_LENGTH && pgm_read_byte(&schedule_table[schedule_index].phase) != SCHEDULE_PHASE_ENTRANCE)
+	{
+		schedule_index++;
+	}
+	schedule_load();
+}
+
+//no transition left today
+#define schedule_done() (schedule_deadline == SCHEDULE_END)
+
+#endif /* SCHEDULE_H */